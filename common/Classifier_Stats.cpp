@@ -0,0 +1,252 @@
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+#include "Classifier_Stats.h"
+
+
+/**
+ * Increments a counter that is written by a single thread. A relaxed load and store are enough and avoid the locked
+ * read-modify-write of fetch_add
+ *
+ * @param counter  The counter
+ */
+static inline void increment(std::atomic<uint64_t> &counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+// ------------- Constructors ------------- //
+/**
+ * Class constructor
+ *
+ * @param n_slots  The number of slots. Every thread that records classifications needs its own slot
+ */
+Classifier_Stats::Classifier_Stats(int n_slots) : n_slots(n_slots) {
+    // new does not respect the alignment of the slots in C++14
+    void *memory = nullptr;
+    if (posix_memalign(&memory, STATS_CACHE_LINE, sizeof(Slot) * size_t(n_slots)) != 0) {
+        throw std::bad_alloc();
+    }
+
+    Classifier_Stats::slots = (Slot *) memory;
+
+    for (int i = 0; i < n_slots; i++) {
+        Slot *slot = new (&slots[i]) Slot;
+
+        for (auto & row : slot->confusion) {
+            for (auto & counter : row) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        for (auto & histogram : slot->latency_histograms) {
+            for (auto & counter : histogram) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        slot->progress.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Class destructor
+ */
+Classifier_Stats::~Classifier_Stats() {
+    free(Classifier_Stats::slots);
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of slots
+ *
+ * @return The number of slots
+ */
+int Classifier_Stats::getSlotCount() const {
+    return Classifier_Stats::n_slots;
+}
+
+/**
+ * Sum up the counters of all the slots. Safe to call while the slots are written
+ *
+ * @return The snapshot
+ */
+Stats_Snapshot Classifier_Stats::getSnapshot() const {
+    Stats_Snapshot snapshot;
+    snapshot.progress.resize(n_slots);
+
+    for (int i = 0; i < n_slots; i++) {
+        for (int label = 0; label < STATS_N_CLASSES; label++) {
+            for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+                snapshot.confusion[label][predicted] += slots[i].confusion[label][predicted].load(std::memory_order_relaxed);
+            }
+        }
+
+        for (int label = 0; label < STATS_N_CLASSES; label++) {
+            for (int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+                uint64_t count = slots[i].latency_histograms[label][bucket].load(std::memory_order_relaxed);
+
+                snapshot.class_latency_histograms[label][bucket] += count;
+                snapshot.latency_histogram[bucket] += count;
+            }
+        }
+
+        snapshot.progress[i] = slots[i].progress.load(std::memory_order_relaxed);
+    }
+
+    // The totals are derived from the confusion matrix so that they always agree with it
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+            snapshot.n_tests += snapshot.confusion[label][predicted];
+        }
+
+        snapshot.n_correct += snapshot.confusion[label][label];
+    }
+
+    snapshot.n_incorrect = snapshot.n_tests - snapshot.n_correct;
+
+    return snapshot;
+}
+
+
+// ------------- Setters ------------- //
+/**
+ * Record the result of a classification. Must only be called by the thread that owns the slot
+ *
+ * @param slot        The slot of the calling thread
+ * @param label       The true label of the image
+ * @param predicted   The predicted label of the image
+ * @param latency_ns  The time the classification took in ns
+ */
+void Classifier_Stats::recordClassification(int slot, uint8_t label, uint8_t predicted, uint64_t latency_ns) {
+    increment(slots[slot].confusion[label][predicted]);
+    increment(slots[slot].latency_histograms[label][getLatencyBucket(latency_ns)]);
+}
+
+/**
+ * Set the progress of a slot. Must only be called by the thread that owns the slot
+ *
+ * @param slot      The slot of the calling thread
+ * @param progress  The number of processed items
+ */
+void Classifier_Stats::setProgress(int slot, uint64_t progress) {
+    slots[slot].progress.store(progress, std::memory_order_relaxed);
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Get the current time of the monotonic clock
+ *
+ * @return The time in ns
+ */
+uint64_t Classifier_Stats::now() {
+    struct timespec time {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return uint64_t(time.tv_sec) * 1000000000 + uint64_t(time.tv_nsec);
+}
+
+/**
+ * Get the histogram bucket of a latency
+ *
+ * @param latency_ns  The latency in ns
+ * @return            The bucket
+ */
+int Classifier_Stats::getLatencyBucket(uint64_t latency_ns) {
+    if (latency_ns < STATS_LINEAR_BUCKETS) {
+        return int(latency_ns);
+    }
+
+    // The position of the highest set bit selects the power of two, the next 2 bits the sub bucket
+    int msb = 63 - __builtin_clzll(latency_ns);
+    int sub_bucket = int(latency_ns >> (msb - 2)) & (STATS_SUB_BUCKETS - 1);
+    int bucket = STATS_LINEAR_BUCKETS + (msb - 4) * STATS_SUB_BUCKETS + sub_bucket;
+
+    return bucket < STATS_LATENCY_BUCKETS ? bucket : STATS_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * Get the smallest latency of a histogram bucket
+ *
+ * @param bucket  The bucket
+ * @return        The latency in ns
+ */
+uint64_t Classifier_Stats::getBucketStart(int bucket) {
+    if (bucket < STATS_LINEAR_BUCKETS) {
+        return uint64_t(bucket);
+    }
+
+    int msb = (bucket - STATS_LINEAR_BUCKETS) / STATS_SUB_BUCKETS + 4;
+    int sub_bucket = (bucket - STATS_LINEAR_BUCKETS) % STATS_SUB_BUCKETS;
+
+    return uint64_t(STATS_SUB_BUCKETS + sub_bucket) << (msb - 2);
+}
+
+
+// ------------- Stats_Snapshot ------------- //
+/**
+ * Calculate the accuracy
+ *
+ * @return The accuracy in percent
+ */
+double Stats_Snapshot::getAccuracy() const {
+    return n_tests == 0 ? 0 : (double(n_correct) / double(n_tests)) * 100;
+}
+
+/**
+ * Estimate a latency percentile of all the classifications
+ *
+ * @param percentile  The percentile (0 - 100)
+ * @return            The latency in ns
+ */
+uint64_t Stats_Snapshot::getLatencyPercentile(double percentile) const {
+    return getLatencyPercentile(latency_histogram, percentile);
+}
+
+/**
+ * Estimate a latency percentile of the classifications of the images of a class
+ *
+ * @param percentile  The percentile (0 - 100)
+ * @param label       The (true) label of the class
+ * @return            The latency in ns
+ */
+uint64_t Stats_Snapshot::getLatencyPercentile(double percentile, int label) const {
+    return getLatencyPercentile(class_latency_histograms[label], percentile);
+}
+
+/**
+ * Estimate a latency percentile from a histogram. The result is the start of the bucket the percentile falls in
+ *
+ * @param histogram   The latency histogram
+ * @param percentile  The percentile (0 - 100)
+ * @return            The latency in ns
+ */
+uint64_t Stats_Snapshot::getLatencyPercentile(const std::array<uint64_t, STATS_LATENCY_BUCKETS> &histogram,
+                                              double percentile) {
+    uint64_t total = 0;
+    for (auto & count : histogram) {
+        total += count;
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    // The rank of the percentile, at least 1 so that the 0th percentile is the smallest latency
+    auto rank = uint64_t(percentile / 100 * double(total) + 0.5);
+    rank = rank < 1 ? 1 : rank;
+
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < STATS_LATENCY_BUCKETS; bucket++) {
+        seen += histogram[bucket];
+
+        if (seen >= rank) {
+            return Classifier_Stats::getBucketStart(bucket);
+        }
+    }
+
+    return Classifier_Stats::getBucketStart(STATS_LATENCY_BUCKETS - 1);
+}
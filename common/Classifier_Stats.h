@@ -0,0 +1,92 @@
+#ifndef COMMON_CLASSIFIER_STATS_H
+#define COMMON_CLASSIFIER_STATS_H
+
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#define STATS_N_CLASSES 10         // The number of classes (digits)
+#define STATS_CACHE_LINE 64        // The size of a cache line in bytes
+#define STATS_LINEAR_BUCKETS 16    // Latencies below this many ns get one bucket each
+#define STATS_SUB_BUCKETS 4        // Buckets per power of two above the linear ones
+#define STATS_LATENCY_BUCKETS 160  // The number of latency buckets (up to ~18 minutes)
+
+
+/**
+ * A copy of the counters of all the slots of a Classifier_Stats object, summed up
+ */
+struct Stats_Snapshot {
+    uint64_t n_tests {0};       /// The number of tests performed
+    uint64_t n_correct {0};     /// The number of correct classifications
+    uint64_t n_incorrect {0};   /// The number of incorrect classifications
+
+    std::array<std::array<uint64_t, STATS_N_CLASSES>, STATS_N_CLASSES> confusion {};  /// [true label][predicted label]
+    std::array<uint64_t, STATS_LATENCY_BUCKETS> latency_histogram {};                 /// Classifications per bucket
+
+    /// The latency histogram of the images of every (true) class
+    std::array<std::array<uint64_t, STATS_LATENCY_BUCKETS>, STATS_N_CLASSES> class_latency_histograms {};
+
+    std::vector<uint64_t> progress {};  /// The progress of every slot
+
+    double getAccuracy() const;
+    uint64_t getLatencyPercentile(double percentile) const;
+    uint64_t getLatencyPercentile(double percentile, int label) const;
+
+    static uint64_t getLatencyPercentile(const std::array<uint64_t, STATS_LATENCY_BUCKETS> &histogram, double percentile);
+};
+
+
+/**
+ * Statistics of a classification run, split in one slot per thread.
+ *
+ * Every slot takes up its own cache lines and must be written by a single thread, so the counters are updated with
+ * plain relaxed loads and stores instead of locked read-modify-write instructions and the threads never contend.
+ * Any thread can take a snapshot at any time without locking. The counters of a snapshot may be a few classifications
+ * apart from each other, every counter on its own is exact.
+ *
+ * The latencies are kept in a log-linear histogram per class: one bucket per ns below STATS_LINEAR_BUCKETS ns and
+ * STATS_SUB_BUCKETS buckets per power of two above, so every bucket is at most 25% wide.
+ */
+class Classifier_Stats {
+public:
+    // Constructors
+    explicit Classifier_Stats(int n_slots);
+
+    // Copy constructors
+    Classifier_Stats(const Classifier_Stats &other) = delete;
+
+    // Destructor
+    ~Classifier_Stats();
+
+    // Getters
+    int getSlotCount() const;
+    Stats_Snapshot getSnapshot() const;
+
+    // Setters
+    void recordClassification(int slot, uint8_t label, uint8_t predicted, uint64_t latency_ns);
+    void setProgress(int slot, uint64_t progress);
+
+    // Functions
+    static uint64_t now();
+    static int getLatencyBucket(uint64_t latency_ns);
+    static uint64_t getBucketStart(int bucket);
+
+private:
+    /**
+     * The counters of a single thread
+     */
+    struct alignas(STATS_CACHE_LINE) Slot {
+        std::atomic<uint64_t> confusion[STATS_N_CLASSES][STATS_N_CLASSES];
+        std::atomic<uint64_t> latency_histograms[STATS_N_CLASSES][STATS_LATENCY_BUCKETS];
+        std::atomic<uint64_t> progress;
+    };
+
+    // Variables
+    int n_slots {0};           /// The number of slots
+    Slot *slots {nullptr};     /// The slots, aligned to the cache line
+};
+
+
+#endif
@@ -0,0 +1,189 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "Evaluation_Report.h"
+
+
+/**
+ * Class constructor. Calculates the results of every class from the stats
+ *
+ * @param snapshot  The stats of the classification run
+ */
+Evaluation_Report::Evaluation_Report(const Stats_Snapshot &snapshot) : snapshot(snapshot) {
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        Class_Report &report = classes[label];
+
+        for (int other = 0; other < STATS_N_CLASSES; other++) {
+            report.n_images += snapshot.confusion[label][other];
+            report.n_predicted += snapshot.confusion[other][label];
+        }
+
+        report.n_correct = snapshot.confusion[label][label];
+
+        report.precision = report.n_predicted == 0 ? 0 : double(report.n_correct) / double(report.n_predicted);
+        report.recall = report.n_images == 0 ? 0 : double(report.n_correct) / double(report.n_images);
+
+        report.latency_p50 = snapshot.getLatencyPercentile(50, label);
+        report.latency_p99 = snapshot.getLatencyPercentile(99, label);
+    }
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the results of a class
+ *
+ * @param label  The label of the class
+ * @return       The results of the class
+ */
+const Class_Report &Evaluation_Report::getClassReport(int label) const {
+    return Evaluation_Report::classes.at(label);
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Print the per class results and the confusion matrix
+ */
+void Evaluation_Report::printReport() const {
+    std::ios_base::fmtflags flags = std::cout.flags();
+    std::streamsize precision = std::cout.precision();
+
+    std::cout << std::fixed << std::setprecision(3);
+
+    std::cout << std::endl << "    Per class results:" << std::endl << std::endl;
+    std::cout << "        label |  images | precision |  recall | p50 (us) | p99 (us)" << std::endl;
+    std::cout << "        ---------------------------------------------------------------" << std::endl;
+
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        const Class_Report &report = classes[label];
+
+        std::cout << "        " << std::setw(5) << label << " | " << std::setw(7) << report.n_images << " | "
+                  << std::setw(8) << report.precision * 100 << "% | " << std::setw(6) << report.recall * 100 << "% | "
+                  << std::setw(8) << double(report.latency_p50) / 1000 << " | "
+                  << std::setw(8) << double(report.latency_p99) / 1000 << std::endl;
+    }
+
+    std::cout << std::endl << "    Confusion matrix (rows: true label, columns: predicted label):" << std::endl << std::endl;
+    std::cout << "             ";
+
+    for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+        std::cout << std::setw(6) << predicted;
+    }
+    std::cout << std::endl;
+
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        std::cout << "        " << std::setw(5) << label;
+
+        for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+            std::cout << std::setw(6) << snapshot.confusion[label][predicted];
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+}
+
+/**
+ * Export the report as JSON. The latencies are in us
+ *
+ * @param path  The path of the file
+ * @return      True if the file was written
+ */
+bool Evaluation_Report::saveJSON(const std::string &path) const {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file " << path << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(6);
+
+    file << "{" << std::endl;
+    file << "  \"n_tests\": " << snapshot.n_tests << "," << std::endl;
+    file << "  \"n_correct\": " << snapshot.n_correct << "," << std::endl;
+    file << "  \"accuracy\": " << snapshot.getAccuracy() / 100 << "," << std::endl;
+    file << "  \"latency_p50_us\": " << double(snapshot.getLatencyPercentile(50)) / 1000 << "," << std::endl;
+    file << "  \"latency_p99_us\": " << double(snapshot.getLatencyPercentile(99)) / 1000 << "," << std::endl;
+    file << "  \"classes\": [" << std::endl;
+
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        const Class_Report &report = classes[label];
+
+        file << "    {\"label\": " << label
+             << ", \"n_images\": " << report.n_images
+             << ", \"n_predicted\": " << report.n_predicted
+             << ", \"n_correct\": " << report.n_correct
+             << ", \"precision\": " << report.precision
+             << ", \"recall\": " << report.recall
+             << ", \"latency_p50_us\": " << double(report.latency_p50) / 1000
+             << ", \"latency_p99_us\": " << double(report.latency_p99) / 1000
+             << ", \"confusion\": [";
+
+        for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+            file << snapshot.confusion[label][predicted] << (predicted < STATS_N_CLASSES - 1 ? ", " : "");
+        }
+
+        file << "]}" << (label < STATS_N_CLASSES - 1 ? "," : "") << std::endl;
+    }
+
+    file << "  ]" << std::endl;
+    file << "}" << std::endl;
+
+    return true;
+}
+
+/**
+ * Export the report as CSV. One row per class, the last columns are the row of the class in the confusion matrix.
+ * The latencies are in us
+ *
+ * @param path  The path of the file
+ * @return      True if the file was written
+ */
+bool Evaluation_Report::saveCSV(const std::string &path) const {
+    std::ofstream file(path);
+
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file " << path << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(6);
+
+    file << "label,n_images,n_predicted,n_correct,precision,recall,latency_p50_us,latency_p99_us";
+    for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+        file << ",predicted_" << predicted;
+    }
+    file << std::endl;
+
+    for (int label = 0; label < STATS_N_CLASSES; label++) {
+        const Class_Report &report = classes[label];
+
+        file << label << "," << report.n_images << "," << report.n_predicted << "," << report.n_correct << ","
+             << report.precision << "," << report.recall << "," << double(report.latency_p50) / 1000 << ","
+             << double(report.latency_p99) / 1000;
+
+        for (int predicted = 0; predicted < STATS_N_CLASSES; predicted++) {
+            file << "," << snapshot.confusion[label][predicted];
+        }
+        file << std::endl;
+    }
+
+    return true;
+}
+
+/**
+ * Export the report as both JSON and CSV
+ *
+ * @param name  The path of the files without the extension
+ * @return      True if both files were written
+ */
+bool Evaluation_Report::saveReport(const std::string &name) const {
+    bool json = saveJSON(name + ".json");
+    bool csv = saveCSV(name + ".csv");
+
+    return json && csv;
+}
@@ -0,0 +1,56 @@
+#ifndef COMMON_EVALUATION_REPORT_H
+#define COMMON_EVALUATION_REPORT_H
+
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Classifier_Stats.h"
+
+
+/**
+ * The results of a single class
+ */
+struct Class_Report {
+    uint64_t n_images {0};      /// The number of images of the class
+    uint64_t n_predicted {0};   /// The number of images classified as the class
+    uint64_t n_correct {0};     /// The number of images of the class classified correctly
+
+    double precision {0};       /// n_correct / n_predicted
+    double recall {0};          /// n_correct / n_images
+
+    uint64_t latency_p50 {0};   /// The median latency of the images of the class in ns
+    uint64_t latency_p99 {0};   /// The 99th percentile latency of the images of the class in ns
+};
+
+
+/**
+ * Evaluation report of a classification run: the confusion matrix, the precision and recall of every class and the
+ * median and 99th percentile latency of every class. The report can be printed or exported as JSON or CSV.
+ */
+class Evaluation_Report {
+public:
+    // Constructors
+    explicit Evaluation_Report(const Stats_Snapshot &snapshot);
+
+    // Destructor
+    ~Evaluation_Report() = default;
+
+    // Getters
+    const Class_Report &getClassReport(int label) const;
+
+    // Functions
+    void printReport() const;
+    bool saveJSON(const std::string &path) const;
+    bool saveCSV(const std::string &path) const;
+    bool saveReport(const std::string &name) const;
+
+private:
+    // Variables
+    Stats_Snapshot snapshot;                              /// The stats the report is calculated from
+    std::array<Class_Report, STATS_N_CLASSES> classes {}; /// The results of every class
+};
+
+
+#endif
@@ -0,0 +1,137 @@
+#include "Thread_Pool.h"
+
+
+/**
+ * Class constructor. Starts the worker threads
+ *
+ * @param n_threads  The number of worker threads
+ */
+Thread_Pool::Thread_Pool(int n_threads) {
+    n_threads = n_threads < 1 ? 1 : n_threads;
+
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&work_ready, nullptr);
+    pthread_cond_init(&work_done, nullptr);
+
+    Thread_Pool::threads.resize(n_threads);
+    Thread_Pool::worker_args.resize(n_threads);
+
+    for (int i = 0; i < n_threads; i++) {
+        worker_args[i].pool = this;
+        worker_args[i].thread_id = i;
+
+        pthread_create(&threads[i], nullptr, workerThread, &worker_args[i]);
+    }
+}
+
+/**
+ * Class destructor. Stops and joins the worker threads
+ */
+Thread_Pool::~Thread_Pool() {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&mutex);
+
+    for (auto & thread : threads) {
+        pthread_join(thread, nullptr);
+    }
+
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&work_ready);
+    pthread_cond_destroy(&work_done);
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of worker threads
+ *
+ * @return The number of worker threads
+ */
+int Thread_Pool::getThreadCount() const {
+    return int(Thread_Pool::threads.size());
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Run function(callable, i, thread_id) for every i in [0, n_tasks) on the worker threads and wait for all the tasks to
+ * finish
+ *
+ * @param n_tasks   The number of tasks
+ * @param function  Calls the task
+ * @param callable  The task
+ */
+void Thread_Pool::run(int n_tasks, void (*function)(const void *, int, int), const void *callable) {
+    if (n_tasks <= 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    Thread_Pool::function = function;
+    Thread_Pool::callable = callable;
+    Thread_Pool::n_tasks = n_tasks;
+    Thread_Pool::next_task.store(0, std::memory_order_relaxed);
+    Thread_Pool::n_finished = 0;
+    Thread_Pool::generation++;
+
+    pthread_cond_broadcast(&work_ready);
+
+    while (n_finished < int(threads.size())) {
+        pthread_cond_wait(&work_done, &mutex);
+    }
+
+    Thread_Pool::function = nullptr;
+    Thread_Pool::callable = nullptr;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * Worker thread function. Waits for a loop, claims and runs tasks until there are none left and reports back
+ *
+ * @param args  The arguments of the worker
+ * @return      nullptr
+ */
+void *Thread_Pool::workerThread(void *args) {
+    auto *worker = (Worker_args *) args;
+    Thread_Pool *pool = worker->pool;
+
+    uint64_t seen = 0;  // The last loop this worker took part in
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (true) {
+        while (!pool->stopping && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        }
+
+        if (pool->stopping) {
+            break;
+        }
+
+        seen = pool->generation;
+
+        void (*function)(const void *, int, int) = pool->function;
+        const void *callable = pool->callable;
+        int n_tasks = pool->n_tasks;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (int i = pool->next_task.fetch_add(1); i < n_tasks; i = pool->next_task.fetch_add(1)) {
+            function(callable, i, worker->thread_id);
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if (++pool->n_finished == int(pool->threads.size())) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return nullptr;
+}
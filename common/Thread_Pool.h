@@ -0,0 +1,83 @@
+#ifndef COMMON_THREAD_POOL_H
+#define COMMON_THREAD_POOL_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <vector>
+
+
+/**
+ * A fixed set of worker threads that run the tasks of parallel loops. The threads are created once and sleep between
+ * the loops, so a loop costs a wake up instead of a thread creation per task. The task of a loop is passed to the
+ * workers as a plain function pointer and a pointer to the callable, so starting a loop never allocates (a
+ * std::function may allocate when the lambda captures more than two pointers).
+ */
+class Thread_Pool {
+public:
+    // Constructors
+    explicit Thread_Pool(int n_threads);
+
+    // Copy constructors
+    Thread_Pool(const Thread_Pool &other) = delete;
+
+    // Destructor
+    ~Thread_Pool();
+
+    // Getters
+    int getThreadCount() const;
+
+    // Functions
+    template<class Task>
+    void parallelFor(int n_tasks, const Task &task);
+
+private:
+    /**
+     * The arguments of a worker thread
+     */
+    struct Worker_args {
+        Thread_Pool *pool;  // The pool of the worker
+        int thread_id;      // The index of the worker
+    };
+
+    // Functions
+    void run(int n_tasks, void (*function)(const void *, int, int), const void *callable);
+    static void *workerThread(void *args);
+
+    // Variables
+    std::vector<pthread_t> threads {};         /// The worker threads
+    std::vector<Worker_args> worker_args {};   /// The arguments of every worker
+
+    pthread_mutex_t mutex {};                  /// Protects the state of the current loop
+    pthread_cond_t work_ready {};              /// Signaled when a loop starts or the pool stops
+    pthread_cond_t work_done {};               /// Signaled when the last worker finishes a loop
+
+    void (*function)(const void *, int, int) {nullptr};  /// Calls the task of the current loop
+    const void *callable {nullptr};            /// The task of the current loop
+    int n_tasks {0};                           /// The number of tasks of the current loop
+    std::atomic<int> next_task {0};            /// The next task to be claimed by a worker
+    int n_finished {0};                        /// The number of workers that finished the current loop
+    uint64_t generation {0};                   /// Incremented for every loop
+    bool stopping {false};                     /// Whether the workers must exit
+};
+
+
+/**
+ * Run task(i, thread_id) for every i in [0, n_tasks) on the worker threads and wait for all the tasks to finish. The
+ * tasks are claimed one at a time, so tasks of different sizes are balanced between the workers. thread_id is the
+ * index of the worker running the task and can be used to index per thread data
+ *
+ * @tparam Task    A callable with a (int task, int thread_id) signature
+ * @param n_tasks  The number of tasks
+ * @param task     The task function
+ */
+template<class Task>
+void Thread_Pool::parallelFor(int n_tasks, const Task &task) {
+    Thread_Pool::run(n_tasks, [](const void *callable, int i, int thread_id) {
+        (*(const Task *) callable)(i, thread_id);
+    }, &task);
+}
+
+
+#endif
@@ -1,26 +1,29 @@
 #include <iostream>
 #include <cmath>
 #include <cstring>
+#include <unistd.h>
 
 #include "mnist/MNIST_Import.h"
 #include "knn/KNN.h"
 #include "utils/Timer.h"
 #include "utils/Print_Progress.h"
+#include "Classifier_Stats.h"
+
+#define PROGRESS_POLL_US 100000  // The interval the main thread polls the progress of the classifiers with
 
 
 /**
  * Struct with the arguments for the threads
  */
-typedef struct {
+template <class Metric>
+struct thread_data {
     int thread_id;   /// The thread ID
     int start;       /// The index of the first image to process
     int end;         /// The index of the last image to process
 
-    pthread_mutex_t *mutex; /// The mutex to lock the progress
-
-    Print_Progress *progress;  /// The progress object
-    KNN *knn;                  /// The KNN object
-} thread_data;
+    Classifier_Stats *stats;   /// The shared stats. The progress is written to slot thread_id
+    KNN<Metric> *knn;          /// The KNN object
+};
 
 
 /**
@@ -29,54 +32,43 @@ typedef struct {
  * @param arg The thread arguments
  * @return nullptr
  */
+template <class Metric>
 void *classify(void *arg) {
     // Type cast the arguments
-    auto *data = (thread_data *) arg;
+    auto *data = (thread_data<Metric> *) arg;
 
-    // Classify the images
+    // Classify the images. The progress is only published, the main thread prints it
     for (int i = data->start; i < data->end; i++) {
         data->knn->classifyImage(i, false);
-
-        // Update the progress bar
-        if ((data->end - data->start) / 8 > 0) {
-            if (i % ((data->end - data->start) / 8) == 0 && i != 0) {
-                // Lock the mutex
-                pthread_mutex_lock(data->mutex);
-
-                // Update the progress bar
-                data->progress->setProgress(data->thread_id, i - data->start);
-
-                // Unlock the mutex
-                pthread_mutex_unlock(data->mutex);
-            }
-        }
+        data->stats->setProgress(data->thread_id, i - data->start + 1);
     }
 
-    // Update the progress bar to 100%
-    pthread_mutex_lock(data->mutex);  // Lock the mutex
-    data->progress->setProgress(data->thread_id, data->end - data->start);  // Update the progress bar
-    pthread_mutex_unlock(data->mutex);  // Unlock the mutex
-
     pthread_exit(nullptr);
 }
 
-void classifyImages(int n_threads, int k, int n_tests, int start_index, const std::vector<MNIST_Image *> &training_images,
-                    const std::vector<MNIST_Image *> &test_images) {
+template <class Metric>
+void classifyImages(int n_threads, int k, int n_tests, int start_index, int n_candidates, const std::string &report_name,
+                    const std::vector<MNIST_Image *> &training_images, const std::vector<MNIST_Image *> &test_images) {
 
-    std::vector<KNN *> classifiers;  // Create a KNN classifiers
+    std::vector<KNN<Metric> *> classifiers;  // Create a KNN classifiers
     classifiers.reserve(n_threads);
 
+    // Every classifier records its classifications to its own slot of the shared stats
+    Classifier_Stats stats(n_threads);
+
     for (int i = 0; i < n_threads; i++) {
-        classifiers.push_back(new KNN(k, training_images, test_images));
+        classifiers.push_back(new KNN<Metric>(k, training_images, test_images));
+        classifiers.back()->shareStats(&stats, i);
+
+        // Use the 4-bit first pass if requested
+        if (n_candidates > 0) {
+            classifiers.back()->enableQuantizedSearch(n_candidates);
+        }
     }
 
     // Create the threads. Every classifier will be run in a separate thread and will classify a part of the test images
     pthread_t threads[n_threads];
-    thread_data data[n_threads];
-
-    // The mutex is used to lock the progress bar
-    auto *mutex = new pthread_mutex_t;
-    pthread_mutex_init(mutex, nullptr);
+    thread_data<Metric> data[n_threads];
 
     // The progress bar object
     auto *progress = new Print_Progress(n_threads, int(n_tests / n_threads));
@@ -87,10 +79,9 @@ void classifyImages(int n_threads, int k, int n_tests, int start_index, const st
         data[i].start = i * int(n_tests / n_threads) + start_index;
         data[i].end = (i + 1) * int(n_tests / n_threads) + start_index;
         data[i].knn = classifiers.at(i);
-        data[i].progress = progress;
-        data[i].mutex = mutex;
+        data[i].stats = &stats;
 
-        pthread_create(&threads[i], nullptr, classify, &data[i]);
+        pthread_create(&threads[i], nullptr, classify<Metric>, &data[i]);
     }
 
     // The last thread will classify the remaining images
@@ -99,10 +90,24 @@ void classifyImages(int n_threads, int k, int n_tests, int start_index, const st
         data[n_threads - 1].start = (n_threads - 1) * int(n_tests / n_threads) + start_index;
         data[n_threads - 1].end = n_tests + start_index;
         data[n_threads - 1].knn = classifiers.at(n_threads - 1);
-        data[n_threads - 1].progress = progress;
-        data[n_threads - 1].mutex = mutex;
+        data[n_threads - 1].stats = &stats;
+
+        pthread_create(&threads[n_threads - 1], nullptr, classify<Metric>, &data[n_threads - 1]);
+    }
+
+    // Poll the progress of the threads until all the images are classified
+    uint64_t n_done = 0;
 
-        pthread_create(&threads[n_threads - 1], nullptr, classify, &data[n_threads - 1]);
+    while (n_done < uint64_t(n_tests)) {
+        usleep(PROGRESS_POLL_US);
+
+        Stats_Snapshot snapshot = stats.getSnapshot();
+        n_done = 0;
+
+        for (int i = 0; i < n_threads; i++) {
+            progress->setProgress(i, int(snapshot.progress[i]));
+            n_done += snapshot.progress[i];
+        }
     }
 
     // Wait for the threads to finish
@@ -110,19 +115,21 @@ void classifyImages(int n_threads, int k, int n_tests, int start_index, const st
         pthread_join(thread, nullptr);
     }
 
-    // Print the results
-    classifiers.at(0)->accumulateStats(classifiers);
+    // Print the results of all the classifiers (they share the stats)
     classifiers.at(0)->printStats();
 
+    // Export the evaluation report if requested
+    if (!report_name.empty() && classifiers.at(0)->saveReport(report_name)) {
+        std::cout << std::endl << "    Report saved as " << report_name << ".json and " << report_name << ".csv" << std::endl;
+    }
+
     // Delete the classifiers
     for (auto &classifier : classifiers) {
         delete classifier;
     }
 
     // Free memory
-    pthread_mutex_destroy(mutex);
     delete(progress);
-    delete(mutex);
 }
 
 /**
@@ -139,8 +146,11 @@ void classifyImages(int n_threads, int k, int n_tests, int start_index, const st
  *   - The number of threads to use
  *   - The number of test images to classify
  *   - The starting index of the test images
+ *   - The number of candidates of the 4-bit first pass that are reranked exactly (0 disables the quantized search)
+ *   - The distance metric (l2, l1, cosine or mahalanobis)
+ *   - The name of the evaluation report files (<name>.json and <name>.csv)
  *
- * ./main -d /home/username/dataset -k 5 -t 16 -n 10000 -s 0
+ * ./main -d /home/username/dataset -k 5 -t 16 -n 10000 -s 0 -q 256 -m l2 -r report
  *
  *
  * @return 0
@@ -150,7 +160,8 @@ int main(int argc, char *argv[]) {
     if (argc < 5){
         std::cerr << "Usage: " << argv[0]
         << " -d <dataset directory> -k <value of K> [-t <number of threads> -n <number of test images>"
-           " -s <starting index for tests>]"
+           " -s <starting index for tests> -q <number of quantized search candidates> -m <distance metric>"
+           " -r <report name>]"
         << std::endl;
     }
 
@@ -160,6 +171,9 @@ int main(int argc, char *argv[]) {
     int n_threads = -1;
     int n_tests = -1;
     int start_index = -1;
+    int n_candidates = 0;
+    std::string report_name;
+    std::string metric = L2_Metric::getName();
 
     for (int i = 5; i < argc - 1; i+=2) {
         if (strcmp(argv[i], "-t") == 0){
@@ -186,6 +200,26 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
 
+        } else if (strcmp(argv[i], "-q") == 0){
+            n_candidates = std::stoi(argv[i + 1]);
+
+            if (n_candidates != 0 && n_candidates < k){
+                std::cerr << "The number of quantized search candidates must be 0 or greater/equal than K" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-m") == 0){
+            metric = argv[i + 1];
+
+            if (metric != L2_Metric::getName() && metric != L1_Metric::getName() &&
+                metric != Cosine_Metric::getName() && metric != Mahalanobis_Metric::getName()){
+                std::cerr << "The metric must be one of: l2, l1, cosine, mahalanobis" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-r") == 0){
+            report_name = argv[i + 1];
+
         } else {
             std::cerr << "Invalid argument: " << argv[i] << std::endl;
             return 1;
@@ -212,6 +246,9 @@ int main(int argc, char *argv[]) {
     std::cout << "    Number of threads: " << n_threads << std::endl;
     std::cout << "    Number of test images: " << n_tests << std::endl;
     std::cout << "    Starting index: " << start_index << std::endl;
+    std::cout << "    Quantized search candidates: " << n_candidates << std::endl;
+    std::cout << "    Distance metric: " << metric << std::endl;
+    std::cout << "    Report: " << (report_name.empty() ? "-" : report_name) << std::endl;
     std::cout << std::endl;
 
 
@@ -268,7 +305,16 @@ int main(int argc, char *argv[]) {
     timer.startTimer();
     std::cout << "Starting the classification..." << std::endl << std::endl;
 
-    classifyImages(n_threads, k, n_tests, start_index, training_images, test_images);
+    // The metric is a template parameter of the classifier, so every metric has its own specialized classifier
+    if (metric == L1_Metric::getName()) {
+        classifyImages<L1_Metric>(n_threads, k, n_tests, start_index, n_candidates, report_name, training_images, test_images);
+    } else if (metric == Cosine_Metric::getName()) {
+        classifyImages<Cosine_Metric>(n_threads, k, n_tests, start_index, n_candidates, report_name, training_images, test_images);
+    } else if (metric == Mahalanobis_Metric::getName()) {
+        classifyImages<Mahalanobis_Metric>(n_threads, k, n_tests, start_index, n_candidates, report_name, training_images, test_images);
+    } else {
+        classifyImages<L2_Metric>(n_threads, k, n_tests, start_index, n_candidates, report_name, training_images, test_images);
+    }
 
     timer.stopTimer();
     std::cout << std::endl << "    Time to classify the test images: ";
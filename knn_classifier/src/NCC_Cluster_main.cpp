@@ -1,11 +1,112 @@
 #include <iostream>
+#include <chrono>
 #include <cstring>
+#include <stdexcept>
 
 #include "mnist/MNIST_Import.h"
 #include "utils/Timer.h"
 #include "ncc_cluster/NCC_clusters.h"
 #include "../include/progressbar.h"
 
+#define MODEL_PATH "pre_fit/clusters.model"  // The model file the fitted clusters are saved to and loaded from
+
+/**
+ * Creates the cluster classifier (fitted from scratch or loaded from the pre-fitted clusters) and classifies the test
+ * images
+ *
+ * @tparam Metric           The distance metric
+ * @param n_clusters        The number of clusters
+ * @param from_scratch      Whether to fit the clusters or load the pre-fitted ones
+ * @param algorithm         The algorithm the clusters are fitted with
+ * @param seed              The seed of the random generator of the clustering
+ * @param report_name       The name of the evaluation report files. Empty to skip the export
+ * @param training_images   The training images, only used to fit the clusters
+ * @param test_images       The test images
+ */
+template <class Metric>
+void classifyImages(int n_clusters, bool from_scratch, KMeans_Algorithm algorithm, unsigned seed, const std::string &report_name,
+                    const std::vector<MNIST_Image *> &training_images,
+                    const std::vector<MNIST_Image *> &test_images) {
+    Timer timer;  // The timer object is used to time the classification
+
+    // Start the classification process
+    timer.startTimer();
+
+    // Create the classifier object
+    if (from_scratch){
+        std::cout << "Creating the clusters from scratch..." << std::endl;
+
+        NCC_clusters<Metric> ncc_cluster(n_clusters, training_images, test_images, algorithm, seed);
+        // Save the clusters as a model file
+        if (ncc_cluster.saveModel(MODEL_PATH)) {
+            std::cout << "    Model saved as " << MODEL_PATH << std::endl;
+        }
+
+        timer.stopTimer();
+        std::cout << "    Time to create and fit the classifier: ";
+        timer.displayElapsed();
+
+        // Start the classification process
+        timer.startTimer();
+
+        std::cout << std::endl << "Starting the classification..." << std::endl << std::endl;
+
+        progressbar bar(int(test_images.size()));  // Create the progress bar
+
+        std::cout << "    Classifying the test images  ";
+        for (int i = 0; i < test_images.size(); ++i) {
+            bar.update();
+            ncc_cluster.classifyImage(i, false);
+        }
+        std::cout << std::endl;
+        timer.stopTimer();
+        std::cout << std::endl << "    Time to classify the test images: ";
+        timer.displayElapsed();
+
+        ncc_cluster.printStats();
+
+        // Export the evaluation report if requested
+        if (!report_name.empty() && ncc_cluster.saveReport(report_name)) {
+            std::cout << std::endl << "    Report saved as " << report_name << ".json and " << report_name << ".csv" << std::endl;
+        }
+
+    } else {
+        std::cout << "Loading the clusters from " << MODEL_PATH << "..." << std::endl;
+
+        NCC_clusters<Metric> ncc_cluster(MODEL_PATH, test_images);
+
+        timer.stopTimer();
+        std::cout << std::endl << "    Time to create the classifier from the pre-saved mean clusters: ";
+        timer.displayElapsed();
+
+        // Start the classification process
+        timer.startTimer();
+
+        std::cout << "Starting the classification..." << std::endl << std::endl;
+
+        progressbar bar(int(test_images.size()));  // Create the progress bar
+
+        std::cout << "    Classifying the test images  ";
+
+        for (int i = 0; i < test_images.size(); ++i) {
+            bar.update();
+            ncc_cluster.classifyImage(i, false);
+        }
+        std::cout << std::endl;
+
+        timer.stopTimer();
+        std::cout << std::endl << "    Time to classify the 10000 test images: ";
+        timer.displayElapsed();
+
+        ncc_cluster.printStats();
+
+        // Export the evaluation report if requested
+        if (!report_name.empty() && ncc_cluster.saveReport(report_name)) {
+            std::cout << std::endl << "    Report saved as " << report_name << ".json and " << report_name << ".csv" << std::endl;
+        }
+    }
+}
+
 /**
  * Main function classifies the test images using the Nearest Centroid Classification optimized with clusters.
  *
@@ -20,6 +121,11 @@
  *
  *   Optional arguments:
  *   -fit Whether to train the clusters from scratch or use the pre-trained clusters
+ *   -m   The distance metric (l2, l1, cosine or mahalanobis)
+ *   -a   The clustering algorithm (online, lloyd or minibatch). Lloyd uses the whole training set and skips most of
+ *        the distances with the triangle inequality, minibatch stops as soon as the clusters converge
+ *   -s   The seed of the clustering (default: the time). The same seed gives the same clusters
+ *   -r   The name of the evaluation report files (<name>.json and <name>.csv)
  *
  * ./main -d /home/username/dataset -c 5 -t 16 -n 10000 -s 0
  *
@@ -29,17 +135,49 @@
 int main(int argc, char *argv[]){
     // Parse the arguments
     if (argc < 5){
-        std::cerr << "Usage: " << argv[0] << " -d <dataset directory> -c <The number of clusters> [-fit ]" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " -d <dataset directory> -c <The number of clusters> [-fit -m <distance metric> -a <online|lloyd|minibatch> -s <seed> -r <report name>]" << std::endl;
     }
 
     std::string dataset_dir = argv[2];
     int n_clusters = std::stoi(argv[4]);
 
     bool from_scratch = false;
+    std::string metric = L2_Metric::getName();
+    std::string report_name;
+    KMeans_Algorithm algorithm = KMeans_Algorithm::ONLINE;
+    auto seed = unsigned(std::chrono::system_clock::now().time_since_epoch().count());
 
     for (int i = 5; i < argc; i++) {
         if (strcmp(argv[i], "-fit") == 0){
             from_scratch = true;
+
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc){
+            metric = argv[++i];
+
+            if (metric != L2_Metric::getName() && metric != L1_Metric::getName() &&
+                metric != Cosine_Metric::getName() && metric != Mahalanobis_Metric::getName()){
+                std::cerr << "The metric must be one of: l2, l1, cosine, mahalanobis" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc){
+            std::string name = argv[++i];
+
+            if (name == "lloyd") {
+                algorithm = KMeans_Algorithm::LLOYD;
+            } else if (name == "minibatch") {
+                algorithm = KMeans_Algorithm::MINI_BATCH;
+            } else if (name != "online") {
+                std::cerr << "The algorithm must be one of: online, lloyd, minibatch" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc){
+            seed = unsigned(std::stoul(argv[++i]));
+
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+            report_name = argv[++i];
+
         } else {
             std::cerr << "Invalid argument: " << argv[i] << std::endl;
             return 1;
@@ -50,6 +188,11 @@ int main(int argc, char *argv[]){
     std::cout << "Arguments:" << std::endl << std::endl;
     std::cout << "    Dataset directory: " << dataset_dir << std::endl;
     std::cout << "    Number of clusters: " << n_clusters << std::endl;
+    std::cout << "    Distance metric: " << metric << std::endl;
+    std::cout << "    Algorithm: " << (algorithm == KMeans_Algorithm::LLOYD ? "lloyd" :
+                                   algorithm == KMeans_Algorithm::MINI_BATCH ? "minibatch" : "online") << std::endl;
+    std::cout << "    Seed: " << seed << std::endl;
+    std::cout << "    Report: " << (report_name.empty() ? "-" : report_name) << std::endl;
     std::cout << std::endl;
 
 
@@ -100,68 +243,22 @@ int main(int argc, char *argv[]){
     std::cout << std::endl;
 
 
-    // Start the classification process
-    timer.startTimer();
-
-    // Create the classifier object
-    if (from_scratch){
-        std::cout << "Creating the clusters from scratch..." << std::endl;
-
-        NCC_clusters ncc_cluster(n_clusters, training_images, test_images);
-        ncc_cluster.saveMeanClusters();  // Save the mean clusters as pgm files
-
-        timer.stopTimer();
-        std::cout << "    Time to create and fit the classifier: ";
-        timer.displayElapsed();
-
-        // Start the classification process
-        timer.startTimer();
-
-        std::cout << std::endl << "Starting the classification..." << std::endl << std::endl;
-
-        progressbar bar(int(test_images.size()));  // Create the progress bar
-
-        std::cout << "    Classifying the test images  ";
-        for (int i = 0; i < test_images.size(); ++i) {
-            bar.update();
-            ncc_cluster.classifyImage(i, false);
-        }
-        std::cout << std::endl;
-        timer.stopTimer();
-        std::cout << std::endl << "    Time to classify the test images: ";
-        timer.displayElapsed();
-
-        ncc_cluster.printStats();
-
-    } else {
-        std::cout << "Loading the clusters from file..." << std::endl;
-
-        NCC_clusters ncc_cluster("pre_fit", training_images, test_images);
-
-        timer.stopTimer();
-        std::cout << std::endl << "    Time to create the classifier from the pre-saved mean clusters: ";
-        timer.displayElapsed();
-
-        // Start the classification process
-        timer.startTimer();
-
-        std::cout << "Starting the classification..." << std::endl << std::endl;
-
-        progressbar bar(int(test_images.size()));  // Create the progress bar
-
-        std::cout << "    Classifying the test images  ";
-
-        for (int i = 0; i < test_images.size(); ++i) {
-            bar.update();
-            ncc_cluster.classifyImage(i, false);
+    // The metric is a template parameter of the classifier, so every metric has its own specialized classifier
+    try {
+        if (metric == L1_Metric::getName()) {
+            classifyImages<L1_Metric>(n_clusters, from_scratch, algorithm, seed, report_name, training_images, test_images);
+        } else if (metric == Cosine_Metric::getName()) {
+            classifyImages<Cosine_Metric>(n_clusters, from_scratch, algorithm, seed, report_name, training_images, test_images);
+        } else if (metric == Mahalanobis_Metric::getName()) {
+            classifyImages<Mahalanobis_Metric>(n_clusters, from_scratch, algorithm, seed, report_name, training_images, test_images);
+        } else {
+            classifyImages<L2_Metric>(n_clusters, from_scratch, algorithm, seed, report_name, training_images, test_images);
         }
-        std::cout << std::endl;
-
-        timer.stopTimer();
-        std::cout << std::endl << "    Time to classify the 10000 test images: ";
-        timer.displayElapsed();
 
-        ncc_cluster.printStats();
+    } catch (const std::runtime_error &error) {
+        // The pre-fitted model is missing, invalid or was fitted with another metric
+        std::cerr << error.what() << std::endl;
+        return 1;
     }
 
     return 0;
@@ -1,10 +1,151 @@
+#include <algorithm>
 #include <iostream>
 #include <cstring>
+#include <pthread.h>
 
 #include "mnist/MNIST_Import.h"
 #include "utils/Timer.h"
 #include "ncc/NCC.h"
-#include "../include/progressbar.h"
+
+#define ONLINE_BATCH_SIZE 100  // The number of images streamed into the classifier at once
+
+
+/**
+ * Structure for passing arguments to the online thread
+ */
+template <class Metric>
+struct Online_args {
+    NCC<Metric> *ncc;  // The classifier
+    const std::vector<MNIST_Image *> *images;  // The images to stream into the classifier
+};
+
+/**
+ * Thread function that streams labeled images into the classifier in batches while the test images are classified
+ *
+ * @param args  The arguments
+ * @return      nullptr
+ */
+template <class Metric>
+void *streamImages(void *args) {
+    auto *online_args = (Online_args<Metric> *) args;
+    const std::vector<MNIST_Image *> &images = *online_args->images;
+
+    for (size_t first = 0; first < images.size(); first += ONLINE_BATCH_SIZE) {
+        size_t last = std::min(images.size(), first + ONLINE_BATCH_SIZE);
+
+        online_args->ncc->addTrainingImages(std::vector<MNIST_Image *>(images.begin() + first, images.begin() + last));
+    }
+
+    return nullptr;
+}
+
+
+/**
+ * Calculates the class means and classifies the test images with the Nearest Centroid Classification algorithm
+ *
+ * @tparam Metric           The distance metric
+ * @param n_tests           The number of test images to classify
+ * @param start_index       The index of the first test image
+ * @param report_name       The name of the evaluation report files. Empty to skip the export
+ * @param n_online          The number of training images held back and streamed into the classifier online
+ * @param decay             The decay of the online updates
+ * @param n_prototypes      The number of prototypes (k-means clusters) of every class. 1 uses the class means
+ * @param training_images   The training images
+ * @param test_images       The test images
+ */
+template <class Metric>
+void classifyImages(int n_tests, int start_index, const std::string &report_name, int n_online, double decay,
+                    int n_prototypes, const std::vector<MNIST_Image *> &training_images,
+                    const std::vector<MNIST_Image *> &test_images) {
+    Timer timer;  // The timer object is used to time the classification
+
+    // Start the classification process
+    timer.startTimer();
+
+    // The last n_online training images are not used for the means, they arrive while the test images are classified
+    n_online = std::min(n_online, int(training_images.size()));
+
+    std::vector<MNIST_Image *> initial_images(training_images.begin(), training_images.end() - n_online);
+    std::vector<MNIST_Image *> online_images(training_images.end() - n_online, training_images.end());
+
+    // Create the NCC object
+    NCC<Metric> ncc(initial_images, test_images);
+    ncc.setDecay(decay);
+
+    if (n_prototypes > 1) {
+        std::cout << "Determine " << n_prototypes << " prototypes for each class..." << std::endl;
+        ncc.calculatePrototypes(n_prototypes);  // Cluster the images of every class
+
+    } else {
+        std::cout << "Determine the mean vector for each class..." << std::endl;
+        std::cout << std::endl;
+        ncc.calculateMeans();  // Calculate the means for each class
+    }
+
+    std::cout << std::endl;
+
+    timer.stopTimer();
+    std::cout << "    Time to calculate the means: ";
+    timer.displayElapsed();
+
+    // save the means as pgm files
+    ncc.saveClassMeans("images/mean_");
+
+    std::cout << std::endl;
+    std::cout << "Starting the classification..." << std::endl;
+    std::cout << std::endl;
+
+    timer.startTimer();
+
+    std::cout << "    Classifying test images..." << std::endl;
+
+    // Stream the held back training images into the classifier. The classification is never blocked by the updates
+    Online_args<Metric> online_args {&ncc, &online_images};
+    pthread_t online_thread {};
+
+    if (n_online > 0) {
+        pthread_create(&online_thread, nullptr, streamImages<Metric>, &online_args);
+    }
+
+    // Classify all the test images in batches
+    std::vector<int> predictions = ncc.classifyBatch(start_index, n_tests);
+
+    timer.stopTimer();
+
+    if (n_online > 0) {
+        pthread_join(online_thread, nullptr);
+        std::cout << "    Training images added online: " << n_online << std::endl;
+    }
+
+    int miss = 0;  // The number of miss images
+
+    for (int i = 0; i < n_tests; ++i) {
+        int res = predictions[i];
+
+        // If the result is not the same as the label, save the image
+        if (res != test_images.at(i + start_index)->getLabel() && miss < 10){
+            miss++;
+            test_images.at(i + start_index)->saveImage(
+                    "images/ncc_misclassified/miss_" + std::to_string(miss) + "_res_" + std::to_string(res) +
+                    "_label_" + std::to_string(test_images.at(i + start_index)->getLabel())
+            );
+        }
+    }
+
+    std::cout << std::endl;
+
+    std::cout << "    Time to classify the images: ";
+    timer.displayElapsed();
+    std::cout << std::endl;
+
+    std::cout << "Classification Summary:" << std::endl << std::endl;
+    ncc.printStats();  // Print the statistics
+
+    // Export the evaluation report if requested
+    if (!report_name.empty() && ncc.saveReport(report_name)) {
+        std::cout << "    Report saved as " << report_name << ".json and " << report_name << ".csv" << std::endl;
+    }
+}
 
 
 /**
@@ -18,8 +159,13 @@
  *   Optional arguments:
  *   - The number of test images to classify
  *   - The starting index of the test images
+ *   - The distance metric (l2, l1, cosine or mahalanobis)
+ *   - The name of the evaluation report files (<name>.json and <name>.csv)
+ *   - The number of training images streamed into the classifier online during the classification
+ *   - The decay of the online updates
+ *   - The number of prototypes of every class
  *
- * ./main -d /home/username/dataset -k 5 -t 16 -n 10000 -s 0
+ * ./main -d /home/username/dataset -n 10000 -s 0 -m l2 -r report -o 10000 -e 0.999 -p 8
  *
  *
  * @return 0
@@ -29,7 +175,8 @@ int main(int argc, char *argv[]){
     if (argc < 3){
         std::cerr << "Usage: " << argv[0]
                   << " -d <dataset directory> -k <value of K> [-n <number of test images>"
-                     " -s <starting index for tests>]"
+                     " -s <starting index for tests> -m <distance metric> -r <report name>"
+                     " -o <number of online images> -e <online decay> -p <prototypes per class>]"
                   << std::endl;
     }
 
@@ -37,6 +184,11 @@ int main(int argc, char *argv[]){
 
     int n_tests = -1;
     int start_index = -1;
+    std::string metric = L2_Metric::getName();
+    std::string report_name;
+    int n_online = 0;
+    double decay = 1;
+    int n_prototypes = 1;
 
     for (int i = 3; i < argc - 1; i+=2) {
         if (strcmp(argv[i], "-n") == 0){
@@ -55,6 +207,42 @@ int main(int argc, char *argv[]){
                 return 1;
             }
 
+        } else if (strcmp(argv[i], "-m") == 0){
+            metric = argv[i + 1];
+
+            if (metric != L2_Metric::getName() && metric != L1_Metric::getName() &&
+                metric != Cosine_Metric::getName() && metric != Mahalanobis_Metric::getName()){
+                std::cerr << "The metric must be one of: l2, l1, cosine, mahalanobis" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-r") == 0){
+            report_name = argv[i + 1];
+
+        } else if (strcmp(argv[i], "-o") == 0){
+            n_online = std::stoi(argv[i + 1]);
+
+            if (n_online < 0){
+                std::cerr << "The number of online images must be greater/equal than 0" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-e") == 0){
+            decay = std::stod(argv[i + 1]);
+
+            if (decay <= 0 || decay > 1){
+                std::cerr << "The decay must be greater than 0 and less/equal than 1" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-p") == 0){
+            n_prototypes = std::stoi(argv[i + 1]);
+
+            if (n_prototypes < 1){
+                std::cerr << "The number of prototypes must be greater than 0" << std::endl;
+                return 1;
+            }
+
         } else {
             std::cerr << "Invalid argument: " << argv[i] << std::endl;
             return 1;
@@ -74,6 +262,11 @@ int main(int argc, char *argv[]){
     std::cout << "    Dataset directory: " << dataset_dir << std::endl;
     std::cout << "    Number of test images: " << n_tests << std::endl;
     std::cout << "    Starting index: " << start_index << std::endl;
+    std::cout << "    Distance metric: " << metric << std::endl;
+    std::cout << "    Report: " << (report_name.empty() ? "-" : report_name) << std::endl;
+    std::cout << "    Online images: " << n_online << std::endl;
+    std::cout << "    Online decay: " << decay << std::endl;
+    std::cout << "    Prototypes per class: " << n_prototypes << std::endl;
     std::cout << std::endl;
 
 
@@ -126,63 +319,16 @@ int main(int argc, char *argv[]){
 
     std::cout << std::endl;
 
-    // Start the classification process
-    timer.startTimer();
-
-    // Create the NCC object
-    NCC ncc(training_images, test_images);
-
-    std::cout << "Determine the mean vector for each class..." << std::endl;
-    std::cout << std::endl;
-    ncc.calculateMeans();  // Calculate the means for each class
-
-    std::cout << std::endl;
-
-    timer.stopTimer();
-    std::cout << "    Time to calculate the means: ";
-    timer.displayElapsed();
-
-    // save the means as pgm files
-    for (int i = 0; i < 10; i++){
-        ncc.getClassMeans().at(i)->saveImage("images/mean_" + std::to_string(i));
-    }
-
-    std::cout << std::endl;
-    std::cout << "Starting the classification..." << std::endl;
-    std::cout << std::endl;
-
-    timer.startTimer();
-
-    progressbar bar(n_tests);
-
-    std::cout << "    Classifying test images ";
-
-    int miss = 0;  // The number of miss images
-
-    for (int i = 0; i < n_tests; ++i) {
-        bar.update();
-        int res = ncc.classifyImage(i + start_index, false);  // Classify the image
-
-        // If the result is not the same as the label, save the image
-        if (res != test_images.at(i + start_index)->getLabel() && miss < 10){
-            miss++;
-            test_images.at(i + start_index)->saveImage(
-                    "images/ncc_misclassified/miss_" + std::to_string(miss) + "_res_" + std::to_string(res) +
-                    "_label_" + std::to_string(test_images.at(i + start_index)->getLabel())
-            );
-        }
+    // The metric is a template parameter of the classifier, so every metric has its own specialized classifier
+    if (metric == L1_Metric::getName()) {
+        classifyImages<L1_Metric>(n_tests, start_index, report_name, n_online, decay, n_prototypes, training_images, test_images);
+    } else if (metric == Cosine_Metric::getName()) {
+        classifyImages<Cosine_Metric>(n_tests, start_index, report_name, n_online, decay, n_prototypes, training_images, test_images);
+    } else if (metric == Mahalanobis_Metric::getName()) {
+        classifyImages<Mahalanobis_Metric>(n_tests, start_index, report_name, n_online, decay, n_prototypes, training_images, test_images);
+    } else {
+        classifyImages<L2_Metric>(n_tests, start_index, report_name, n_online, decay, n_prototypes, training_images, test_images);
     }
 
-    std::cout << std::endl;
-    std::cout << std::endl;
-
-    timer.stopTimer();
-    std::cout << "    Time to classify the images: ";
-    timer.displayElapsed();
-    std::cout << std::endl;
-
-    std::cout << "Classification Summary:" << std::endl << std::endl;
-    ncc.printStats();  // Print the statistics
-
     return 0;
 }
\ No newline at end of file
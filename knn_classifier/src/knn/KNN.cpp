@@ -4,6 +4,7 @@
 #include "KNN.h"
 
 #define N_THREADS 16
+#define COMPACTION_RATIO 4  // Compact when more than 1 / COMPACTION_RATIO of the training slots are tombstones
 
 /**
  * Class constructor
@@ -12,20 +13,20 @@
  * @param training_images   The training images
  * @param test_images       The test images
  */
-KNN::KNN(int k, const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images) {
+template <class Metric>
+KNN<Metric>::KNN(int k, const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images) {
     KNN::k = k;
-    KNN::n_tests = 0;
-    KNN::n_correct = 0;
-    KNN::n_incorrect = 0;
 
-    KNN::training_images.reserve(training_images.size());
     KNN::test_images.reserve(test_images.size());
 
+    pthread_rwlock_init(&store_lock, nullptr);
+    pthread_mutex_init(&compaction_mutex, nullptr);
+
     // Deep copy the training images
-    for (auto & training_image : training_images) {
-        auto *image = new MNIST_Image(*training_image);
+    KNN::training_store = new Training_Store();
 
-        KNN::training_images.push_back(image);
+    for (auto & training_image : training_images) {
+        KNN::training_store->append(*training_image);
     }
 
     // Deep copy the test images
@@ -34,99 +35,309 @@ KNN::KNN(int k, const std::vector<MNIST_Image *>& training_images, const std::ve
 
         KNN::test_images.push_back(image);
     }
+
+    // Learn the parameters of the metric (if any). Appended images do not change them
+    KNN::metric.fit(training_images);
 }
 
 /**
  * Class destructor
  */
-KNN::~KNN() {
-    // Free the memory
-    for (auto & training_image : KNN::training_images) {
-        delete training_image;
+template <class Metric>
+KNN<Metric>::~KNN() {
+    // Wait for the last background compaction
+    if (KNN::compaction_started) {
+        pthread_join(KNN::compaction_thread, nullptr);
     }
 
+    pthread_rwlock_destroy(&store_lock);
+    pthread_mutex_destroy(&compaction_mutex);
+
+    // Free the memory
+    delete KNN::training_store;
+
     for (auto & test_image : KNN::test_images) {
         delete test_image;
     }
+
+    delete KNN::quantized_store;
 }
 
+// ------------- Getters ------------- //
 /**
- * Increment the number of correct classifications
+ * Get the number of alive training images
+ *
+ * @return The number of alive training images
  */
-void KNN::incrementCorrect() {
-    KNN::n_correct++;
-    KNN::n_tests++;
+template <class Metric>
+uint32_t KNN<Metric>::getTrainingSize() {
+    pthread_rwlock_rdlock(&store_lock);
+    uint32_t size = training_store->getSize();
+    pthread_rwlock_unlock(&store_lock);
+
+    return size;
 }
 
+
+// ------------- Setters ------------- //
 /**
- * Increment the number of incorrect classifications
+ * Records the classifications to a stats object shared with other classifiers instead of the own stats
+ *
+ * @param shared_stats  The shared stats
+ * @param slot          The slot of the shared stats written by this classifier. No other thread may write to it
  */
-void KNN::incrementIncorrect() {
-    KNN::n_incorrect++;
-    KNN::n_tests++;
+template <class Metric>
+void KNN<Metric>::shareStats(Classifier_Stats *shared_stats, int slot) {
+    KNN::stats = shared_stats;
+    KNN::stats_slot = slot;
 }
 
 
 /**
  * Struct to pass arguments to the thread
  */
-typedef struct {
-    int start;       // The index of the first image to process
-    int end;         // The index of the last image to process
+template <class Metric>
+struct Thread_args {
+    int start;            // The index of the first image to process
+    int end;              // The index of the last image to process
 
-    int test_index;  // The index of the test image
-    KNN *knn;        // The KNN object
-} Thread_args;
+    int test_index;       // The index of the test image
+    KNN<Metric> *knn;     // The KNN object
+};
 
 
 /**
- * Thread function for each classifier. Classifies the images in the range [start, end)
+ * Thread function for each classifier. Calculates the distances of the training slots in the range [start, end).
+ * Tombstones are skipped
  *
  * @param arg The thread arguments
  * @return nullptr
  */
+template <class Metric>
 void *calculateDistancesThread(void *args) {
-    auto *thread_args = (Thread_args *) args;
-    KNN *knn = thread_args->knn;
-    int test_index = thread_args->test_index;
+    auto *thread_args = (Thread_args<Metric> *) args;
+    KNN<Metric> *knn = thread_args->knn;
+    const MNIST_Image &test_image = *knn->test_images.at(thread_args->test_index);
 
     for (int i = thread_args->start; i < thread_args->end; i++) {
-        // Reset the distance. Useful if the same training images are used for multiple test images
-        knn->training_images.at(i)->calculateDistance(*knn->test_images.at(test_index));
+        if (knn->training_store->isAlive(i)) {
+            knn->distances[i] = knn->metric.distance(*knn->training_store->getImage(i), test_image);
+        }
     }
 
     return nullptr;
 }
 
 /**
- * Classifies the test image at the given index
+ * Thread function of the background compaction
  *
- * @param test_index  The index of the test image
- * @param verbose     Whether to print the classification result
- * @return The predicted label
+ * @param arg The KNN object
+ * @return nullptr
+ */
+template <class Metric>
+void *compactionThread(void *arg) {
+    auto *knn = (KNN<Metric> *) arg;
+
+    knn->compactTrainingImages();
+    knn->compaction_running = false;
+
+    return nullptr;
+}
+
+/**
+ * Builds the 4-bit copy of the training images and switches the classifier to the quantized search. Every test image
+ * is first compared with the 4-bit images and only the n_candidates closest ones are compared with the exact distance.
+ * The first pass always ranks with the euclidean distance, the rerank uses the metric of the classifier.
+ *
+ * @param n_candidates  The number of first pass candidates to rerank. Must not be smaller than k
+ */
+template <class Metric>
+void KNN<Metric>::enableQuantizedSearch(int n_candidates) {
+    pthread_rwlock_wrlock(&store_lock);
+
+    delete KNN::quantized_store;
+
+    // Tombstones are stored too, the slots of the two stores must match
+    KNN::quantized_store = new Quantized_Store();
+
+    for (uint32_t i = 0; i < training_store->getSlotCount(); ++i) {
+        KNN::quantized_store->append(*training_store->getImage(i));
+    }
+
+    KNN::n_candidates = std::max(uint32_t(n_candidates), k);
+
+    pthread_rwlock_unlock(&store_lock);
+}
+
+/**
+ * Appends a copy of an image to the training images. The quantized copy (if any) is updated in place
+ *
+ * @param image  The labeled image to append
+ * @return       The id of the image, used to remove it
+ */
+template <class Metric>
+uint32_t KNN<Metric>::appendTrainingImage(const MNIST_Image &image) {
+    pthread_rwlock_wrlock(&store_lock);
+
+    uint32_t id = training_store->append(image);
+
+    if (quantized_store != nullptr) {
+        quantized_store->append(image);
+    }
+
+    pthread_rwlock_unlock(&store_lock);
+
+    return id;
+}
+
+/**
+ * Removes a training image. The image is only marked as removed and a background compaction is started when the
+ * tombstones take up too much of the store
+ *
+ * @param id  The id returned when the image was appended. The images given to the constructor have ids 0 to n - 1
+ * @return    True if the image was found and removed
+ */
+template <class Metric>
+bool KNN<Metric>::removeTrainingImage(uint32_t id) {
+    pthread_rwlock_wrlock(&store_lock);
+
+    bool removed = training_store->remove(id);
+    bool compact = training_store->getTombstoneCount() * COMPACTION_RATIO > training_store->getSlotCount();
+
+    pthread_rwlock_unlock(&store_lock);
+
+    if (compact) {
+        startCompaction();
+    }
+
+    return removed;
+}
+
+/**
+ * Starts a background compaction unless one is already running
+ */
+template <class Metric>
+void KNN<Metric>::startCompaction() {
+    if (compaction_running.exchange(true)) {
+        return;
+    }
+
+    pthread_mutex_lock(&compaction_mutex);
+
+    // The previous compaction thread has finished (compaction_running was false), so the join does not block
+    if (compaction_started) {
+        pthread_join(compaction_thread, nullptr);
+    }
+
+    pthread_create(&compaction_thread, nullptr, compactionThread<Metric>, this);
+    compaction_started = true;
+
+    pthread_mutex_unlock(&compaction_mutex);
+}
+
+/**
+ * Drops the tombstones of the training images (and of the quantized copy) by copying the alive images to new stores.
+ *
+ * The copy is made under the read lock, so the classification is never blocked. Updates made between the copy and the
+ * swap are replayed on the new stores under the write lock before swapping them in. The ids do not change, and the
+ * next id is carried over so the ids of the removed images are never handed out again.
+ */
+template <class Metric>
+void KNN<Metric>::compactTrainingImages() {
+    pthread_mutex_lock(&compaction_mutex);
+
+    // 1. Copy the alive images
+    pthread_rwlock_rdlock(&store_lock);
+
+    auto *new_training_store = new Training_Store();
+    Quantized_Store *new_quantized_store = quantized_store != nullptr ? new Quantized_Store() : nullptr;
+    uint32_t n_copied = training_store->getSlotCount();
+
+    for (uint32_t i = 0; i < n_copied; ++i) {
+        if (training_store->isAlive(i)) {
+            new_training_store->appendWithId(*training_store->getImage(i), training_store->getId(i));
+
+            if (new_quantized_store != nullptr) {
+                new_quantized_store->append(*training_store->getImage(i));
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&store_lock);
+
+    // 2. Replay the updates made since the copy and swap the stores
+    pthread_rwlock_wrlock(&store_lock);
+
+    for (uint32_t i = 0; i < n_copied; ++i) {
+        if (!training_store->isAlive(i)) {
+            new_training_store->remove(training_store->getId(i));
+        }
+    }
+
+    for (uint32_t i = n_copied; i < training_store->getSlotCount(); ++i) {
+        if (training_store->isAlive(i)) {
+            new_training_store->appendWithId(*training_store->getImage(i), training_store->getId(i));
+
+            if (new_quantized_store != nullptr) {
+                new_quantized_store->append(*training_store->getImage(i));
+            }
+        }
+    }
+
+    // The quantized search may have been enabled during the copy
+    if (quantized_store != nullptr && new_quantized_store == nullptr) {
+        new_quantized_store = new Quantized_Store();
+
+        for (uint32_t i = 0; i < new_training_store->getSlotCount(); ++i) {
+            new_quantized_store->append(*new_training_store->getImage(i));
+        }
+    }
+
+    // Keep the ids growing, even if the images with the highest ids were removed
+    new_training_store->setNextId(training_store->getNextId());
+
+    std::swap(training_store, new_training_store);
+    std::swap(quantized_store, new_quantized_store);
+
+    pthread_rwlock_unlock(&store_lock);
+
+    pthread_mutex_unlock(&compaction_mutex);
+
+    delete new_training_store;
+    delete new_quantized_store;
+}
+
+/**
+ * Finds the labels of the k nearest training images by calculating the exact distance to every training image
+ *
+ * @param test_index        The index of the test image
+ * @param k_nearest_labels  The output labels of the k nearest training images
  */
-int KNN::classifyImage(int test_index, bool verbose) {
+template <class Metric>
+void KNN<Metric>::findNearestExact(int test_index, std::vector<uint8_t>& k_nearest_labels) {
     typedef void * (*thread_function_ptr)(void *);  // Pointer to a thread function
 
     pthread_attr_t pthread_custom_attr;       // Custom attributes for the threads
     pthread_attr_init(&pthread_custom_attr);  // Initialize the custom attributes
 
-    std::array<Thread_args, N_THREADS> thread_args{};  // The arguments for each thread
+    std::array<Thread_args<Metric>, N_THREADS> thread_args{};  // The arguments for each thread
     std::array<pthread_t, N_THREADS> threads{};        // The threads
 
-    // Calculate the number of images to process per thread
-    int n_images = int(training_images.size());
+    // Calculate the number of images to process per thread. The last thread also gets the remainder
+    int n_images = int(training_store->getSlotCount());
     int n_images_per_thread = n_images / N_THREADS;
 
+    distances.resize(n_images);
+
     // Create the threads
     for (int i = 0; i < N_THREADS; ++i) {
         thread_args[i].start = i * n_images_per_thread;
-        thread_args[i].end = (i + 1) * n_images_per_thread;
+        thread_args[i].end = i == N_THREADS - 1 ? n_images : (i + 1) * n_images_per_thread;
         thread_args[i].test_index = test_index;
         thread_args[i].knn = this;
 
         // Create the thread
-        pthread_create(&threads[i], &pthread_custom_attr, (thread_function_ptr)calculateDistancesThread, &thread_args[i]);
+        pthread_create(&threads[i], &pthread_custom_attr, (thread_function_ptr)calculateDistancesThread<Metric>, &thread_args[i]);
     }
 
     // Wait for all threads to finish
@@ -134,35 +345,110 @@ int KNN::classifyImage(int test_index, bool verbose) {
         pthread_join(threads[i], nullptr);
     }
 
+    // Keep the k closest alive slots. The store itself is never reordered, so the slots stay valid for the updates
+    candidates.clear();
+    for (uint32_t i = 0; i < uint32_t(n_images); ++i) {
+        if (training_store->isAlive(i)) {
+            candidates.push_back(i);
+        }
+    }
 
-//    std::sort(training_images.begin(), training_images.end(), [](MNIST_Image *a, MNIST_Image *b) {
-//        return a->getDistance() < b->getDistance();
-//    });
+    uint32_t n_nearest = std::min(k, uint32_t(candidates.size()));
 
-    // Get the k smallest distances
-    std::vector<MNIST_Image> k_smallest_images;
-    k_smallest_images.reserve(k);
+    std::partial_sort(candidates.begin(), candidates.begin() + n_nearest, candidates.end(),
+                      [this](uint32_t a, uint32_t b) {
+        return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+    });
 
-    /*
-     * Instead of sorting the entire array, we can simply get the smallest distance and remove it from the array k times
-     * The time complexity is roughly O(kn) instead of O(nlogn)
-     */
-    for (int i = 0; i < k; ++i) {
-        auto min = std::min_element(training_images.begin() + i, training_images.end(), [](MNIST_Image *a, MNIST_Image *b) {
-            return a->getDistance() < b->getDistance();
-        });
+    for (uint32_t i = 0; i < n_nearest; ++i) {
+        k_nearest_labels.push_back(training_store->getImage(candidates[i])->getLabel());
+    }
+}
 
-        // add the minimum element to the vector
-        k_smallest_images.push_back(**min);
+/**
+ * Finds the labels of the k nearest training images in two passes. The first pass scans the 4-bit copy of the training
+ * images and keeps the n_candidates closest ones. The second pass calculates the exact distance of the candidates
+ * only, so the result is the exact one as long as the true k nearest images survive the first pass.
+ *
+ * The scan runs in the calling thread. The classifiers are already run in parallel, one per thread.
+ *
+ * @param test_index        The index of the test image
+ * @param k_nearest_labels  The output labels of the k nearest training images
+ */
+template <class Metric>
+void KNN<Metric>::findNearestQuantized(int test_index, std::vector<uint8_t>& k_nearest_labels) {
+    const MNIST_Image &test_image = *test_images.at(test_index);
+
+    // 1. Approximate distances to all the training images
+    quantized_store->scanDistances(test_image, approx_distances);
+
+    // 2. Keep the n_candidates closest alive images
+    candidates.clear();
+    for (uint32_t i = 0; i < approx_distances.size(); ++i) {
+        if (training_store->isAlive(i)) {
+            candidates.push_back(i);
+        }
+    }
+
+    uint32_t n_rerank = std::min(n_candidates, uint32_t(candidates.size()));
+    uint32_t n_nearest = std::min(k, n_rerank);
+
+    if (n_nearest == 0) {
+        return;
+    }
+
+    const std::vector<uint32_t> &approx = approx_distances;
+    std::nth_element(candidates.begin(), candidates.begin() + n_rerank - 1, candidates.end(),
+                     [&approx](uint32_t a, uint32_t b) {
+        return approx[a] < approx[b];
+    });
+
+    // 3. Rerank the candidates with the exact distance
+    distances.resize(approx_distances.size());
+
+    for (uint32_t i = 0; i < n_rerank; ++i) {
+        distances[candidates[i]] = metric.distance(*training_store->getImage(candidates[i]), test_image);
+    }
+
+    std::partial_sort(candidates.begin(), candidates.begin() + n_nearest, candidates.begin() + n_rerank,
+                      [this](uint32_t a, uint32_t b) {
+        return distances[a] < distances[b] || (distances[a] == distances[b] && a < b);
+    });
 
-        // swap the minimum element with the first element
-        std::swap(*min, training_images.at(i));
+    for (uint32_t i = 0; i < n_nearest; ++i) {
+        k_nearest_labels.push_back(training_store->getImage(candidates[i])->getLabel());
     }
+}
+
+/**
+ * Classifies the test image at the given index
+ *
+ * @param test_index  The index of the test image
+ * @param verbose     Whether to print the classification result
+ * @return The predicted label
+ */
+template <class Metric>
+int KNN<Metric>::classifyImage(int test_index, bool verbose) {
+    uint64_t start_time = Classifier_Stats::now();
 
-    // Count the number of images with each label
+    // Get the labels of the k nearest training images
+    std::vector<uint8_t> k_nearest_labels;
+    k_nearest_labels.reserve(k);
+
+    pthread_rwlock_rdlock(&store_lock);
+
+    if (quantized_store != nullptr) {
+        findNearestQuantized(test_index, k_nearest_labels);
+    } else {
+        findNearestExact(test_index, k_nearest_labels);
+    }
+
+    pthread_rwlock_unlock(&store_lock);
+
+    // Count the number of images with each label. Fewer than k labels are found if the training set is that small
     std::array<int, 10> label_count {};
-    for (int i = 0; i < k; ++i) {
-        label_count.at(k_smallest_images.at(i).getLabel())++;
+    for (auto & label : k_nearest_labels) {
+        label_count.at(label)++;
     }
 
     // Find the label with the most votes
@@ -176,11 +462,8 @@ int KNN::classifyImage(int test_index, bool verbose) {
     }
 
     // Update the stats
-    if (test_images.at(test_index)->isLabel(max_label)) {
-        incrementCorrect();
-    } else {
-        incrementIncorrect();
-    }
+    stats->recordClassification(stats_slot, test_images.at(test_index)->getLabel(), uint8_t(max_label),
+                                Classifier_Stats::now() - start_time);
 
     // Print the results
     if (verbose) {
@@ -206,43 +489,42 @@ int KNN::classifyImage(int test_index, bool verbose) {
 }
 
 /**
- * Calculates the accuracy of the classifier
+ * Prints the accuracy of the classifier. If the stats are shared, the results of all the classifiers sharing them
  */
-void KNN::calculateAccuracy() {
-    accuracy = (double(n_correct) / double(n_tests)) * 100;
-}
-
-/**
- * Prints the accuracy of the classifier
- */
-void KNN::printStats(){
-    calculateAccuracy();  // Calculate the accuracy
+template <class Metric>
+void KNN<Metric>::printStats(){
+    Stats_Snapshot snapshot = stats->getSnapshot();
 
     // Print the results
     std::cout << std::endl;
     std::cout << std::endl;
     std::cout << std::endl;
     std::cout << "Classification Summary:" << std::endl << std::endl;
-    std::cout << "    Number of tests: " << n_tests << std::endl;
-    std::cout << "    Number of correct classifications: " << n_correct << std::endl;
-    std::cout << "    Number of incorrect classifications: " << n_incorrect << std::endl;
+    std::cout << "    Number of tests: " << snapshot.n_tests << std::endl;
+    std::cout << "    Number of correct classifications: " << snapshot.n_correct << std::endl;
+    std::cout << "    Number of incorrect classifications: " << snapshot.n_incorrect << std::endl;
     std::cout.precision(3);
-    std::cout << "    Accuracy: " << std::fixed << accuracy << "%" << std::endl;
+    std::cout << "    Accuracy: " << std::fixed << snapshot.getAccuracy() << "%" << std::endl;
+    std::cout << "    Latency p50 / p99: " << double(snapshot.getLatencyPercentile(50)) / 1000 << "us / "
+              << double(snapshot.getLatencyPercentile(99)) / 1000 << "us" << std::endl;
 
+    Evaluation_Report(snapshot).printReport();
 }
 
 /**
- * Accumulates the stats from another KNN object
+ * Exports the evaluation report (confusion matrix, per class precision, recall and latency) as JSON and CSV
  *
- * @param knn_classifiers The KNN vector to accumulate stats from
- */
-void KNN::accumulateStats(const std::vector<KNN *>& knn_classifiers) {
-    // Accumulate the stats
-    for (auto & knn_classifier : knn_classifiers) {
-        if (knn_classifier != this) {
-            n_correct += knn_classifier->n_correct;
-            n_incorrect += knn_classifier->n_incorrect;
-            n_tests += knn_classifier->n_tests;
-        }
-    }
+ * @param name  The path of the files without the extension
+ * @return      True if the files were written
+ */
+template <class Metric>
+bool KNN<Metric>::saveReport(const std::string &name) const {
+    return Evaluation_Report(stats->getSnapshot()).saveReport(name);
 }
+
+
+// Instantiate the classifier for every available metric
+template class KNN<L2_Metric>;
+template class KNN<L1_Metric>;
+template class KNN<Cosine_Metric>;
+template class KNN<Mahalanobis_Metric>;
@@ -2,11 +2,27 @@
 #define KNN_CLASSIFIER_KNN_H
 
 
+#include <atomic>
 #include <cstdint>
+#include <pthread.h>
 #include <vector>
 #include "../mnist/MNIST_Image.h"
-
-
+#include "../metrics/Distance_Metrics.h"
+#include "Evaluation_Report.h"
+#include "Quantized_Store.h"
+#include "Training_Store.h"
+
+
+/**
+ * K nearest neighbors classifier
+ *
+ * Training images can be appended and removed while the classifier is in use. Removed images are kept as tombstones
+ * and skipped by the search until a background compaction drops them. classifyImage must be called by one thread at a
+ * time, the update functions can be called from any thread.
+ *
+ * @tparam Metric  The distance metric used to find the neighbors (see metrics/Distance_Metrics.h)
+ */
+template <class Metric>
 class KNN {
 public:
     // Constructors
@@ -19,33 +35,55 @@ public:
     ~KNN();
 
     // Getters
+    uint32_t getTrainingSize();
 
     // Setters
-    void incrementCorrect();
-    void incrementIncorrect();
+    void shareStats(Classifier_Stats *shared_stats, int slot);
 
     // Functions
+    void enableQuantizedSearch(int n_candidates);
+    uint32_t appendTrainingImage(const MNIST_Image &image);
+    bool removeTrainingImage(uint32_t id);
+    void compactTrainingImages();
     int classifyImage(int test_index, bool verbose = false);
     void printStats();
-    void accumulateStats(const std::vector<KNN *>& knn_classifiers);
+    bool saveReport(const std::string &name) const;
 
     // Friend functions
+    template <class M>
     friend void * calculateDistancesThread(void *arg);
 
+    template <class M>
+    friend void * compactionThread(void *arg);
+
 
 private:
     // Variables
-    uint32_t k {1};  /// The number of nearest neighbors to consider
-    std::vector<MNIST_Image *> training_images;   /// The training images
+    uint32_t k {1};     /// The number of nearest neighbors to consider
+    Metric metric {};   /// The distance metric
+    Training_Store *training_store {nullptr};     /// The training images
     std::vector<MNIST_Image *> test_images;       /// The training images
+    std::vector<double> distances {};             /// The exact distances of the current test image (one per slot)
+
+    Classifier_Stats own_stats {1};         /// The stats of the classifier when they are not shared
+    Classifier_Stats *stats {&own_stats};   /// The stats the classifications are recorded to
+    int stats_slot {0};                     /// The slot of the stats written by this classifier
+
+    Quantized_Store *quantized_store {nullptr};  /// The 4-bit copy of the training images (quantized search only)
+    uint32_t n_candidates {0};                   /// The number of first pass candidates reranked exactly
+    std::vector<uint32_t> approx_distances {};   /// The first pass distances of the current test image
+    std::vector<uint32_t> candidates {};         /// The training image slots ordered by the distance
 
-    int n_tests {0};        /// The number of tests performed
-    int n_correct {0};      /// The number of correct classifications
-    int n_incorrect {0};    /// The number of incorrect classifications
-    double accuracy {0};    /// The accuracy of the classifier
+    pthread_rwlock_t store_lock {};                 /// Readers classify, writers update the training images
+    pthread_mutex_t compaction_mutex {};            /// Serializes the compactions
+    pthread_t compaction_thread {};                 /// The background compaction thread
+    bool compaction_started {false};                /// Whether compaction_thread has to be joined
+    std::atomic<bool> compaction_running {false};   /// Whether a background compaction is in progress
 
     // Functions
-    void calculateAccuracy();
+    void startCompaction();
+    void findNearestExact(int test_index, std::vector<uint8_t>& k_nearest_labels);
+    void findNearestQuantized(int test_index, std::vector<uint8_t>& k_nearest_labels);
 };
 
 
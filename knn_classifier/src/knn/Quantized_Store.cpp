@@ -0,0 +1,183 @@
+#include <algorithm>
+
+#include "Quantized_Store.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+/*
+ * Every u16 lane of the scan accumulators receives at most one lookup value (<= 241) per pixel pair. Flushing them to
+ * the u32 accumulators every 256 pairs keeps the partial sums below 65535.
+ */
+#define QUANTIZED_FLUSH_PAIRS 256
+
+/**
+ * Class constructor. Packs the 4 high bits of every pixel of the images in the blocked layout
+ *
+ * @param images  The images to store
+ */
+Quantized_Store::Quantized_Store(const std::vector<MNIST_Image *>& images) {
+    for (auto & image : images) {
+        append(*image);
+    }
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of images in the store
+ *
+ * @return The number of images in the store
+ */
+uint32_t Quantized_Store::getSize() const {
+    return Quantized_Store::n_images;
+}
+
+/**
+ * Get the codes of a block
+ *
+ * @param block  The index of the block
+ * @return       Pointer to the QUANTIZED_BLOCK_BYTES bytes of the block
+ */
+const uint8_t *Quantized_Store::getBlockCodes(uint32_t block) const {
+    return chunks[block / QUANTIZED_CHUNK_BLOCKS].data() + size_t(block % QUANTIZED_CHUNK_BLOCKS) * QUANTIZED_BLOCK_BYTES;
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Pack the 4 high bits of every pixel of an image in the next free position of the store
+ *
+ * @param image  The image to append
+ */
+void Quantized_Store::append(const MNIST_Image &image) {
+    // Start a new block (and chunk) when the last one is full. The padding images of a block are all zeros
+    if (n_images == n_blocks * QUANTIZED_BLOCK_SIZE) {
+        if (n_blocks % QUANTIZED_CHUNK_BLOCKS == 0) {
+            chunks.emplace_back(size_t(QUANTIZED_CHUNK_BLOCKS) * QUANTIZED_BLOCK_BYTES, 0);
+        }
+
+        n_blocks++;
+    }
+
+    uint32_t i = n_images++;
+    uint32_t b = i / QUANTIZED_BLOCK_SIZE;
+    uint8_t *block = chunks[b / QUANTIZED_CHUNK_BLOCKS].data() + size_t(b % QUANTIZED_CHUNK_BLOCKS) * QUANTIZED_BLOCK_BYTES;
+    uint32_t lane = i % 16;
+    int shift = (i % QUANTIZED_BLOCK_SIZE) < 16 ? 0 : 4;
+
+    for (int p = 0; p < MNIST_IMAGE_SIZE; p++) {
+        block[p * 16 + lane] |= uint8_t((image.getPixel(p) >> 4) << shift);
+    }
+}
+
+/**
+ * Build the 16 entry lookup table of every pixel for the given query. The query keeps its 8-bit precision and a code c
+ * stands for the center of its bucket (16 * c + 8), so entry c of pixel p is the squared difference of the two scaled
+ * down by 256 to fit in a byte (at most 241).
+ *
+ * @param query   The image the distances are calculated to
+ * @param tables  The output tables (QUANTIZED_LUT_BYTES bytes)
+ */
+void Quantized_Store::buildLookupTables(const MNIST_Image &query, uint8_t *tables) {
+    for (int p = 0; p < MNIST_IMAGE_SIZE; p++) {
+        int pixel = query.getPixel(p);
+
+        for (int c = 0; c < 16; c++) {
+            int diff = pixel - (16 * c + 8);
+            tables[p * 16 + c] = uint8_t((diff * diff + 128) >> 8);
+        }
+    }
+}
+
+/**
+ * Calculate the approximate distances of the QUANTIZED_BLOCK_SIZE images of a block
+ *
+ * @param block            The index of the block
+ * @param tables           The lookup tables of the query
+ * @param block_distances  The output distances (QUANTIZED_BLOCK_SIZE values)
+ */
+void Quantized_Store::scanBlock(uint32_t block, const uint8_t *tables, uint32_t *block_distances) const {
+    const uint8_t *block_codes = getBlockCodes(block);
+
+#ifdef __AVX2__
+    /*
+     * Every iteration handles 2 pixels: the low 128-bit lane holds pixel p and the high lane pixel p + 1, both for the
+     * codes and the lookup tables. The shuffle resolves the 32 codes of each lane to their partial distances, which
+     * are widened to u16 and added to 4 accumulators (images 0-7, 8-15, 16-23 and 24-31, one pixel per lane).
+     */
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i totals[4] = {zero, zero, zero, zero};
+
+    for (int pair = 0; pair < MNIST_IMAGE_SIZE / 2; pair += QUANTIZED_FLUSH_PAIRS) {
+        int end = std::min(pair + QUANTIZED_FLUSH_PAIRS, MNIST_IMAGE_SIZE / 2);
+
+        __m256i partial[4] = {zero, zero, zero, zero};
+
+        for (int i = pair; i < end; i++) {
+            __m256i packed = _mm256_loadu_si256((const __m256i *) (block_codes + i * 32));
+            __m256i lut = _mm256_loadu_si256((const __m256i *) (tables + i * 32));
+
+            __m256i low = _mm256_shuffle_epi8(lut, _mm256_and_si256(packed, low_mask));
+            __m256i high = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(packed, 4), low_mask));
+
+            partial[0] = _mm256_add_epi16(partial[0], _mm256_unpacklo_epi8(low, zero));
+            partial[1] = _mm256_add_epi16(partial[1], _mm256_unpackhi_epi8(low, zero));
+            partial[2] = _mm256_add_epi16(partial[2], _mm256_unpacklo_epi8(high, zero));
+            partial[3] = _mm256_add_epi16(partial[3], _mm256_unpackhi_epi8(high, zero));
+        }
+
+        // Fold the two pixel lanes together while widening to u32
+        for (int j = 0; j < 4; j++) {
+            __m256i even = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(partial[j]));
+            __m256i odd = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(partial[j], 1));
+
+            totals[j] = _mm256_add_epi32(totals[j], _mm256_add_epi32(even, odd));
+        }
+    }
+
+    for (int j = 0; j < 4; j++) {
+        _mm256_storeu_si256((__m256i *) (block_distances + j * 8), totals[j]);
+    }
+
+#else
+    for (int j = 0; j < QUANTIZED_BLOCK_SIZE; j++) {
+        block_distances[j] = 0;
+    }
+
+    for (int p = 0; p < MNIST_IMAGE_SIZE; p++) {
+        const uint8_t *lut = tables + p * 16;
+
+        for (int j = 0; j < 16; j++) {
+            uint8_t packed = block_codes[p * 16 + j];
+
+            block_distances[j] += lut[packed & 0x0F];
+            block_distances[j + 16] += lut[packed >> 4];
+        }
+    }
+#endif
+}
+
+/**
+ * Calculate the approximate distance of every stored image to the query. The distances are the squared euclidean
+ * distances between the query and the 4-bit images scaled down by 256.
+ *
+ * @param query      The image to calculate the distances to
+ * @param distances  The output distances. Resized to the number of images in the store
+ */
+void Quantized_Store::scanDistances(const MNIST_Image &query, std::vector<uint32_t>& distances) const {
+    alignas(32) uint8_t tables[QUANTIZED_LUT_BYTES];
+    buildLookupTables(query, tables);
+
+    // Room for the padding images of the last block
+    distances.resize(size_t(n_blocks) * QUANTIZED_BLOCK_SIZE);
+
+    for (uint32_t block = 0; block < n_blocks; block++) {
+        scanBlock(block, tables, distances.data() + size_t(block) * QUANTIZED_BLOCK_SIZE);
+    }
+
+    distances.resize(n_images);
+}
@@ -0,0 +1,55 @@
+#ifndef KNN_CLASSIFIER_QUANTIZED_STORE_H
+#define KNN_CLASSIFIER_QUANTIZED_STORE_H
+
+
+#include <cstdint>
+#include <vector>
+#include "../mnist/MNIST_Image.h"
+
+#define QUANTIZED_BLOCK_SIZE 32                                          // Images interleaved in every block
+#define QUANTIZED_BLOCK_BYTES (MNIST_IMAGE_SIZE * QUANTIZED_BLOCK_SIZE / 2)  // Bytes of a packed block
+#define QUANTIZED_LUT_BYTES (MNIST_IMAGE_SIZE * 16)                      // Bytes of the per query lookup tables
+#define QUANTIZED_CHUNK_BLOCKS 32                                        // Blocks allocated together when growing
+
+
+/**
+ * 4-bit copy of a set of images used for a fast first pass distance scan. Every pixel is reduced to its 4 high bits
+ * and two images share each byte (nibble packed), halving the bytes read per image compared to the 8-bit pixels.
+ *
+ * The images are interleaved in blocks of QUANTIZED_BLOCK_SIZE. Inside a block the 16 bytes of pixel p hold the codes
+ * of images 0-15 in the low nibbles and of images 16-31 in the high nibbles. That way a single byte shuffle with the
+ * 16 entry lookup table of pixel p produces the partial distance of 16 images at once.
+ *
+ * The blocks are allocated in chunks of QUANTIZED_CHUNK_BLOCKS, so images can be appended one at a time without moving
+ * the codes already stored.
+ */
+class Quantized_Store {
+public:
+    // Constructors
+    Quantized_Store() = default;
+    explicit Quantized_Store(const std::vector<MNIST_Image *>& images);
+
+    // Destructor
+    ~Quantized_Store() = default;
+
+    // Getters
+    uint32_t getSize() const;
+
+    // Functions
+    void append(const MNIST_Image &image);
+    void scanDistances(const MNIST_Image &query, std::vector<uint32_t>& distances) const;
+
+private:
+    // Variables
+    uint32_t n_images {0};          /// The number of images in the store
+    uint32_t n_blocks {0};          /// The number of interleaved blocks
+    std::vector<std::vector<uint8_t>> chunks {};  /// The nibble packed pixels in the blocked layout
+
+    // Functions
+    const uint8_t *getBlockCodes(uint32_t block) const;
+    static void buildLookupTables(const MNIST_Image &query, uint8_t *tables);
+    void scanBlock(uint32_t block, const uint8_t *tables, uint32_t *block_distances) const;
+};
+
+
+#endif
@@ -0,0 +1,151 @@
+#include <algorithm>
+
+#include "Training_Store.h"
+
+/**
+ * Class destructor
+ */
+Training_Store::~Training_Store() {
+    // Free the chunks
+    for (auto & chunk : Training_Store::chunks) {
+        delete[] chunk;
+    }
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of used slots. Slots of removed images are counted until the store is compacted
+ *
+ * @return The number of used slots
+ */
+uint32_t Training_Store::getSlotCount() const {
+    return Training_Store::n_slots;
+}
+
+/**
+ * Get the number of alive images
+ *
+ * @return The number of alive images
+ */
+uint32_t Training_Store::getSize() const {
+    return Training_Store::n_alive;
+}
+
+/**
+ * Get the number of removed images that still occupy a slot
+ *
+ * @return The number of tombstones
+ */
+uint32_t Training_Store::getTombstoneCount() const {
+    return Training_Store::n_slots - Training_Store::n_alive;
+}
+
+/**
+ * Check if the image of a slot is alive
+ *
+ * @param slot  The slot
+ * @return      True if the image has not been removed
+ */
+bool Training_Store::isAlive(uint32_t slot) const {
+    return Training_Store::alive[slot] != 0;
+}
+
+/**
+ * Get the id of the image of a slot
+ *
+ * @param slot  The slot
+ * @return      The id of the image
+ */
+uint32_t Training_Store::getId(uint32_t slot) const {
+    return Training_Store::ids[slot];
+}
+
+/**
+ * Get the image of a slot
+ *
+ * @param slot  The slot
+ * @return      Pointer to the image. Valid until the store is destroyed
+ */
+MNIST_Image *Training_Store::getImage(uint32_t slot) const {
+    return &Training_Store::chunks[slot / TRAINING_CHUNK_SIZE][slot % TRAINING_CHUNK_SIZE];
+}
+
+/**
+ * Get the id the next appended image will get
+ *
+ * @return The next id
+ */
+uint32_t Training_Store::getNextId() const {
+    return Training_Store::next_id;
+}
+
+
+// ------------- Setters ------------- //
+/**
+ * Make the next appended images get at least a given id. Used by a compaction to carry the ids of the old store over,
+ * so the ids of the removed images are not reused
+ *
+ * @param id  The smallest id of the next appended image
+ */
+void Training_Store::setNextId(uint32_t id) {
+    Training_Store::next_id = std::max(Training_Store::next_id, id);
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Copy an image to the end of the store
+ *
+ * @param image  The image to append
+ * @return       The id of the appended image
+ */
+uint32_t Training_Store::append(const MNIST_Image &image) {
+    return appendWithId(image, Training_Store::next_id);
+}
+
+/**
+ * Copy an image to the end of the store keeping a given id. Used to move images between stores during a compaction
+ *
+ * @param image  The image to append
+ * @param id     The id of the image
+ * @return       The id of the appended image
+ */
+uint32_t Training_Store::appendWithId(const MNIST_Image &image, uint32_t id) {
+    // Allocate a new chunk when the last one is full
+    if (Training_Store::n_slots == Training_Store::chunks.size() * TRAINING_CHUNK_SIZE) {
+        Training_Store::chunks.push_back(new MNIST_Image[TRAINING_CHUNK_SIZE]);
+    }
+
+    uint32_t slot = Training_Store::n_slots++;
+    *getImage(slot) = image;
+
+    Training_Store::alive.push_back(1);
+    Training_Store::ids.push_back(id);
+    Training_Store::slots_by_id[id] = slot;
+
+    Training_Store::n_alive++;
+    Training_Store::next_id = std::max(Training_Store::next_id, id + 1);
+
+    return id;
+}
+
+/**
+ * Remove an image. The slot of the image is kept as a tombstone until the store is compacted
+ *
+ * @param id  The id of the image
+ * @return    True if the image was found and removed
+ */
+bool Training_Store::remove(uint32_t id) {
+    auto it = Training_Store::slots_by_id.find(id);
+
+    if (it == Training_Store::slots_by_id.end()) {
+        return false;
+    }
+
+    Training_Store::alive[it->second] = 0;
+    Training_Store::slots_by_id.erase(it);
+    Training_Store::n_alive--;
+
+    return true;
+}
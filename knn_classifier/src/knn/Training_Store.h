@@ -0,0 +1,63 @@
+#ifndef KNN_CLASSIFIER_TRAINING_STORE_H
+#define KNN_CLASSIFIER_TRAINING_STORE_H
+
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "../mnist/MNIST_Image.h"
+
+#define TRAINING_CHUNK_SIZE 1024  // The number of images in every chunk of the store
+
+
+/**
+ * Growable store of training images. The images are kept in fixed size chunks, so appending an image never moves the
+ * images already stored. Removed images are only marked as dead (tombstones) and keep their slot until the store is
+ * compacted.
+ *
+ * Every image gets an id when it is appended. The id does not change when the store is compacted, unlike the slot.
+ * The ids only grow: a compaction carries the next id over to the new store, so the id of a removed image is never
+ * handed out again.
+ */
+class Training_Store {
+public:
+    // Constructors
+    Training_Store() = default;
+
+    // Copy constructors
+    Training_Store(const Training_Store &other) = delete;
+
+    // Destructor
+    ~Training_Store();
+
+    // Getters
+    uint32_t getSlotCount() const;
+    uint32_t getSize() const;
+    uint32_t getTombstoneCount() const;
+    bool isAlive(uint32_t slot) const;
+    uint32_t getId(uint32_t slot) const;
+    MNIST_Image *getImage(uint32_t slot) const;
+    uint32_t getNextId() const;
+
+    // Setters
+    void setNextId(uint32_t id);
+
+    // Functions
+    uint32_t append(const MNIST_Image &image);
+    uint32_t appendWithId(const MNIST_Image &image, uint32_t id);
+    bool remove(uint32_t id);
+
+private:
+    // Variables
+    std::vector<MNIST_Image *> chunks {};                    /// The chunks of TRAINING_CHUNK_SIZE images
+    std::vector<uint8_t> alive {};                           /// Whether the image of every slot is alive
+    std::vector<uint32_t> ids {};                            /// The id of the image of every slot
+    std::unordered_map<uint32_t, uint32_t> slots_by_id {};   /// The slot of every alive image
+
+    uint32_t n_slots {0};    /// The number of used slots (alive and dead)
+    uint32_t n_alive {0};    /// The number of alive images
+    uint32_t next_id {0};    /// The id of the next appended image
+};
+
+
+#endif
@@ -0,0 +1,232 @@
+#include "Distance_Metrics.h"
+
+#include <algorithm>
+
+
+// ------------- L2 ------------- //
+const char *L2_Metric::getName() {
+    return "l2";
+}
+
+/**
+ * The euclidean distance has no parameters
+ */
+void L2_Metric::fit(const std::vector<MNIST_Image *>&) {}
+
+/**
+ * The euclidean distance has no parameters
+ *
+ * @return  An empty vector
+ */
+std::vector<float> L2_Metric::getParameters() const {
+    return {};
+}
+
+/**
+ * The euclidean distance has no parameters
+ *
+ * @param n_parameters  The number of parameters
+ * @return              True if there are none
+ */
+bool L2_Metric::setParameters(const float *, int n_parameters) {
+    return n_parameters == 0;
+}
+
+/**
+ * |c - x|^2 = |c|^2 - 2 x . c + |x|^2 and the last term is the same for every centroid
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid
+ * @param weights                The MNIST_IMAGE_SIZE weights of the row: 2 c
+ * @param bias                   The bias of the row: |c|^2
+ * @return                       True
+ */
+bool L2_Metric::linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const {
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        weights[i] = 2 * centroid[i];
+    }
+
+    bias = centroid_squared_norm;
+    return true;
+}
+
+
+// ------------- L1 ------------- //
+const char *L1_Metric::getName() {
+    return "l1";
+}
+
+/**
+ * The manhattan distance has no parameters
+ */
+void L1_Metric::fit(const std::vector<MNIST_Image *>&) {}
+
+/**
+ * The Manhattan distance has no parameters
+ *
+ * @return  An empty vector
+ */
+std::vector<float> L1_Metric::getParameters() const {
+    return {};
+}
+
+/**
+ * The Manhattan distance has no parameters
+ *
+ * @param n_parameters  The number of parameters
+ * @return              True if there are none
+ */
+bool L1_Metric::setParameters(const float *, int n_parameters) {
+    return n_parameters == 0;
+}
+
+/**
+ * The manhattan distance is not linear in the image
+ *
+ * @return  False
+ */
+bool L1_Metric::linearize(const float *, float, float *, float &) const {
+    return false;
+}
+
+
+// ------------- Cosine ------------- //
+const char *Cosine_Metric::getName() {
+    return "cosine";
+}
+
+/**
+ * The cosine distance has no parameters. The norms are kept up to date by the images
+ */
+void Cosine_Metric::fit(const std::vector<MNIST_Image *>&) {}
+
+/**
+ * The cosine distance has no parameters
+ *
+ * @return  An empty vector
+ */
+std::vector<float> Cosine_Metric::getParameters() const {
+    return {};
+}
+
+/**
+ * The cosine distance has no parameters
+ *
+ * @param n_parameters  The number of parameters
+ * @return              True if there are none
+ */
+bool Cosine_Metric::setParameters(const float *, int n_parameters) {
+    return n_parameters == 0;
+}
+
+/**
+ * 1 - x . c / (|x| |c|) ranks the centroids the same way as -x . c / |c|, since |x| is the same for every centroid.
+ * An empty centroid gets zero weights, so it is never nearer than a centroid in the direction of the image.
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid
+ * @param weights                The MNIST_IMAGE_SIZE weights of the row: c / |c|
+ * @param bias                   The bias of the row: 0
+ * @return                       True
+ */
+bool Cosine_Metric::linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const {
+    float scale = centroid_squared_norm == 0 ? 0 : float(1 / std::sqrt(double(centroid_squared_norm)));
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        weights[i] = centroid[i] * scale;
+    }
+
+    bias = 0;
+    return true;
+}
+
+
+// ------------- Mahalanobis ------------- //
+const char *Mahalanobis_Metric::getName() {
+    return "mahalanobis";
+}
+
+/**
+ * Learn the pixel weights from the variance of every pixel in the training set
+ *
+ * @param training_images  The training images
+ */
+void Mahalanobis_Metric::fit(const std::vector<MNIST_Image *>& training_images) {
+    std::array<double, MNIST_IMAGE_SIZE> sums {};
+    std::array<double, MNIST_IMAGE_SIZE> squared_sums {};
+
+    for (auto & image : training_images) {
+        const uint8_t *pixels = image->getPixelData();
+
+        for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+            sums[i] += pixels[i];
+            squared_sums[i] += double(pixels[i]) * pixels[i];
+        }
+    }
+
+    // Calculate the variance of every pixel and the mean variance used as regularization
+    double n = training_images.empty() ? 1 : double(training_images.size());
+    std::array<double, MNIST_IMAGE_SIZE> variances {};
+    double mean_variance = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        double mean = sums[i] / n;
+
+        variances[i] = std::max(squared_sums[i] / n - mean * mean, 0.0);
+        mean_variance += variances[i] / MNIST_IMAGE_SIZE;
+    }
+
+    // The weights are in (0, 1]: constant pixels keep a weight of 1 and the noisy pixels are scaled down
+    double regularization = mean_variance > 0 ? mean_variance : 1;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        weights[i] = float(regularization / (variances[i] + regularization));
+    }
+}
+
+/**
+ * Get the learned pixel weights
+ *
+ * @return  The weight of every pixel
+ */
+std::vector<float> Mahalanobis_Metric::getParameters() const {
+    return std::vector<float>(weights.begin(), weights.end());
+}
+
+/**
+ * Restore pixel weights learned by fit()
+ *
+ * @param parameters    The weight of every pixel
+ * @param n_parameters  The number of weights
+ * @return              True if there is one weight for every pixel
+ */
+bool Mahalanobis_Metric::setParameters(const float *parameters, int n_parameters) {
+    if (n_parameters != MNIST_IMAGE_SIZE) {
+        return false;
+    }
+
+    std::copy(parameters, parameters + MNIST_IMAGE_SIZE, weights.begin());
+
+    return true;
+}
+
+/**
+ * sum w (c - x)^2 = sum w c^2 - 2 x . (w c) + sum w x^2 and the last term is the same for every centroid
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid (unused)
+ * @param weights                The MNIST_IMAGE_SIZE weights of the row: 2 w c
+ * @param bias                   The bias of the row: sum w c^2
+ * @return                       True
+ */
+bool Mahalanobis_Metric::linearize(const float *centroid, float, float *weights, float &bias) const {
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        weights[i] = 2 * this->weights[i] * centroid[i];
+        sum += double(this->weights[i]) * centroid[i] * centroid[i];
+    }
+
+    bias = float(sum);
+    return true;
+}
@@ -0,0 +1,638 @@
+#ifndef KNN_CLASSIFIER_DISTANCE_METRICS_H
+#define KNN_CLASSIFIER_DISTANCE_METRICS_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "../mnist/MNIST_Image.h"
+
+/*
+ * Distance metrics used by the classifiers. Every metric is a policy class passed to the classifiers as a template
+ * parameter, so the distance kernel is chosen at compile time and each metric has its own SIMD loop.
+ *
+ * Every metric provides:
+ *   - getName()  The name of the metric as given in the command line
+ *   - fit()      Learns the parameters of the metric from the training images (if any)
+ *   - getParameters() / setParameters() Export and restore the learned parameters, so a saved model (see
+ *                 utils/Centroid_Model.h) is used with the exact metric it was fitted with. setParameters() returns
+ *                 false if the number of parameters is not the one of the metric.
+ *   - distance() The distance between two images. Smaller means closer. The distances are only used for comparisons,
+ *                so monotonic transformations (e.g. the square root of the euclidean distance) are skipped.
+ *                A second overload takes a float centroid (a row of a Centroid_Matrix) and its squared norm instead of
+ *                the first image, so the centroids are compared at full precision.
+ *   - linearize() Writes the centroid as the weights and the bias of a Linear_Scorer row (see utils/Linear_Scorer.h),
+ *                 so that bias - image . weights ranks the centroids the same way as distance(). Returns false if the
+ *                 metric can not be written in this form.
+ *   - hasTriangleInequality() Whether toMetric(distance()) satisfies the triangle inequality, so it can be used to
+ *                 bound distances without calculating them (e.g. the accelerated k-means of NCC_clusters)
+ *   - toMetric()  Turns a distance() into the true metric distance (the square root of the squared distances)
+ *
+ * The distances, hasTriangleInequality() and toMetric() are defined inline at the end of this header, so the
+ * templated classifiers inline the kernels into their loops and the traits are compile time constants. The rest of
+ * the metrics (fitting, parameters, linearize()) runs once per model and is in Distance_Metrics.cpp.
+ */
+
+
+/**
+ * Squared euclidean distance
+ */
+class L2_Metric {
+public:
+    static const char *getName();
+
+    void fit(const std::vector<MNIST_Image *>& training_images);
+    std::vector<float> getParameters() const;
+    bool setParameters(const float *parameters, int n_parameters);
+    double distance(const MNIST_Image &a, const MNIST_Image &b) const;
+    double distance(const float *centroid, float centroid_squared_norm, const MNIST_Image &image) const;
+    bool linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const;
+    double distance(const float *a, const float *b) const;
+
+    static constexpr bool hasTriangleInequality();
+    static double toMetric(double distance);
+};
+
+
+/**
+ * Manhattan (L1) distance
+ */
+class L1_Metric {
+public:
+    static const char *getName();
+
+    void fit(const std::vector<MNIST_Image *>& training_images);
+    std::vector<float> getParameters() const;
+    bool setParameters(const float *parameters, int n_parameters);
+    double distance(const MNIST_Image &a, const MNIST_Image &b) const;
+    double distance(const float *centroid, float centroid_squared_norm, const MNIST_Image &image) const;
+    bool linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const;
+    double distance(const float *a, const float *b) const;
+
+    static constexpr bool hasTriangleInequality();
+    static double toMetric(double distance);
+};
+
+
+/**
+ * Cosine distance (1 - cosine similarity). The norms of the images are maintained by the images themselves, so only
+ * the dot product is calculated for every pair.
+ */
+class Cosine_Metric {
+public:
+    static const char *getName();
+
+    void fit(const std::vector<MNIST_Image *>& training_images);
+    std::vector<float> getParameters() const;
+    bool setParameters(const float *parameters, int n_parameters);
+    double distance(const MNIST_Image &a, const MNIST_Image &b) const;
+    double distance(const float *centroid, float centroid_squared_norm, const MNIST_Image &image) const;
+    bool linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const;
+    double distance(const float *a, const float *b) const;
+
+    static constexpr bool hasTriangleInequality();
+    static double toMetric(double distance);
+};
+
+
+/**
+ * Diagonal Mahalanobis distance. Every pixel difference is weighted by the inverse of the variance of the pixel in the
+ * training set. The variances are regularized with their mean so that the (almost) constant border pixels do not
+ * dominate the distance.
+ */
+class Mahalanobis_Metric {
+public:
+    static const char *getName();
+
+    void fit(const std::vector<MNIST_Image *>& training_images);
+    std::vector<float> getParameters() const;
+    bool setParameters(const float *parameters, int n_parameters);
+    double distance(const MNIST_Image &a, const MNIST_Image &b) const;
+    double distance(const float *centroid, float centroid_squared_norm, const MNIST_Image &image) const;
+    bool linearize(const float *centroid, float centroid_squared_norm, float *weights, float &bias) const;
+    double distance(const float *a, const float *b) const;
+
+    static constexpr bool hasTriangleInequality();
+    static double toMetric(double distance);
+
+private:
+    std::array<float, MNIST_IMAGE_SIZE> weights {};  /// The weight of every pixel
+};
+
+
+// ------------- Kernels ------------- //
+#ifdef __AVX2__
+/**
+ * Horizontal sum of the 8 32-bit integers of a register
+ *
+ * @param v  The register
+ * @return   The sum of the lanes
+ */
+static inline int64_t horizontalSum(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+    return _mm_cvtsi128_si32(sum);
+}
+
+/**
+ * Horizontal sum of the 8 floats of a register
+ *
+ * @param v  The register
+ * @return   The sum of the lanes
+ */
+static inline double horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+
+    return _mm_cvtss_f32(sum);
+}
+
+/**
+ * Load 8 pixels and convert them to floats
+ *
+ * @param pixels  The pixels
+ * @return        The pixels as floats
+ */
+static inline __m256 loadPixels(const uint8_t *pixels) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) pixels)));
+}
+
+/**
+ * Multiply and add: a * b + c
+ *
+ * @return  The result of every lane
+ */
+static inline __m256 multiplyAdd(__m256 a, __m256 b, __m256 c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+
+// ------------- L2 ------------- //
+/**
+ * Calculate the squared euclidean distance. The square root is a strictly increasing function, so since we only want
+ * to compare the distances, we can safely ignore it.
+ *
+ * @param a  The first image
+ * @param b  The second image
+ * @return   The squared euclidean distance between the images
+ */
+inline double L2_Metric::distance(const MNIST_Image &a, const MNIST_Image &b) const {
+    const uint8_t *pa = a.getPixelData();
+    const uint8_t *pb = b.getPixelData();
+
+#ifdef __AVX2__
+    // 16 pixels per iteration: widen to 16 bits, subtract and multiply-add the squares in pairs to 32 bits
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pa + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pb + i)));
+        __m256i diff = _mm256_sub_epi16(va, vb);
+
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+    }
+
+    return double(horizontalSum(sum));
+#else
+    int64_t sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        int diff = pa[i] - pb[i];
+        sum += diff * diff;
+    }
+
+    return double(sum);
+#endif
+}
+
+/**
+ * Calculate the squared euclidean distance between a float centroid and an image
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid (unused)
+ * @param image                  The image
+ * @return                       The squared euclidean distance between the centroid and the image
+ */
+inline double L2_Metric::distance(const float *centroid, float, const MNIST_Image &image) const {
+    const uint8_t *pixels = image.getPixelData();
+
+#ifdef __AVX2__
+    // 8 pixels per iteration, two independent sums to hide the latency of the multiply-add
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i), loadPixels(pixels + i));
+        __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i + 8), loadPixels(pixels + i + 8));
+
+        sum0 = multiplyAdd(diff0, diff0, sum0);
+        sum1 = multiplyAdd(diff1, diff1, sum1);
+    }
+
+    return horizontalSum(_mm256_add_ps(sum0, sum1));
+#else
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        double diff = double(centroid[i]) - double(pixels[i]);
+        sum += diff * diff;
+    }
+
+    return sum;
+#endif
+}
+
+/**
+ * Calculate the squared euclidean distance between two float centroids
+ *
+ * @param a  The MNIST_IMAGE_SIZE pixels of the first centroid
+ * @param b  The MNIST_IMAGE_SIZE pixels of the second centroid
+ * @return   The squared euclidean distance between the centroids
+ */
+inline double L2_Metric::distance(const float *a, const float *b) const {
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        float diff = a[i] - b[i];
+        sum += diff * diff;
+    }
+
+    return sum;
+}
+
+/**
+ * The euclidean distance is a metric
+ */
+constexpr bool L2_Metric::hasTriangleInequality() {
+    return true;
+}
+
+/**
+ * @param distance  The squared euclidean distance
+ * @return          The euclidean distance
+ */
+inline double L2_Metric::toMetric(double distance) {
+    return std::sqrt(distance);
+}
+
+
+// ------------- L1 ------------- //
+/**
+ * Calculate the manhattan distance
+ *
+ * @param a  The first image
+ * @param b  The second image
+ * @return   The sum of the absolute pixel differences of the images
+ */
+inline double L1_Metric::distance(const MNIST_Image &a, const MNIST_Image &b) const {
+    const uint8_t *pa = a.getPixelData();
+    const uint8_t *pb = b.getPixelData();
+
+#ifdef __AVX2__
+    // The sum of absolute differences instruction does the whole job for 32 pixels at a time
+    __m256i sum = _mm256_setzero_si256();
+
+    int i = 0;
+    for (; i + 32 <= MNIST_IMAGE_SIZE; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (pa + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (pb + i));
+
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+    }
+
+    // The remaining 16 pixels
+    __m128i tail = _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (pa + i)), _mm_loadu_si128((const __m128i *) (pb + i)));
+    sum = _mm256_add_epi64(sum, _mm256_zextsi128_si256(tail));
+
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi64(half, _mm_unpackhi_epi64(half, half));
+
+    return double(_mm_cvtsi128_si64(half));
+#else
+    int64_t sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        sum += std::abs(pa[i] - pb[i]);
+    }
+
+    return double(sum);
+#endif
+}
+
+/**
+ * Calculate the manhattan distance between a float centroid and an image
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid (unused)
+ * @param image                  The image
+ * @return                       The sum of the absolute differences between the centroid and the image
+ */
+inline double L1_Metric::distance(const float *centroid, float, const MNIST_Image &image) const {
+    const uint8_t *pixels = image.getPixelData();
+
+#ifdef __AVX2__
+    // The absolute value clears the sign bit
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i), loadPixels(pixels + i));
+        __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i + 8), loadPixels(pixels + i + 8));
+
+        sum0 = _mm256_add_ps(sum0, _mm256_andnot_ps(sign, diff0));
+        sum1 = _mm256_add_ps(sum1, _mm256_andnot_ps(sign, diff1));
+    }
+
+    return horizontalSum(_mm256_add_ps(sum0, sum1));
+#else
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        sum += std::abs(double(centroid[i]) - double(pixels[i]));
+    }
+
+    return sum;
+#endif
+}
+
+/**
+ * Calculate the manhattan distance between two float centroids
+ *
+ * @param a  The MNIST_IMAGE_SIZE pixels of the first centroid
+ * @param b  The MNIST_IMAGE_SIZE pixels of the second centroid
+ * @return   The sum of the absolute differences of the centroids
+ */
+inline double L1_Metric::distance(const float *a, const float *b) const {
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        sum += std::abs(a[i] - b[i]);
+    }
+
+    return sum;
+}
+
+/**
+ * The manhattan distance is a metric
+ */
+constexpr bool L1_Metric::hasTriangleInequality() {
+    return true;
+}
+
+/**
+ * @param distance  The manhattan distance
+ * @return          The manhattan distance
+ */
+inline double L1_Metric::toMetric(double distance) {
+    return distance;
+}
+
+
+// ------------- Cosine ------------- //
+/**
+ * Calculate the cosine distance. An empty (all black) image is at distance 1 from every other image.
+ *
+ * @param a  The first image
+ * @param b  The second image
+ * @return   1 minus the cosine of the angle between the images
+ */
+inline double Cosine_Metric::distance(const MNIST_Image &a, const MNIST_Image &b) const {
+    const uint8_t *pa = a.getPixelData();
+    const uint8_t *pb = b.getPixelData();
+
+    double norms = double(a.getSquaredNorm()) * double(b.getSquaredNorm());
+
+    if (norms == 0) {
+        return 1;
+    }
+
+#ifdef __AVX2__
+    // 16 pixels per iteration: widen to 16 bits and multiply-add the products in pairs to 32 bits
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pa + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pb + i)));
+
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(va, vb));
+    }
+
+    double dot = double(horizontalSum(sum));
+#else
+    int64_t sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        sum += pa[i] * pb[i];
+    }
+
+    double dot = double(sum);
+#endif
+
+    return 1 - dot / std::sqrt(norms);
+}
+
+/**
+ * Calculate the cosine distance between a float centroid and an image
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid
+ * @param image                  The image
+ * @return                       1 minus the cosine of the angle between the centroid and the image
+ */
+inline double Cosine_Metric::distance(const float *centroid, float centroid_squared_norm, const MNIST_Image &image) const {
+    const uint8_t *pixels = image.getPixelData();
+
+    double norms = double(centroid_squared_norm) * double(image.getSquaredNorm());
+
+    if (norms == 0) {
+        return 1;
+    }
+
+#ifdef __AVX2__
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        sum0 = multiplyAdd(_mm256_loadu_ps(centroid + i), loadPixels(pixels + i), sum0);
+        sum1 = multiplyAdd(_mm256_loadu_ps(centroid + i + 8), loadPixels(pixels + i + 8), sum1);
+    }
+
+    double dot = horizontalSum(_mm256_add_ps(sum0, sum1));
+#else
+    double dot = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        dot += double(centroid[i]) * pixels[i];
+    }
+#endif
+
+    return 1 - dot / std::sqrt(norms);
+}
+
+/**
+ * Calculate the cosine distance between two float centroids
+ *
+ * @param a  The MNIST_IMAGE_SIZE pixels of the first centroid
+ * @param b  The MNIST_IMAGE_SIZE pixels of the second centroid
+ * @return   1 minus the cosine of the angle between the centroids
+ */
+inline double Cosine_Metric::distance(const float *a, const float *b) const {
+    double dot = 0;
+    double norm_a = 0;
+    double norm_b = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        dot += double(a[i]) * b[i];
+        norm_a += double(a[i]) * a[i];
+        norm_b += double(b[i]) * b[i];
+    }
+
+    double norms = norm_a * norm_b;
+
+    return norms == 0 ? 1 : 1 - dot / std::sqrt(norms);
+}
+
+/**
+ * The cosine distance does not satisfy the triangle inequality
+ */
+constexpr bool Cosine_Metric::hasTriangleInequality() {
+    return false;
+}
+
+/**
+ * @param distance  The cosine distance
+ * @return          The cosine distance
+ */
+inline double Cosine_Metric::toMetric(double distance) {
+    return distance;
+}
+
+
+// ------------- Mahalanobis ------------- //
+/**
+ * Calculate the weighted squared euclidean distance
+ *
+ * @param a  The first image
+ * @param b  The second image
+ * @return   The sum of the weighted squared pixel differences of the images
+ */
+inline double Mahalanobis_Metric::distance(const MNIST_Image &a, const MNIST_Image &b) const {
+    const uint8_t *pa = a.getPixelData();
+    const uint8_t *pb = b.getPixelData();
+
+#ifdef __AVX2__
+    // 8 pixels per iteration: widen to 32 bits, convert the difference to float and accumulate the weighted squares
+    __m256 sum = _mm256_setzero_ps();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 8) {
+        __m256i va = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (pa + i)));
+        __m256i vb = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (pb + i)));
+        __m256 diff = _mm256_cvtepi32_ps(_mm256_sub_epi32(va, vb));
+        __m256 weighted = _mm256_mul_ps(_mm256_loadu_ps(weights.data() + i), diff);
+
+#ifdef __FMA__
+        sum = _mm256_fmadd_ps(weighted, diff, sum);
+#else
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(weighted, diff));
+#endif
+    }
+
+    return horizontalSum(sum);
+#else
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        double diff = double(pa[i]) - double(pb[i]);
+        sum += weights[i] * diff * diff;
+    }
+
+    return sum;
+#endif
+}
+
+/**
+ * Calculate the weighted squared euclidean distance between a float centroid and an image
+ *
+ * @param centroid               The MNIST_IMAGE_SIZE pixels of the centroid
+ * @param centroid_squared_norm  The squared norm of the centroid (unused)
+ * @param image                  The image
+ * @return                       The sum of the weighted squared differences between the centroid and the image
+ */
+inline double Mahalanobis_Metric::distance(const float *centroid, float, const MNIST_Image &image) const {
+    const uint8_t *pixels = image.getPixelData();
+
+#ifdef __AVX2__
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i += 16) {
+        __m256 diff0 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i), loadPixels(pixels + i));
+        __m256 diff1 = _mm256_sub_ps(_mm256_loadu_ps(centroid + i + 8), loadPixels(pixels + i + 8));
+
+        sum0 = multiplyAdd(_mm256_mul_ps(_mm256_loadu_ps(weights.data() + i), diff0), diff0, sum0);
+        sum1 = multiplyAdd(_mm256_mul_ps(_mm256_loadu_ps(weights.data() + i + 8), diff1), diff1, sum1);
+    }
+
+    return horizontalSum(_mm256_add_ps(sum0, sum1));
+#else
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        double diff = double(centroid[i]) - double(pixels[i]);
+        sum += weights[i] * diff * diff;
+    }
+
+    return sum;
+#endif
+}
+
+/**
+ * Calculate the weighted squared euclidean distance between two float centroids
+ *
+ * @param a  The MNIST_IMAGE_SIZE pixels of the first centroid
+ * @param b  The MNIST_IMAGE_SIZE pixels of the second centroid
+ * @return   The sum of the weighted squared differences of the centroids
+ */
+inline double Mahalanobis_Metric::distance(const float *a, const float *b) const {
+    double sum = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        float diff = a[i] - b[i];
+        sum += weights[i] * diff * diff;
+    }
+
+    return sum;
+}
+
+/**
+ * The weighted euclidean distance is a metric
+ */
+constexpr bool Mahalanobis_Metric::hasTriangleInequality() {
+    return true;
+}
+
+/**
+ * @param distance  The weighted squared euclidean distance
+ * @return          The weighted euclidean distance
+ */
+inline double Mahalanobis_Metric::toMetric(double distance) {
+    return std::sqrt(distance);
+}
+
+
+#endif
@@ -1,5 +1,4 @@
 #include "MNIST_Image.h"
-#include <cmath>
 #include <fstream>
 
 // ------------- Constructors ------------- //
@@ -16,7 +15,9 @@ MNIST_Image::MNIST_Image(uint8_t label) : label(label) {}
  * @param label   The label of the image
  * @param pixels  The pixels of the image flattened into a 1D array
  */
-MNIST_Image::MNIST_Image(uint8_t label, const std::array<uint8_t, MNIST_IMAGE_SIZE> pixels) : label(label), pixels(pixels) {}
+MNIST_Image::MNIST_Image(uint8_t label, const std::array<uint8_t, MNIST_IMAGE_SIZE> pixels) : label(label) {
+    setPixels(pixels);
+}
 
 /**
  * Copy constructor
@@ -26,7 +27,23 @@ MNIST_Image::MNIST_Image(uint8_t label, const std::array<uint8_t, MNIST_IMAGE_SI
 MNIST_Image::MNIST_Image(const MNIST_Image &other) {
     MNIST_Image::label = other.label;
     MNIST_Image::distance = other.distance;
+    MNIST_Image::squared_norm = other.squared_norm;
+    MNIST_Image::pixels = other.pixels;
+}
+
+/**
+ * Copy assignment
+ *
+ * @param other  The image to copy
+ * @return       This image
+ */
+MNIST_Image &MNIST_Image::operator=(const MNIST_Image &other) {
+    MNIST_Image::label = other.label;
+    MNIST_Image::distance = other.distance;
+    MNIST_Image::squared_norm = other.squared_norm;
     MNIST_Image::pixels = other.pixels;
+
+    return *this;
 }
 
 
@@ -68,6 +85,24 @@ std::array<uint8_t, MNIST_IMAGE_SIZE> MNIST_Image::getPixels() const {
     return MNIST_Image::pixels;
 }
 
+/**
+ * Get a pointer to the pixels of the image. Used by the distance kernels to avoid copying the pixels
+ *
+ * @return Pointer to the first pixel of the image
+ */
+const uint8_t *MNIST_Image::getPixelData() const {
+    return MNIST_Image::pixels.data();
+}
+
+/**
+ * Get the squared euclidean norm of the image. The norm is kept up to date by the pixel setters
+ *
+ * @return The sum of the squared pixels of the image
+ */
+uint32_t MNIST_Image::getSquaredNorm() const {
+    return MNIST_Image::squared_norm;
+}
+
 
 // ------------- Setters ------------- //
 /**
@@ -89,22 +124,30 @@ void MNIST_Image::setDistance(double d) {
 }
 
 /**
- * Set a pixel of the image. This will also update the normalized pixel at the same index
+ * Set a pixel of the image. This will also update the squared norm of the image
  *
  * @param pixel   The pixel to set
  * @param index   The index of the pixel to set
  */
 void MNIST_Image::setPixel(uint8_t pixel, uint32_t index) {
+    MNIST_Image::squared_norm -= uint32_t(MNIST_Image::pixels[index]) * MNIST_Image::pixels[index];
+    MNIST_Image::squared_norm += uint32_t(pixel) * pixel;
+
     MNIST_Image::pixels[index] = pixel;
 }
 
 /**
- * Set the pixels of the image. This will also update the normalized pixels
+ * Set the pixels of the image. This will also update the squared norm of the image
  *
  * @param pixels   The pixels of the image
  */
 void MNIST_Image::setPixels(std::array<uint8_t, MNIST_IMAGE_SIZE> p) {
     MNIST_Image::pixels = p;
+
+    MNIST_Image::squared_norm = 0;
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        MNIST_Image::squared_norm += uint32_t(p[i]) * p[i];
+    }
 }
 
 
@@ -159,23 +202,3 @@ void MNIST_Image::saveImage(const std::string &name) const{
 bool MNIST_Image::isLabel(uint8_t l) const {
     return MNIST_Image::label == l;
 }
-
-/**
- * Calculate the distance between this image and another image. The distance is calculated using the Euclidean distance.
- * For performance reasons, the final square root is not calculated. The square root is a strictly increasing function.
- * If d1 > d2, then sqrt(d1) > sqrt(d2),so since we only want to compare the distances, we can safely ignore the square
- * root.
- *
- * @param image   The image to calculate the distance to
- * @return        The distance between this image and the other image
- */
-double MNIST_Image::calculateDistance(const MNIST_Image &test_image){
-    MNIST_Image::distance = 0;
-
-    // Sum the squared differences between the pixels
-    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
-        MNIST_Image::distance += std::pow(MNIST_Image::pixels[i] - test_image.pixels[i], 2);
-    }
-
-    return MNIST_Image::distance;
-}
@@ -16,6 +16,7 @@ public:
 
     // Copy constructors
     MNIST_Image(const MNIST_Image &other);
+    MNIST_Image &operator=(const MNIST_Image &other);
 
     // Destructor
     ~MNIST_Image() = default;
@@ -25,6 +26,8 @@ public:
     double getDistance() const;
     uint8_t getPixel(int index) const;
     std::array<uint8_t, MNIST_IMAGE_SIZE> getPixels() const;
+    const uint8_t *getPixelData() const;
+    uint32_t getSquaredNorm() const;
 
     // Setters
     void setLabel(uint8_t label);
@@ -35,13 +38,27 @@ public:
     // Functions
     void saveImage(const ::std::string &name) const;
     bool isLabel(uint8_t l) const;
-    double calculateDistance(const MNIST_Image &test_image);
+
+    /**
+     * Calculate the distance between this image and another image using the given metric and store it in the image.
+     *
+     * @tparam Metric   The distance metric (see metrics/Distance_Metrics.h)
+     * @param image     The image to calculate the distance to
+     * @param metric    The metric object
+     * @return          The distance between this image and the other image
+     */
+    template <class Metric>
+    double calculateDistance(const MNIST_Image &image, const Metric &metric) {
+        distance = metric.distance(*this, image);
+        return distance;
+    }
 
 
 private:
     // Variables
     uint8_t label {0};                                   /// The label of the image
     double distance {0};                                 /// The distance between this image and another image
+    uint32_t squared_norm {0};                           /// The sum of the squared pixels of the image
 
     std::array<uint8_t, MNIST_IMAGE_SIZE> pixels{};      /// The pixels of the image flattened into a 1D array
 };
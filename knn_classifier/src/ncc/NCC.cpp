@@ -1,8 +1,22 @@
 #include <algorithm>
+#include <limits>
+#include <pthread.h>
+#include <random>
+#include <unistd.h>
 #include "NCC.h"
+#include "Thread_Pool.h"
 #include "../../include/progressbar.h"
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #define MEAN_THREADS 16
+#define MEAN_PROGRESS_BATCH 256  // The number of images a mean thread processes between progress updates
+#define MEAN_ACCUMULATOR_SIZE (10 * MNIST_IMAGE_SIZE + 16)  // The sums and the (padded) counts of every class
+#define PROGRESS_POLL_US 10000  // The interval the progress of the mean threads is polled with
+#define NCC_BATCH_SIZE 600  // The number of images scored together by classifyBatch
+#define PROTOTYPE_ITERATIONS 30  // The maximum number of k-means iterations for the prototypes of a class
 
 // -------------- Constructors -------------- //
 
@@ -12,11 +26,8 @@
  * @param training_images   The training images
  * @param test_images       The test images
  */
-NCC::NCC(const std::vector<MNIST_Image *> &training_images, const std::vector<MNIST_Image *> &test_images) {
-    this->n_tests = 0;
-    this->n_correct = 0;
-    this->n_incorrect = 0;
-
+template <class Metric>
+NCC<Metric>::NCC(const std::vector<MNIST_Image *> &training_images, const std::vector<MNIST_Image *> &test_images) {
     this->training_images.reserve(training_images.size());
     this->test_images.reserve(test_images.size());
 
@@ -34,13 +45,17 @@ NCC::NCC(const std::vector<MNIST_Image *> &training_images, const std::vector<MN
         this->test_images.push_back(image);
     }
 
-    // initialize the class means
-    for (int i = 0; i < 10; i++) {
-        auto *image = new MNIST_Image(i);
-        class_means[i] = image;
-    }
-
     this->class_counts.fill(0);
+    this->prototype_sums.assign(10 * MNIST_IMAGE_SIZE, 0);
+    this->prototype_weights.assign(10, 0);
+
+    pthread_mutex_init(&update_mutex, nullptr);
+
+    // Learn the parameters of the metric (if any)
+    this->metric.fit(this->training_images);
+
+    // Publish the empty means so the classifier can be used before any image is added
+    publishCentroids();
 }
 
 /**
@@ -48,15 +63,12 @@ NCC::NCC(const std::vector<MNIST_Image *> &training_images, const std::vector<MN
  *
  * @param training_images   The training images
  * @param test_images       The test images
- * @param means             The means of each class
+ * @param means             The means of each class, one row per class
  * @param counts            The number of images in each class
  */
-NCC::NCC(const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images,
-         const std::array<MNIST_Image *, 10>& means, std::array<int, 10> counts) {
-    this->n_tests = 0;
-    this->n_correct = 0;
-    this->n_incorrect = 0;
-
+template <class Metric>
+NCC<Metric>::NCC(const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images,
+         const Centroid_Matrix& means, std::array<int, 10> counts) {
     this->training_images.reserve(training_images.size());
     this->test_images.reserve(test_images.size());
 
@@ -74,20 +86,34 @@ NCC::NCC(const std::vector<MNIST_Image *>& training_images, const std::vector<MN
         this->test_images.push_back(image);
     }
 
-    // Deep copy the means
+    this->class_counts = counts;
+    this->prototype_sums.assign(10 * MNIST_IMAGE_SIZE, 0);
+    this->prototype_weights.assign(10, 0);
+
+    // The running sums that give the means back
     for (int i = 0; i < 10; i++) {
-        auto *image = new MNIST_Image(*means[i]);
+        const float *mean = means.getRow(i);
+
+        for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+            prototype_sums[i * MNIST_IMAGE_SIZE + pixel] = double(mean[pixel]) * counts[i];
+        }
 
-        class_means[i] = image;
+        prototype_weights[i] = counts[i];
     }
 
-    this->class_counts = counts;
+    pthread_mutex_init(&update_mutex, nullptr);
+
+    // Learn the parameters of the metric (if any)
+    this->metric.fit(this->training_images);
+
+    publishCentroids();
 }
 
 /**
  * Class destructor
  */
-NCC::~NCC() {
+template <class Metric>
+NCC<Metric>::~NCC() {
     // Free the memory
     for (auto & training_image : training_images) {
         delete training_image;
@@ -97,38 +123,80 @@ NCC::~NCC() {
         delete test_image;
     }
 
-    for (auto & mean : class_means) {
-        delete mean;
-    }
+    pthread_mutex_destroy(&update_mutex);
 }
 
 
 // -------------- Getters -------------- //
 /**
- * Get the mean array of all the classes
- * @return  The mean array
+ * Get the current means of all the classes
+ * @return  A copy of the centroid matrix of the means, row i is the mean of class i
  */
-std::array<MNIST_Image *, 10> NCC::getClassMeans() const {
-    return class_means;
+template <class Metric>
+Centroid_Matrix NCC<Metric>::getClassMeans() const {
+    Rcu_Pointer<NCC_Centroids>::Reader current(centroids);
+
+    return current->means;
+}
+
+/**
+ * Get the number of prototypes of every class
+ * @return  The number of prototypes of every class
+ */
+template <class Metric>
+int NCC<Metric>::getPrototypeCount() const {
+    pthread_mutex_lock(&update_mutex);
+    int n = n_prototypes;
+    pthread_mutex_unlock(&update_mutex);
+
+    return n;
+}
+
+/**
+ * Get the number of images of every class, including the images added after the means were calculated
+ * @return  The number of images in each class
+ */
+template <class Metric>
+std::array<int, 10> NCC<Metric>::getClassCounts() const {
+    pthread_mutex_lock(&update_mutex);
+    std::array<int, 10> counts = class_counts;
+    pthread_mutex_unlock(&update_mutex);
+
+    return counts;
 }
 
 
 // -------------- Setters -------------- //
 
 /**
- * Increment the number of correct classifications
+ * Records the classifications to a stats object shared with other classifiers instead of the own stats
+ *
+ * @param shared_stats  The shared stats
+ * @param slot          The slot of the shared stats written by this classifier. No other thread may write to it
  */
-void NCC::incrementCorrect() {
-    NCC::n_correct++;
-    NCC::n_tests++;
+template <class Metric>
+void NCC<Metric>::shareStats(Classifier_Stats *shared_stats, int slot) {
+    NCC::stats = shared_stats;
+    NCC::stats_slot = slot;
 }
 
 /**
- * Increment the number of incorrect classifications
+ * Sets the exponential decay of the online updates. When an image of a class is added the sum and the number of
+ * images of the class are multiplied by the decay first, so the mean forgets the old images of the class with a
+ * half life of log(0.5) / log(decay) images. A decay of 1 keeps the plain mean of all the images
+ *
+ * @param decay  The decay in (0, 1]
  */
-void NCC::incrementIncorrect() {
-    NCC::n_incorrect++;
-    NCC::n_tests++;
+template <class Metric>
+void NCC<Metric>::setDecay(double decay) {
+    if (decay <= 0 || decay > 1) {
+        std::cerr << "The decay must be in (0, 1]" << std::endl;
+        return;
+    }
+
+    pthread_mutex_lock(&update_mutex);
+    NCC::decay = decay;
+    pthread_mutex_unlock(&update_mutex);
 }
 
 // -------------- Methods -------------- //
@@ -136,104 +204,136 @@ void NCC::incrementIncorrect() {
 /**
  * Structure for passing arguments to the mean thread
  */
-typedef struct {
+template <class Metric>
+struct Thread_args {
+    int thread_id;  // The id of the thread
     int start;  // The index of the first image to process
     int end;  // The index of the last image to process
-    pthread_mutex_t *progress_mutex;  // The mutex to lock
-    progressbar *bar;  // The progress bar
+    Classifier_Stats *progress;  // The progress of the threads, one slot per thread
+    pthread_barrier_t *barrier;  // Synchronizes the levels of the merge
 
-    std::vector<std::vector<int>> *means;   // The means
-    std::vector<int> *counts;  // The counts
+    uint32_t *accumulators;  // The accumulators of all the threads, MEAN_ACCUMULATOR_SIZE values per thread
 
-    NCC *ncm;  // The NCC object
-} Thread_args;
+    NCC<Metric> *ncm;  // The NCC object
+};
 
 
 /**
- * Thread function for calculating the means
+ * Adds the pixels of an image to a row of sums
  *
- * @param args  The arguments
- * @return      nullptr
+ * @param pixels  The MNIST_IMAGE_SIZE pixels of the image
+ * @param sums    The MNIST_IMAGE_SIZE sums
  */
-void *calculateMeansThread(void *args) {
-    auto *thread_args = (Thread_args *) args;
-
-    // Calculate the means from start to end
-    for (int i = thread_args->start; i < thread_args->end; i++) {
+static inline void accumulatePixels(const uint8_t *pixels, uint32_t *sums) {
+#ifdef __AVX2__
+    // Widen 16 pixels to two vectors of 8 u32 and add them to the sums. MNIST_IMAGE_SIZE is a multiple of 16
+    for (int j = 0; j < MNIST_IMAGE_SIZE; j += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (pixels + j));
+
+        __m256i low = _mm256_cvtepu8_epi32(bytes);
+        __m256i high = _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8));
+
+        __m256i *sum = (__m256i *) (sums + j);
+        _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum), low));
+        _mm256_storeu_si256(sum + 1, _mm256_add_epi32(_mm256_loadu_si256(sum + 1), high));
+    }
+#else
+    for (int j = 0; j < MNIST_IMAGE_SIZE; j++) {
+        sums[j] += pixels[j];
+    }
+#endif
+}
 
-        // lock the mutex and update the progress bar
-        pthread_mutex_lock(thread_args->progress_mutex);
-        thread_args->bar->update();
-        pthread_mutex_unlock(thread_args->progress_mutex);
+/**
+ * Adds an accumulator to another one
+ *
+ * @param source       The accumulator to add
+ * @param destination  The accumulator added to
+ */
+static inline void mergeAccumulators(const uint32_t *source, uint32_t *destination) {
+    int j = 0;
 
-        int label = thread_args->ncm->training_images[i]->getLabel();  // The label of the image
-        thread_args->counts->at(label)++;  // update the count
+#ifdef __AVX2__
+    for (; j + 8 <= MEAN_ACCUMULATOR_SIZE; j += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (source + j));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (destination + j));
 
-        // Add the image to the mean
-        for (int j = 0; j < MNIST_IMAGE_SIZE; j++) {
-            thread_args->means->at(label)[j] += thread_args->ncm->training_images[i]->getPixel(j);
-        }
+        _mm256_storeu_si256((__m256i *) (destination + j), _mm256_add_epi32(a, b));
     }
+#endif
 
-    return nullptr;
+    for (; j < MEAN_ACCUMULATOR_SIZE; j++) {
+        destination[j] += source[j];
+    }
 }
 
+
 /**
- * Calculate the means of each class
+ * Thread function for calculating the means. Every thread sums up the images in [start, end) to its own accumulator.
+ * The accumulators are then merged in a tree: at every level thread t adds the accumulator of thread t + stride to its
+ * own, so the sums end up in the accumulator of thread 0 after log2(MEAN_THREADS) levels.
+ *
+ * @param args  The arguments
+ * @return      nullptr
  */
-void NCC::calculateMeans() {
+template <class Metric>
+void *calculateMeansThread(void *args) {
+    auto *thread_args = (Thread_args<Metric> *) args;
+    const std::vector<MNIST_Image *> &images = thread_args->ncm->training_images;
 
-    std::vector<std::vector<int>> thread_counts;  // The counts of each class for each thread
-    thread_counts.reserve(MEAN_THREADS);  // Reserve space for the threads
+    uint32_t *accumulator = thread_args->accumulators + size_t(thread_args->thread_id) * MEAN_ACCUMULATOR_SIZE;
+    uint32_t *counts = accumulator + 10 * MNIST_IMAGE_SIZE;
 
-    // Initialize the counts to 0
-    for (int i = 0; i < MEAN_THREADS; i++) {
-        std::vector<int> thread_count;
-        thread_count.reserve(10);
+    // 1. Sum up the images of every class
+    for (int i = thread_args->start; i < thread_args->end; i++) {
+        int label = images[i]->getLabel();  // The label of the image
 
-        for (int j = 0; j < 10; j++) {
-            thread_count.push_back(0);
-        }
+        counts[label]++;
+        accumulatePixels(images[i]->getPixelData(), accumulator + label * MNIST_IMAGE_SIZE);
 
-        thread_counts.push_back(thread_count);
+        // Publish the progress in batches. The calling thread updates the progress bar
+        if ((i - thread_args->start + 1) % MEAN_PROGRESS_BATCH == 0) {
+            thread_args->progress->setProgress(thread_args->thread_id, i - thread_args->start + 1);
+        }
     }
 
-    /*
-     * Initialize the means to 0. Every thread has its own copy of the means. Each mean is a vector of size
-     * (10, MNIST_IMAGE_SIZE). The first dimension is the class and the second dimension is the pixel.
-     */
-    std::vector<std::vector<std::vector<int>>> thread_means;  // The mean vectors of each class for each thread
-    thread_means.reserve(MEAN_THREADS);  // Reserve space for the threads
-
-    // Initialize the means to 0
-    for (int i = 0; i < MEAN_THREADS; i++) {
-        std::vector<std::vector<int>> thread_mean;
-        thread_mean.reserve(10);
+    thread_args->progress->setProgress(thread_args->thread_id, thread_args->end - thread_args->start);
 
-        for (int j = 0; j < 10; j++) {
-            std::vector<int> mean;
-            mean.reserve(MNIST_IMAGE_SIZE);
+    // 2. Merge the accumulators
+    for (int stride = 1; stride < MEAN_THREADS; stride *= 2) {
+        pthread_barrier_wait(thread_args->barrier);
 
-            for (int k = 0; k < MNIST_IMAGE_SIZE; k++) {
-                mean.push_back(0);
-            }
-
-            thread_mean.push_back(mean);
+        if (thread_args->thread_id % (2 * stride) == 0 && thread_args->thread_id + stride < MEAN_THREADS) {
+            mergeAccumulators(accumulator + size_t(stride) * MEAN_ACCUMULATOR_SIZE, accumulator);
         }
-
-        thread_means.push_back(thread_mean);
     }
 
+    return nullptr;
+}
+
+/**
+ * Calculate the means of each class
+ */
+template <class Metric>
+void NCC<Metric>::calculateMeans() {
+    /*
+     * Every thread has its own contiguous accumulator: the sums of the pixels of every class (10 x MNIST_IMAGE_SIZE)
+     * followed by the number of images of every class. The accumulators are a multiple of the cache line size apart.
+     */
+    std::vector<uint32_t> accumulators(size_t(MEAN_THREADS) * MEAN_ACCUMULATOR_SIZE, 0);
+
     typedef void * (*thread_function_ptr)(void *);  // The type of the thread function
 
     pthread_attr_t pthread_custom_attr;  // The attributes of the threads
     pthread_attr_init(&pthread_custom_attr);  // Initialize the attributes
 
-    // create a mutex for the progress bar
-    auto *progress_mutex = new pthread_mutex_t;
-    pthread_mutex_init(progress_mutex, nullptr);
+    pthread_barrier_t barrier;  // The barrier between the levels of the merge
+    pthread_barrier_init(&barrier, nullptr, MEAN_THREADS);
+
+    // The progress of the threads, polled by this thread to update the progress bar
+    Classifier_Stats progress(MEAN_THREADS);
 
-    std::array<Thread_args, MEAN_THREADS> thread_args{};  // The arguments for each thread
+    std::array<Thread_args<Metric>, MEAN_THREADS> thread_args{};  // The arguments for each thread
     std::array<pthread_t, MEAN_THREADS> threads{};  // The threads
 
     int n_images = int(training_images.size());  // The number of images
@@ -243,17 +343,35 @@ void NCC::calculateMeans() {
 
     std::cout << "    Calculating means ";
 
-    // Create the threads
+    // Create the threads. The last thread also processes the remaining images
     for (int i = 0; i < MEAN_THREADS; i++) {
+        thread_args[i].thread_id = i;
         thread_args[i].start = i * n_images_per_thread;
-        thread_args[i].end = (i + 1) * n_images_per_thread;
-        thread_args[i].means = &thread_means[i];
-        thread_args[i].counts = &thread_counts[i];
-        thread_args[i].progress_mutex = progress_mutex;
-        thread_args[i].bar = bar;
+        thread_args[i].end = i == MEAN_THREADS - 1 ? n_images : (i + 1) * n_images_per_thread;
+        thread_args[i].accumulators = accumulators.data();
+        thread_args[i].progress = &progress;
+        thread_args[i].barrier = &barrier;
         thread_args[i].ncm = this;
 
-        pthread_create(&threads[i], &pthread_custom_attr, (thread_function_ptr) calculateMeansThread, &thread_args[i]);
+        pthread_create(&threads[i], &pthread_custom_attr, (thread_function_ptr) calculateMeansThread<Metric>, &thread_args[i]);
+    }
+
+    // Poll the progress of the threads until all the images are processed
+    int n_done = 0;
+
+    while (n_done < n_images) {
+        usleep(PROGRESS_POLL_US);
+
+        Stats_Snapshot snapshot = progress.getSnapshot();
+        int n_progress = 0;
+
+        for (auto & thread_progress : snapshot.progress) {
+            n_progress += int(thread_progress);
+        }
+
+        for (; n_done < n_progress; n_done++) {
+            bar->update();
+        }
     }
 
     // Wait for the threads to finish
@@ -263,36 +381,239 @@ void NCC::calculateMeans() {
 
     std::cout << std::endl;
 
-    // Combine the results to the first thread
-    for (int thread_id = 1; thread_id < MEAN_THREADS; thread_id++) {
-        for (int label = 0; label < 10; label++) {
-            thread_counts[0][label] += thread_counts[thread_id][label];
+    // The merged sums and counts are in the accumulator of the first thread
+    const uint32_t *sums = accumulators.data();
+    const uint32_t *counts = sums + 10 * MNIST_IMAGE_SIZE;
 
-            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
-                thread_means[0][label][pixel] += thread_means[thread_id][label][pixel];
-            }
-        }
-    }
+    // Replace the running sums and counts and publish the means
+    pthread_mutex_lock(&update_mutex);
 
-    // Calculate the means
-    for (int label = 0; label < 10; label++) {
-        for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
-            class_means[label]->setPixel(thread_means[0][label][pixel] / thread_counts[0][label], pixel);
-        }
-    }
+    n_prototypes = 1;
+    prototype_sums.assign(sums, sums + 10 * MNIST_IMAGE_SIZE);
+    prototype_weights.assign(counts, counts + 10);
 
-    // Set the counts
     for (int i = 0; i < 10; i++) {
-        class_counts[i] = thread_counts[0][i];
+        class_counts[i] = int(counts[i]);
     }
 
+    publishCentroids();
+
+    pthread_mutex_unlock(&update_mutex);
+
     // free the memory
     pthread_attr_destroy(&pthread_custom_attr);
-    pthread_mutex_destroy(progress_mutex);
+    pthread_barrier_destroy(&barrier);
+
+    delete bar;
+}
+
+
+/**
+ * Calculate n_prototypes prototypes for every class with k-means on the training images of the class. The classes are
+ * clustered independently, in parallel on a thread pool. Classes with fewer images than prototypes repeat their
+ * clusters. With a single prototype the result is the mean of every class
+ *
+ * @param n_prototypes  The number of prototypes of every class
+ */
+template <class Metric>
+void NCC<Metric>::calculatePrototypes(int n_prototypes) {
+    n_prototypes = std::max(n_prototypes, 1);
+
+    // Split the training images by class
+    std::array<std::vector<MNIST_Image *>, 10> class_images {};
+
+    for (auto & image : training_images) {
+        class_images[image->getLabel()].push_back(image);
+    }
+
+    // The sums and the number of images of the prototypes of every class
+    std::array<std::vector<double>, 10> sums {};
+    std::array<std::vector<double>, 10> weights {};
 
-    delete progress_mutex;
+    Thread_Pool pool(std::min(MEAN_THREADS, 10));
+
+    pool.parallelFor(10, [&](int label, int) {
+        sums[label].assign(size_t(n_prototypes) * MNIST_IMAGE_SIZE, 0);
+        weights[label].assign(n_prototypes, 0);
+
+        fitPrototypes(class_images[label], label, sums[label], weights[label]);
+    });
+
+    // Replace the running sums and counts and publish the prototypes
+    pthread_mutex_lock(&update_mutex);
+
+    NCC::n_prototypes = n_prototypes;
+    prototype_sums.clear();
+    prototype_weights.clear();
+
+    for (int label = 0; label < 10; label++) {
+        prototype_sums.insert(prototype_sums.end(), sums[label].begin(), sums[label].end());
+        prototype_weights.insert(prototype_weights.end(), weights[label].begin(), weights[label].end());
+        class_counts[label] = int(class_images[label].size());
+    }
+
+    publishCentroids();
+
+    pthread_mutex_unlock(&update_mutex);
 }
 
+/**
+ * Cluster the images of a class with k-means. The centers are seeded with k-means++ and refined with Lloyd iterations
+ * until no image changes cluster. An empty cluster is moved to the image farthest from its center
+ *
+ * @param images   The images of the class
+ * @param label    The label of the class, also the seed of the random generator
+ * @param sums     The n_prototypes x MNIST_IMAGE_SIZE sums of the pixels of the images of every prototype
+ * @param weights  The number of images of every prototype
+ */
+template <class Metric>
+void NCC<Metric>::fitPrototypes(const std::vector<MNIST_Image *> &images, int label, std::vector<double> &sums,
+                                std::vector<double> &weights) const {
+    int n_images = int(images.size());
+    int n_prototypes = int(weights.size());
+    int k = std::min(n_prototypes, n_images);  // The number of clusters
+
+    if (k == 0) {
+        return;
+    }
+
+    std::mt19937 generator(label);
+    Centroid_Matrix centers(k);
+
+    // Set a center to an image
+    auto setCenter = [&](int center, const MNIST_Image &image) {
+        float *row = centers.getRow(center);
+        const uint8_t *pixels = image.getPixelData();
+
+        std::copy(pixels, pixels + MNIST_IMAGE_SIZE, row);
+        centers.updateNorm(center);
+    };
+
+    auto distanceTo = [&](int center, const MNIST_Image &image) {
+        return metric.distance(centers.getRow(center), centers.getSquaredNorm(center), image);
+    };
+
+    // 1. k-means++: every next center is an image picked with probability proportional to its distance
+    std::vector<double> distances(n_images);
+
+    setCenter(0, *images[generator() % n_images]);
+
+    for (int i = 0; i < n_images; i++) {
+        distances[i] = distanceTo(0, *images[i]);
+    }
+
+    for (int c = 1; c < k; c++) {
+        double total = 0;
+
+        for (auto & distance : distances) {
+            total += distance;
+        }
+
+        int next = int(generator() % n_images);
+
+        if (total > 0) {
+            double target = std::uniform_real_distribution<double>(0, total)(generator);
+
+            for (next = 0; next < n_images - 1 && target >= distances[next]; next++) {
+                target -= distances[next];
+            }
+        }
+
+        setCenter(c, *images[next]);
+
+        for (int i = 0; i < n_images; i++) {
+            distances[i] = std::min(distances[i], distanceTo(c, *images[i]));
+        }
+    }
+
+    // 2. Lloyd iterations
+    std::vector<int> assignments(n_images, -1);
+    std::vector<double> cluster_sums(size_t(k) * MNIST_IMAGE_SIZE);
+    std::vector<double> counts(k);
+
+    for (int iteration = 0; iteration < PROTOTYPE_ITERATIONS; iteration++) {
+        int changed = 0;
+
+        // Assign every image to the nearest center
+        for (int i = 0; i < n_images; i++) {
+            int nearest = 0;
+            double min_distance = distanceTo(0, *images[i]);
+
+            for (int c = 1; c < k; c++) {
+                double distance = distanceTo(c, *images[i]);
+
+                if (distance < min_distance) {
+                    min_distance = distance;
+                    nearest = c;
+                }
+            }
+
+            changed += assignments[i] != nearest;
+            assignments[i] = nearest;
+            distances[i] = min_distance;
+        }
+
+        // Sum up the images of every cluster
+        std::fill(cluster_sums.begin(), cluster_sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (int i = 0; i < n_images; i++) {
+            const uint8_t *pixels = images[i]->getPixelData();
+            double *sum = cluster_sums.data() + size_t(assignments[i]) * MNIST_IMAGE_SIZE;
+
+            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                sum[pixel] += pixels[pixel];
+            }
+
+            counts[assignments[i]]++;
+        }
+
+        // Move the centers to the means of their clusters
+        for (int c = 0; c < k; c++) {
+            if (counts[c] == 0) {
+                // Move the empty cluster to the farthest image, it is assigned to it in the next iteration
+                int farthest = int(std::max_element(distances.begin(), distances.end()) - distances.begin());
+
+                setCenter(c, *images[farthest]);
+                distances[farthest] = 0;
+                changed++;
+                continue;
+            }
+
+            float *row = centers.getRow(c);
+            const double *sum = cluster_sums.data() + size_t(c) * MNIST_IMAGE_SIZE;
+
+            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                row[pixel] = float(sum[pixel] / counts[c]);
+            }
+
+            centers.updateNorm(c);
+        }
+
+        if (changed == 0) {
+            break;
+        }
+    }
+
+    // 3. The prototypes are the final clusters, repeated if there are fewer clusters than prototypes
+    for (int p = 0; p < n_prototypes; p++) {
+        int c = p % k;
+        double *sum = sums.data() + size_t(p) * MNIST_IMAGE_SIZE;
+
+        if (counts[c] == 0) {
+            // A cluster emptied in the last iteration keeps its center as a single image
+            const float *row = centers.getRow(c);
+
+            std::copy(row, row + MNIST_IMAGE_SIZE, sum);
+            weights[p] = 1;
+
+        } else {
+            std::copy(cluster_sums.begin() + size_t(c) * MNIST_IMAGE_SIZE,
+                      cluster_sums.begin() + size_t(c + 1) * MNIST_IMAGE_SIZE, sum);
+            weights[p] = counts[c];
+        }
+    }
+}
 
 /**
  * Classify the image with test_index
@@ -301,12 +622,23 @@ void NCC::calculateMeans() {
  *
  * @return  The predicted label of the image
  */
-int NCC::classifyImage(int test_index, bool verbose) {
-    std::array<double, 10> class_distances{};  // The distance from the test image to each class mean image
+template <class Metric>
+int NCC<Metric>::classifyImage(int test_index, bool verbose) {
+    uint64_t start_time = Classifier_Stats::now();
+
+    // The means the image is classified with. Updates publish new means and never change these
+    Rcu_Pointer<NCC_Centroids>::Reader current(centroids);
+    const Centroid_Matrix &class_means = current->means;
+
+    std::array<double, 10> class_distances{};  // The distance from the test image to the nearest prototype of each class
+    class_distances.fill(std::numeric_limits<double>::infinity());
 
-    // Calculate the distance from the test image to the class mean images
-    for (int i = 0; i < 10; ++i) {
-        class_distances[i] = class_means.at(i)->calculateDistance(*test_images.at(test_index));
+    // Calculate the distance from the test image to the prototypes of every class
+    for (int i = 0; i < class_means.getRowCount(); ++i) {
+        double distance = metric.distance(class_means.getRow(i), class_means.getSquaredNorm(i), *test_images.at(test_index));
+        int label = class_means.getLabel(i);
+
+        class_distances[label] = std::min(class_distances[label], distance);
     }
 
     int min_label = 0;  // The label of the class mean image with the smallest distance
@@ -321,11 +653,8 @@ int NCC::classifyImage(int test_index, bool verbose) {
     }
 
     // Update the stats
-    if (test_images.at(test_index)->isLabel(min_label)) {
-        incrementCorrect();
-    } else {
-        incrementIncorrect();
-    }
+    stats->recordClassification(stats_slot, test_images.at(test_index)->getLabel(), uint8_t(min_label),
+                                Classifier_Stats::now() - start_time);
 
     // Print the results
     if (verbose) {
@@ -349,26 +678,265 @@ int NCC::classifyImage(int test_index, bool verbose) {
     return min_label;
 }
 
+/**
+ * Classify a batch of consecutive test images. The distances from all the images of a block to all the prototypes are
+ * calculated with a single matrix multiplication that keeps the nearest prototype (see utils/Linear_Scorer.h). Metrics without a linear form fall back
+ * to classifyImage. The latency recorded for every image is the time of its block divided by the size of the block.
+ *
+ * @param start_index  The index of the first image to classify
+ * @param n_images     The number of images to classify
+ * @return             The predicted label of every image
+ */
+template <class Metric>
+std::vector<int> NCC<Metric>::classifyBatch(int start_index, int n_images) {
+    std::vector<int> predictions(n_images);
+
+    if (n_images <= 0) {
+        return predictions;
+    }
+
+    // Check the range once instead of for every image
+    test_images.at(start_index + n_images - 1);
+
+    if (!Rcu_Pointer<NCC_Centroids>::Reader(centroids)->linear) {
+        for (int i = 0; i < n_images; i++) {
+            predictions[i] = classifyImage(start_index + i);
+        }
+
+        return predictions;
+    }
+
+    std::vector<int> rows(NCC_BATCH_SIZE);  // The nearest prototype of every image of a block
+
+    for (int first = 0; first < n_images; first += NCC_BATCH_SIZE) {
+        uint64_t start_time = Classifier_Stats::now();
+
+        // Every block reads the latest published means
+        Rcu_Pointer<NCC_Centroids>::Reader current(centroids);
+
+        int n_block = std::min(NCC_BATCH_SIZE, n_images - first);
+        MNIST_Image *const *block = test_images.data() + start_index + first;
+
+        // The image gets the label of the nearest prototype of all the classes
+        current->scorer.nearest(block, n_block, rows.data());
+
+        for (int i = 0; i < n_block; i++) {
+            predictions[first + i] = current->means.getLabel(rows[i]);
+        }
+
+        uint64_t latency = (Classifier_Stats::now() - start_time) / n_block;
+
+        // Update the stats
+        for (int i = 0; i < n_block; i++) {
+            stats->recordClassification(stats_slot, block[i]->getLabel(), uint8_t(predictions[first + i]), latency);
+        }
+    }
+
+    return predictions;
+}
+
+/**
+ * Add a labeled image to the means. The image is folded into the running sums of its class and the new means are
+ * published. The classifications are never blocked, they keep using the previous means until the new ones are
+ * published. Safe to call from any thread
+ *
+ * @param image  The image
+ */
+template <class Metric>
+void NCC<Metric>::addTrainingImage(const MNIST_Image &image) {
+    pthread_mutex_lock(&update_mutex);
+
+    std::vector<bool> changed(10 * n_prototypes, false);
+    changed[foldImage(image)] = true;
+
+    publishRows(changed);
+
+    pthread_mutex_unlock(&update_mutex);
+}
+
+/**
+ * Add a batch of labeled images to the means. The new means are published once for the whole batch. Safe to call
+ * from any thread
+ *
+ * @param images  The images
+ */
+template <class Metric>
+void NCC<Metric>::addTrainingImages(const std::vector<MNIST_Image *> &images) {
+    pthread_mutex_lock(&update_mutex);
+
+    std::vector<bool> changed(10 * n_prototypes, false);
+
+    for (auto & image : images) {
+        changed[foldImage(*image)] = true;
+    }
+
+    publishRows(changed);
+
+    pthread_mutex_unlock(&update_mutex);
+}
+
+/**
+ * Add an image to the running sums of the nearest prototype of its class. Must be called with the update mutex held
+ *
+ * @param image  The image
+ * @return       The row of the prototype
+ */
+template <class Metric>
+int NCC<Metric>::foldImage(const MNIST_Image &image) {
+    int label = image.getLabel();
+    int row = label * n_prototypes;
+
+    // Find the nearest prototype of the class. The published prototypes are the current ones, the mutex is held
+    if (n_prototypes > 1) {
+        const Centroid_Matrix &prototypes = centroids.getForWriter()->means;
+        double min_distance = std::numeric_limits<double>::infinity();
+
+        for (int i = label * n_prototypes; i < (label + 1) * n_prototypes; i++) {
+            double distance = metric.distance(prototypes.getRow(i), prototypes.getSquaredNorm(i), image);
+
+            if (distance < min_distance) {
+                min_distance = distance;
+                row = i;
+            }
+        }
+    }
+
+    const uint8_t *pixels = image.getPixelData();
+    double *sums = prototype_sums.data() + size_t(row) * MNIST_IMAGE_SIZE;
+
+    if (decay == 1) {
+        for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+            sums[pixel] += pixels[pixel];
+        }
+
+    } else {
+        for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+            sums[pixel] = decay * sums[pixel] + pixels[pixel];
+        }
+    }
+
+    prototype_weights[row] = decay * prototype_weights[row] + 1;
+    class_counts[label]++;
+
+    return row;
+}
+
+/**
+ * Calculate all the prototypes from the running sums and publish them together with their linear form. Must be called
+ * with the update mutex held
+ */
+template <class Metric>
+void NCC<Metric>::publishCentroids() {
+    int n_rows = 10 * n_prototypes;
+    auto *next = new NCC_Centroids(n_rows);
+
+    next->linear = true;
+
+    for (int row = 0; row < n_rows; row++) {
+        buildRow(*next, row);
+    }
+
+    centroids.publish(next);
+}
+
+/**
+ * Publish a copy of the current prototypes with the changed rows calculated again from the running sums. Must be called
+ * with the update mutex held
+ *
+ * @param changed  Whether every row changed
+ */
+template <class Metric>
+void NCC<Metric>::publishRows(const std::vector<bool> &changed) {
+    auto *next = new NCC_Centroids(*centroids.getForWriter());
+
+    for (int row = 0; row < int(changed.size()); row++) {
+        if (changed[row]) {
+            buildRow(*next, row);
+        }
+    }
+
+    centroids.publish(next);
+}
+
+/**
+ * Calculate a prototype of unpublished means from its running sums, together with its linear form while the metric has
+ * one
+ *
+ * @param next  The means
+ * @param row   The row of the prototype
+ */
+template <class Metric>
+void NCC<Metric>::buildRow(NCC_Centroids &next, int row) const {
+    float *mean = next.means.getRow(row);
+    const double *sums = prototype_sums.data() + size_t(row) * MNIST_IMAGE_SIZE;
+
+    for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+        mean[pixel] = prototype_weights[row] == 0 ? 0 : float(sums[pixel] / prototype_weights[row]);
+    }
+
+    next.means.setLabel(row, uint8_t(row / n_prototypes));
+    next.means.updateNorm(row);
+
+    if (next.linear) {
+        std::array<float, MNIST_IMAGE_SIZE> weights {};
+        float bias = 0;
+
+        next.linear = metric.linearize(mean, next.means.getSquaredNorm(row), weights.data(), bias);
+        next.scorer.setRow(row, weights.data(), bias);
+    }
+}
+
 /**
  * Print the stats
  */
-void NCC::printStats() {
-    calculateAccuracy();  // Calculate the accuracy
+template <class Metric>
+void NCC<Metric>::printStats() {
+    Stats_Snapshot snapshot = stats->getSnapshot();
 
     // Print the results
-    std::cout << "    Number of tests: " << n_tests << std::endl;
-    std::cout << "    Number of correct classifications: " << n_correct << std::endl;
-    std::cout << "    Number of incorrect classifications: " << n_incorrect << std::endl;
+    std::cout << "    Number of tests: " << snapshot.n_tests << std::endl;
+    std::cout << "    Number of correct classifications: " << snapshot.n_correct << std::endl;
+    std::cout << "    Number of incorrect classifications: " << snapshot.n_incorrect << std::endl;
     std::cout.precision(3);
-    std::cout << "    Accuracy: " << std::fixed << accuracy << "%" << std::endl;
+    std::cout << "    Accuracy: " << std::fixed << snapshot.getAccuracy() << "%" << std::endl;
+    std::cout << "    Latency p50 / p99: " << double(snapshot.getLatencyPercentile(50)) / 1000 << "us / "
+              << double(snapshot.getLatencyPercentile(99)) / 1000 << "us" << std::endl;
+
+    Evaluation_Report(snapshot).printReport();
     std::cout << std::endl;
 }
 
 /**
- * Calculate the accuracy
+ * Exports the evaluation report (confusion matrix, per class precision, recall and latency) as JSON and CSV
+ *
+ * @param name  The path of the files without the extension
+ * @return      True if the files were written
  */
-void NCC::calculateAccuracy() {
-    NCC::accuracy = (double(NCC::n_correct) / double(NCC::n_tests)) * 100;
+template <class Metric>
+bool NCC<Metric>::saveReport(const std::string &name) const {
+    return Evaluation_Report(stats->getSnapshot()).saveReport(name);
+}
+
+
+/**
+ * Saves the mean of every class (or every prototype, class by class) as a pgm image. The pixels of the means are
+ * rounded to the nearest integer
+ *
+ * @param name  The path of the images without the label and the extension
+ */
+template <class Metric>
+void NCC<Metric>::saveClassMeans(const std::string &name) const {
+    Rcu_Pointer<NCC_Centroids>::Reader current(centroids);
+    const Centroid_Matrix &class_means = current->means;
+
+    for (int i = 0; i < class_means.getRowCount(); i++) {
+        class_means.saveRow(i, name + std::to_string(i));
+    }
 }
 
 
+// Instantiate the classifier for every available metric
+template class NCC<L2_Metric>;
+template class NCC<L1_Metric>;
+template class NCC<Cosine_Metric>;
+template class NCC<Mahalanobis_Metric>;
@@ -3,41 +3,92 @@
 
 
 #include <array>
+#include <pthread.h>
 #include <vector>
 
 #include "../mnist/MNIST_Image.h"
+#include "../metrics/Distance_Metrics.h"
+#include "../utils/Centroid_Matrix.h"
+#include "Evaluation_Report.h"
+#include "../utils/Linear_Scorer.h"
+#include "../utils/Rcu_Pointer.h"
+
+/**
+ * A published version of the class means. It is never modified after it is published, so the classifications read it
+ * without locking while the means are updated (see utils/Rcu_Pointer.h)
+ */
+struct NCC_Centroids {
+    explicit NCC_Centroids(int n_rows) : means(n_rows), scorer(n_rows) {}
+
+    Centroid_Matrix means;   /// The prototypes of the classes, row i is prototype i % n_prototypes of class i / n_prototypes
+    Linear_Scorer scorer;    /// The prototypes in the linear form of the metric, used by classifyBatch
+    bool linear {false};     /// Whether the metric has a linear form
+};
+
 
+/**
+ * Nearest centroid classifier. Every class is represented by its mean, or by the means of n_prototypes k-means clusters
+ * of its images (see calculatePrototypes). An image gets the label of the nearest prototype
+ *
+ * @tparam Metric  The distance metric used to find the nearest class mean (see metrics/Distance_Metrics.h)
+ */
+template <class Metric>
 class NCC {
 public:
     // Constructors
     NCC() = delete;
     NCC(const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images);
     NCC(const std::vector<MNIST_Image *>& training_images, const std::vector<MNIST_Image *>& test_images,
-        const std::array<MNIST_Image *, 10>& means, std::array<int, 10> counts);
+        const Centroid_Matrix& means, std::array<int, 10> counts);
 
     // Destructor
     ~NCC();
 
     // Getters
-    std::array<MNIST_Image *, 10> getClassMeans() const;
+    Centroid_Matrix getClassMeans() const;
+    std::array<int, 10> getClassCounts() const;
+    int getPrototypeCount() const;
 
     // Setters
-    void incrementCorrect();
-    void incrementIncorrect();
+    void shareStats(Classifier_Stats *shared_stats, int slot);
+    void setDecay(double decay);
 
     // Functions
     void calculateMeans();
+    void calculatePrototypes(int n_prototypes);
+    void addTrainingImage(const MNIST_Image &image);
+    void addTrainingImages(const std::vector<MNIST_Image *> &images);
     int classifyImage(int test_index, bool verbose = false);
+    std::vector<int> classifyBatch(int start_index, int n_images);
     void printStats();
+    bool saveReport(const std::string &name) const;
+    void saveClassMeans(const std::string &name) const;
 
     // Friend functions
+    template <class M>
     friend void * calculateMeansThread(void *arg);
 
 private:
+    // Functions
+    int foldImage(const MNIST_Image &image);
+    void publishCentroids();
+    void publishRows(const std::vector<bool> &changed);
+    void buildRow(NCC_Centroids &next, int row) const;
+    void fitPrototypes(const std::vector<MNIST_Image *> &images, int label, std::vector<double> &sums,
+                       std::vector<double> &weights) const;
+
     // Variables
-    std::array<MNIST_Image *, 10> class_means{};  /// The mean vector of each class
+    Metric metric {};                             /// The distance metric
     std::array<int, 10> class_counts {};          /// The number of images in each class
 
+    Rcu_Pointer<NCC_Centroids> centroids;         /// The current class means, replaced atomically on every update
+
+    int n_prototypes {1};                         /// The number of prototypes of every class
+    std::vector<double> prototype_sums;           /// The (decayed) sum of the pixels of every prototype, MNIST_IMAGE_SIZE each
+    std::vector<double> prototype_weights;        /// The (decayed) number of images of every prototype
+    double decay {1};                             /// The weight of the old images of a prototype when a new one arrives
+    mutable pthread_mutex_t update_mutex {};      /// Serializes the updates of the means
+
     std::vector<MNIST_Image *> cluster_means{};          /// The mean vector of each cluster
     std::vector<std::vector<MNIST_Image *>> clusters{};  /// The clusters of images
 
@@ -45,13 +96,10 @@ private:
     std::vector<MNIST_Image *> test_images;       /// The training images
 
     int n_clusters {0};     /// The number of clusters
-    int n_tests {0};        /// The number of tests performed
-    int n_correct {0};      /// The number of correct classifications
-    int n_incorrect {0};    /// The number of incorrect classifications
-    double accuracy {0};    /// The accuracy of the classifier
 
-    // Functions
-    void calculateAccuracy();
+    Classifier_Stats own_stats {1};         /// The stats of the classifier when they are not shared
+    Classifier_Stats *stats {&own_stats};   /// The stats the classifications are recorded to
+    int stats_slot {0};                     /// The slot of the stats written by this classifier
 };
 
 
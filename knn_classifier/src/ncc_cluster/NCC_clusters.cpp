@@ -1,25 +1,42 @@
 #include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <limits>
-#include <fstream>
+#include <numeric>
 #include <chrono>
 #include <random>
+#include <stdexcept>
 
 #include "../../include/progressbar.h"
 #include "NCC_clusters.h"
+#include "../utils/Timer.h"
 
 #define N_THREADS 16
 #define N_ITERATIONS 30
+#define LLOYD_CHUNK_IMAGES 1000  // The number of images assigned by a task of the Lloyd assignment step
+#define ELKAN_MAX_CLUSTERS 32     // Above this number of clusters Lloyd uses Hamerly's bounds instead of Elkan's
+
+#define SEEDING_ROUNDS 5          // The number of oversampling rounds of the k-means|| seeding
+#define SEEDING_OVERSAMPLING 0.5  // The expected number of candidates of a round, times the number of clusters
+
+#define MINI_BATCH_SIZE 1000             // The number of images of a mini-batch
+#define MINI_BATCH_MAX_ITERATIONS 1000   // The largest number of mini-batches of a fit
+#define MINI_BATCH_TOLERANCE 1e-2        // Stop when no center moves more than this fraction of the mean distance
+#define MINI_BATCH_PATIENCE 10           // Stop when the inertia did not improve for this many mini-batches
 
 /**
  * Constructor
  * @param n_clusters        The number of clusters
  * @param training_images   The training images
  * @param test_images       The test images
+ * @param algorithm         The algorithm the clusters are fitted with
+ * @param seed              The seed of the random generator. The same seed gives the same clusters
  */
-NCC_clusters::NCC_clusters(int n_clusters, const std::vector<MNIST_Image *> &training_images,
-                           const std::vector<MNIST_Image *> &test_images) : n_clusters(n_clusters), from_file(false) {
+template <class Metric>
+NCC_clusters<Metric>::NCC_clusters(int n_clusters, const std::vector<MNIST_Image *> &training_images,
+                           const std::vector<MNIST_Image *> &test_images, KMeans_Algorithm algorithm, unsigned seed)
+                           : n_clusters(n_clusters), from_file(false) {
     // seed the random number generator
-    auto seed = std::chrono::system_clock::now().time_since_epoch().count();
     generator = new std::default_random_engine(seed);
 
     // Deep copy the training images
@@ -36,6 +53,9 @@ NCC_clusters::NCC_clusters(int n_clusters, const std::vector<MNIST_Image *> &tra
         NCC_clusters::test_images.push_back(image);
     }
 
+    // Learn the parameters of the metric (if any)
+    NCC_clusters::metric.fit(NCC_clusters::training_images);
+
     // Initialize the mean and the converge vectors for the clusters
     NCC_clusters::cluster_means.reserve(n_clusters);
 
@@ -50,36 +70,64 @@ NCC_clusters::NCC_clusters(int n_clusters, const std::vector<MNIST_Image *> &tra
         NCC_clusters::clusters.at(i).reserve(training_images.size() / n_clusters);
     }
 
-    std::cout << std::endl << "    Initializing the clusters  ";
+    std::cout << std::endl << "    Initializing the clusters (k-means||)" << std::endl << std::endl;
 
-    // Initialize the centroid means using k-means++
-    NCC_clusters::initializeCentroids(30);
+    // Initialize the centroid means using k-means||
+    Timer seeding_timer;
+    seeding_timer.startTimer();
 
-    std::cout << std::endl;
+    NCC_clusters::initializeCentroids();
 
-    std::cout << std::endl << "    Fitting the clusters       ";
+    seeding_timer.stopTimer();
+    std::cout << std::endl << "    Seeded " << n_clusters << " clusters in ";
+    seeding_timer.displayElapsed();
 
-    progressbar bar((N_ITERATIONS) * 60);
+    if (algorithm != KMeans_Algorithm::ONLINE) {
+        bool lloyd = algorithm == KMeans_Algorithm::LLOYD;
+
+        std::cout << std::endl << "    Fitting the clusters (" << (lloyd ? "Lloyd" : "mini-batch") << ")" << std::endl
+                  << std::endl;
+
+        Timer timer;
+        timer.startTimer();
+
+        int n_iterations = lloyd ? NCC_clusters::fitLloyd() : NCC_clusters::fitMiniBatch();
+
+        timer.stopTimer();
+        std::cout << std::endl << "    Fitted after " << n_iterations << (lloyd ? " iterations in " : " mini-batches in ");
+        timer.displayElapsed();
+
+    } else {
+        std::cout << std::endl << "    Fitting the clusters       ";
+
+        progressbar bar((N_ITERATIONS) * 60);
+
+        // Train the clusters
+        for (int i = 0; i < N_ITERATIONS - 1; ++i) {
+            // Update the progress bar
+            for (int j = 0; j < 60; ++j) {
+                bar.update();
+            }
+
+            NCC_clusters::fitClusters(false, 5);
+        }
+
+        // Final iteration
+        NCC_clusters::fitClusters(true, 5);
 
-    // Train the clusters
-    for (int i = 0; i < N_ITERATIONS - 1; ++i) {
         // Update the progress bar
         for (int j = 0; j < 60; ++j) {
             bar.update();
         }
 
-        NCC_clusters::fitClusters(false, 5);
-    }
-
-    // Final iteration
-    NCC_clusters::fitClusters(true, 5);
+        // The centers are the final means
+        NCC_clusters::centers = Centroid_Matrix(n_clusters);
 
-    // Update the progress bar
-    for (int j = 0; j < 60; ++j) {
-        bar.update();
+        for (int i = 0; i < n_clusters; i++) {
+            NCC_clusters::centers.setRow(i, *NCC_clusters::cluster_means.at(i));
+        }
     }
 
-
     std::cout << std::endl;
     std::cout << std::endl;
 
@@ -89,77 +137,55 @@ NCC_clusters::NCC_clusters(int n_clusters, const std::vector<MNIST_Image *> &tra
 
 
 /**
- * Constructor to load the clusters from files instead of training them
+ * Constructor to load the clusters from a model file (see saveModel()) instead of training them. The centers are used
+ * in place from the mapped file and the metric gets the parameters it was fitted with from the model, so the training
+ * images are not needed
  *
- * @param cluster_dir the directory containing the cluster files
+ * @param model_path        The path of the model file
+ * @param test_images       The test images
+ * @throws std::runtime_error if the model can not be loaded or was fitted with another metric
  */
-NCC_clusters::NCC_clusters(const std::string& cluster_dir, const std::vector<MNIST_Image *>& training_images,
-                           const std::vector<MNIST_Image *>& test_images) : from_file(true) {
+template <class Metric>
+NCC_clusters<Metric>::NCC_clusters(const std::string& model_path, const std::vector<MNIST_Image *>& test_images)
+                           : from_file(true) {
 
-    // seed the random number generator
-    auto seed = std::chrono::system_clock::now().time_since_epoch().count();
-    generator = new std::default_random_engine(seed);
+    // Map the model before copying the images, so an invalid model fails fast
+    NCC_clusters::model = new Centroid_Model(model_path);
 
-    // Deep copy the training images
-    for (auto & training_image : training_images) {
-        auto *image = new MNIST_Image(*training_image);
+    if (model->getMetric() != Metric::getName()) {
+        std::string model_metric = model->getMetric();
+        delete model;
 
-        NCC_clusters::training_images.push_back(image);
+        throw std::runtime_error("The model " + model_path + " was fitted with the " + model_metric + " metric");
     }
 
-    // Deep copy the test images
-    for (auto & test_image : test_images) {
-        auto *image = new MNIST_Image(*test_image);
+    // Restore the parameters the metric learned from the training set
+    if (!NCC_clusters::metric.setParameters(model->getParameters(), model->getParameterCount())) {
+        delete model;
 
-        NCC_clusters::test_images.push_back(image);
+        throw std::runtime_error("Invalid parameters of the " + std::string(Metric::getName()) +
+                                 " metric in model file: " + model_path);
     }
 
-    // open the stats file
-    std::ifstream stats_file(cluster_dir + "/stats");
-
-    // read the number of clusters
-    int clusters_num;
-    stats_file >> clusters_num;
-
-    // initialize the cluster means
-    NCC_clusters::cluster_means.reserve(clusters_num);
-
-    // read the cluster means from the files
-    for (int i = 0; i < clusters_num; i++) {
-        // open the cluster mean file
-        std::ifstream mean_file(cluster_dir + "/mean_cluster_" + std::to_string(i) + ".pgm");
-
-        // read the pgm
-        std::string magic_number;
-        int width, height, max_value;
-        mean_file >> magic_number >> width >> height >> max_value;
-
-        // create the image
-        auto *image = new MNIST_Image();
+    NCC_clusters::n_clusters = model->getRowCount();
 
-        // read the image data
-        for (int j = 0; j < width * height; j++) {
-            int pixel;
-            mean_file >> pixel;
-            image->setPixel(pixel, j);
-        }
-
-        // read the label from the stats file
-        int label;
-        stats_file >> label;
+    // seed the random number generator
+    auto seed = std::chrono::system_clock::now().time_since_epoch().count();
+    generator = new std::default_random_engine(seed);
 
-        // set the label
-        image->setLabel(label);
+    // Deep copy the test images
+    for (auto & test_image : test_images) {
+        auto *image = new MNIST_Image(*test_image);
 
-        // add the mean to the cluster means
-        NCC_clusters::cluster_means.push_back(image);
+        NCC_clusters::test_images.push_back(image);
     }
 }
 
 /**
  * Destructor to free the memory allocated to the images
  */
-NCC_clusters::~NCC_clusters() {
+template <class Metric>
+NCC_clusters<Metric>::~NCC_clusters() {
     // Delete the training images
     for (auto & training_image : NCC_clusters::training_images) {
         delete training_image;
@@ -170,38 +196,29 @@ NCC_clusters::~NCC_clusters() {
         delete test_image;
     }
 
-    if (NCC_clusters::from_file) {
-        // Delete the cluster means
-        for (auto & cluster_mean : NCC_clusters::cluster_means) {
-            delete cluster_mean;
-        }
-    }
-
+    delete model;
     delete generator;
 }
 
 // -------------- Setters -------------- //
 
 /**
- * Increment the number of correct classifications
- */
-void NCC_clusters::incrementCorrect() {
-    NCC_clusters::n_correct++;
-    NCC_clusters::n_tests++;
-}
-
-/**
- * Increment the number of incorrect classifications
+ * Records the classifications to a stats object shared with other classifiers instead of the own stats
+ *
+ * @param shared_stats  The shared stats
+ * @param slot          The slot of the shared stats written by this classifier. No other thread may write to it
  */
-void NCC_clusters::incrementIncorrect() {
-    NCC_clusters::n_incorrect++;
-    NCC_clusters::n_tests++;
+template <class Metric>
+void NCC_clusters<Metric>::shareStats(Classifier_Stats *shared_stats, int slot) {
+    NCC_clusters::stats = shared_stats;
+    NCC_clusters::stats_slot = slot;
 }
 
 /**
  * Initialize the cluster centroids using k-means++
  */
-void NCC_clusters::fitClusters(bool is_final, int dataset_fraction) {
+template <class Metric>
+void NCC_clusters<Metric>::fitClusters(bool is_final, int dataset_fraction) {
     // create a random part of the training images
     std::vector<MNIST_Image *> random_training_images;
     random_training_images.reserve(NCC_clusters::training_images.size() / dataset_fraction);
@@ -221,7 +238,7 @@ void NCC_clusters::fitClusters(bool is_final, int dataset_fraction) {
         distances.reserve(NCC_clusters::n_clusters);
 
         for (auto & cluster_mean : NCC_clusters::cluster_means) {
-            distances.push_back(training_image->calculateDistance(*cluster_mean));
+            distances.push_back(training_image->calculateDistance(*cluster_mean, NCC_clusters::metric));
         }
 
         // Find the minimum distance and assign the image reference to the corresponding cluster
@@ -244,12 +261,586 @@ void NCC_clusters::fitClusters(bool is_final, int dataset_fraction) {
     }
 }
 
+/**
+ * Fit the clusters with batch (Lloyd) k-means on the whole training set, starting from the initial centroids. Every
+ * iteration assigns all the images to their nearest center and then moves every center to the mean of its images,
+ * until no image changes cluster.
+ *
+ * The assignment step runs on a thread pool, LLOYD_CHUNK_IMAGES images per task. Every thread adds the pixels of the
+ * images it assigned to its own float sums of every cluster, and the update step reduces the sums of the threads. The
+ * pixels are integers and a float holds every integer up to 2^24, so the partial sums are exact for up to 65793
+ * images and the centers do not depend on the number of threads or on which thread got which images.
+ *
+ * When the metric satisfies the triangle inequality the assignment step is accelerated with Elkan's bounds. Every
+ * image keeps an upper bound of the distance to its center and a lower bound of the distance to every center. A
+ * center can not be nearer than the own one when the upper bound is below its lower bound or below half the distance
+ * between the two centers, so only the centers that pass both tests have their distance calculated. After every
+ * update the bounds are moved by how far the centers moved. The assignments are the same as the ones of the plain
+ * algorithm.
+ *
+ * Elkan's bounds take k doubles per image, 168 MB for 350 clusters, and streaming through them costs more than the
+ * distances they save. Above ELKAN_MAX_CLUSTERS clusters the images keep Hamerly's single lower bound instead, the
+ * distance to the second nearest center, which rules out all the other centers at once (see assignImageHamerly()).
+ *
+ * @return The number of iterations
+ */
+template <class Metric>
+int NCC_clusters<Metric>::fitLloyd() {
+    int n_images = int(NCC_clusters::training_images.size());
+    int k = NCC_clusters::n_clusters;
+
+    // The initial centers are the initial centroids
+    NCC_clusters::centers = Centroid_Matrix(k);
+
+    for (int c = 0; c < k; c++) {
+        NCC_clusters::centers.setRow(c, *NCC_clusters::cluster_means.at(c));
+    }
+
+    constexpr bool accelerated = Metric::hasTriangleInequality();
+    bool elkan = accelerated && k <= ELKAN_MAX_CLUSTERS;  // Whether every image keeps a lower bound per center
+    int n_lower = elkan ? k : 1;                          // The number of lower bounds of an image
+
+    Thread_Pool pool(N_THREADS);
+    int n_threads = pool.getThreadCount();
+    int n_chunks = (n_images + LLOYD_CHUNK_IMAGES - 1) / LLOYD_CHUNK_IMAGES;
+
+    std::vector<int> assignments(n_images, -1);                       // The cluster of every image
+    std::vector<double> upper_bounds(n_images, 0);                    // The upper bound of the distance to the center
+    std::vector<double> lower_bounds(size_t(n_images) * n_lower, 0);  // The lower bounds of the other centers
+    std::vector<double> center_distances(elkan ? size_t(k) * k : 0);  // The distances between the centers
+    std::vector<double> half_gaps(k, 0);                              // Half the distance to the nearest other center
+    std::vector<double> movements(k, 0);                              // How far every center moved in the last update
+
+    if (accelerated) {
+        size_t n_bounds = upper_bounds.size() + lower_bounds.size() + center_distances.size();
+
+        std::cout << "        " << (elkan ? "Elkan" : "Hamerly") << " bounds: " << std::fixed << std::setprecision(1)
+                  << double(n_bounds * sizeof(double)) / (1 << 20) << " MiB" << std::endl << std::endl;
+    }
+
+    // The partial results of every thread
+    std::vector<float> thread_sums(size_t(n_threads) * k * MNIST_IMAGE_SIZE);  // The pixel sums of every cluster
+    std::vector<int> thread_counts(size_t(n_threads) * k);                      // The images of every cluster
+    std::vector<uint64_t> thread_distances(n_threads);  // The number of image to center distances calculated
+    std::vector<int> thread_changed(n_threads);         // The number of images that changed cluster
+
+    int iteration = 0;
+
+    for (; iteration < N_ITERATIONS; iteration++) {
+        bool use_bounds = accelerated && iteration > 0;
+
+        std::fill(thread_sums.begin(), thread_sums.end(), 0.0f);
+        std::fill(thread_counts.begin(), thread_counts.end(), 0);
+        std::fill(thread_distances.begin(), thread_distances.end(), 0);
+        std::fill(thread_changed.begin(), thread_changed.end(), 0);
+
+        if (use_bounds) {
+            pool.parallelFor(k, [&](int c, int) {
+                half_gaps[c] = std::numeric_limits<double>::infinity();
+
+                for (int other = 0; other < k; other++) {
+                    if (other == c) {
+                        continue;
+                    }
+
+                    double distance = Metric::toMetric(NCC_clusters::metric.distance(NCC_clusters::centers.getRow(c),
+                                                                                     NCC_clusters::centers.getRow(other)));
+
+                    if (elkan) {
+                        center_distances[size_t(c) * k + other] = distance;
+                    }
+
+                    half_gaps[c] = std::min(half_gaps[c], distance / 2);
+                }
+            });
+        }
+
+        pool.parallelFor(n_chunks, [&](int chunk, int thread_id) {
+            float *sums = thread_sums.data() + size_t(thread_id) * k * MNIST_IMAGE_SIZE;
+            int *counts = thread_counts.data() + size_t(thread_id) * k;
+
+            int end = std::min(n_images, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+
+            for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+                double *lower = lower_bounds.data() + size_t(i) * n_lower;
+                int cluster;
+
+                if (elkan) {
+                    cluster = NCC_clusters::assignImage(i, assignments[i], use_bounds, upper_bounds[i], lower,
+                                                        center_distances, half_gaps, thread_distances[thread_id]);
+                } else {
+                    cluster = NCC_clusters::assignImageHamerly(i, assignments[i], use_bounds, upper_bounds[i], *lower,
+                                                               half_gaps, thread_distances[thread_id]);
+                }
+
+                if (cluster != assignments[i]) {
+                    assignments[i] = cluster;
+                    thread_changed[thread_id]++;
+                }
+
+                const uint8_t *pixels = NCC_clusters::training_images[i]->getPixelData();
+                float *sum = sums + size_t(cluster) * MNIST_IMAGE_SIZE;
+
+                for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                    sum[pixel] += pixels[pixel];
+                }
+
+                counts[cluster]++;
+            }
+        });
+
+        uint64_t n_distances = 0;
+        int n_changed = 0;
+
+        for (int t = 0; t < n_threads; t++) {
+            n_distances += thread_distances[t];
+            n_changed += thread_changed[t];
+        }
+
+        double skipped = 1 - double(n_distances) / (double(n_images) * k);
+
+        std::cout << "        Iteration " << std::setw(2) << iteration + 1 << ": " << std::setw(6) << n_changed
+                  << " images changed cluster, " << std::fixed << std::setprecision(1) << skipped * 100
+                  << "% of the distances skipped" << std::endl;
+
+        if (n_changed == 0) {
+            iteration++;
+            break;
+        }
+
+        NCC_clusters::updateCenters(pool, thread_sums, thread_counts, movements);
+
+        // Move the bounds by the movement of the centers
+        if (accelerated) {
+            // The single lower bound moves by the largest movement of the other centers
+            int fastest = int(std::max_element(movements.begin(), movements.end()) - movements.begin());
+            double second_fastest = 0;
+
+            for (int c = 0; c < k; c++) {
+                if (c != fastest) {
+                    second_fastest = std::max(second_fastest, movements[c]);
+                }
+            }
+
+            pool.parallelFor(n_chunks, [&](int chunk, int) {
+                int end = std::min(n_images, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+
+                for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+                    double *lower = lower_bounds.data() + size_t(i) * n_lower;
+
+                    if (elkan) {
+                        for (int c = 0; c < k; c++) {
+                            lower[c] = std::max(0.0, lower[c] - movements[c]);
+                        }
+                    } else {
+                        double movement = assignments[i] == fastest ? second_fastest : movements[fastest];
+                        lower[0] = std::max(0.0, lower[0] - movement);
+                    }
+
+                    upper_bounds[i] += movements[assignments[i]];
+                }
+            });
+        }
+    }
+
+    // The clusters of images of the final assignment
+    for (int i = 0; i < n_images; i++) {
+        NCC_clusters::clusters.at(assignments[i]).push_back(NCC_clusters::training_images[i]);
+    }
+
+    return iteration;
+}
+
+/**
+ * Fit the clusters with mini-batch k-means, starting from the initial centroids. Every iteration draws
+ * MINI_BATCH_SIZE images, assigns them to their nearest centers on a thread pool and moves every center towards the
+ * mean of its images of the batch. Every center has its own learning rate, the number of images of the batch over
+ * the number of images it has seen, so every center is the running mean of all the images ever assigned to it. The
+ * batches are drawn without replacement from a shuffled order of the training set that is shuffled again after every
+ * pass.
+ *
+ * The fit stops when no center moved more than MINI_BATCH_TOLERANCE times the mean distance of the images to their
+ * centers, or when the smoothed inertia (the mean distance of a batch) did not improve for MINI_BATCH_PATIENCE batches.
+ *
+ * @return The number of mini-batches
+ */
+template <class Metric>
+int NCC_clusters<Metric>::fitMiniBatch() {
+    int n_images = int(NCC_clusters::training_images.size());
+    int k = NCC_clusters::n_clusters;
+    int batch_size = std::min(MINI_BATCH_SIZE, n_images);
+
+    // The initial centers are the initial centroids
+    NCC_clusters::centers = Centroid_Matrix(k);
+
+    for (int c = 0; c < k; c++) {
+        NCC_clusters::centers.setRow(c, *NCC_clusters::cluster_means.at(c));
+    }
+
+    Thread_Pool pool(N_THREADS);
+
+    std::vector<int> order(n_images);  // The shuffled order the batches are drawn from
+    std::iota(order.begin(), order.end(), 0);
+    int position = n_images;           // The next image of the order, at the end to shuffle before the first batch
+
+    std::vector<int> batch_clusters(batch_size);        // The nearest center of every image of the batch
+    std::vector<double> batch_distances(batch_size);    // The distance to the nearest center
+    std::vector<double> sums(size_t(k) * MNIST_IMAGE_SIZE);  // The pixel sums of every center in the batch
+    std::vector<int> batch_counts(k);                   // The images of every center in the batch
+    std::vector<double> seen(k, 0);                     // The images every center has seen
+    std::array<float, MNIST_IMAGE_SIZE> center {};
+
+    // The weight of a batch in the smoothed inertia, about the weight of a pass over the training set
+    double alpha = std::min(1.0, 2.0 * batch_size / (n_images + 1));
+
+    double smoothed_inertia = 0;
+    double best_inertia = std::numeric_limits<double>::infinity();
+    int no_improvement = 0;
+
+    int iteration = 0;
+
+    while (iteration < MINI_BATCH_MAX_ITERATIONS) {
+        // Draw the batch without replacement
+        if (position + batch_size > n_images) {
+            std::shuffle(order.begin(), order.end(), *NCC_clusters::generator);
+            position = 0;
+        }
+
+        const int *batch = order.data() + position;
+        position += batch_size;
+
+        // Assign the images of the batch
+        int n_chunks = (batch_size + LLOYD_CHUNK_IMAGES - 1) / LLOYD_CHUNK_IMAGES;
+
+        pool.parallelFor(n_chunks, [&](int chunk, int) {
+            int end = std::min(batch_size, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+
+            for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+                batch_clusters[i] = NCC_clusters::nearestCenter(batch[i], batch_distances[i]);
+            }
+        });
+
+        // Sum the images of every center
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(batch_counts.begin(), batch_counts.end(), 0);
+
+        double inertia = 0;
+
+        for (int i = 0; i < batch_size; i++) {
+            const uint8_t *pixels = NCC_clusters::training_images[batch[i]]->getPixelData();
+            double *sum = sums.data() + size_t(batch_clusters[i]) * MNIST_IMAGE_SIZE;
+
+            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                sum[pixel] += pixels[pixel];
+            }
+
+            batch_counts[batch_clusters[i]]++;
+            inertia += batch_distances[i];
+        }
+
+        inertia /= batch_size;
+
+        // Move the centers with their own learning rates
+        double largest_movement = 0;
+
+        for (int c = 0; c < k; c++) {
+            if (batch_counts[c] == 0) {
+                continue;
+            }
+
+            seen[c] += batch_counts[c];
+
+            double rate = batch_counts[c] / seen[c];
+            const float *old_center = NCC_clusters::centers.getRow(c);
+            const double *sum = sums.data() + size_t(c) * MNIST_IMAGE_SIZE;
+
+            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                double batch_mean = sum[pixel] / batch_counts[c];
+                center[pixel] = float(old_center[pixel] + rate * (batch_mean - old_center[pixel]));
+            }
+
+            largest_movement = std::max(largest_movement,
+                                        Metric::toMetric(NCC_clusters::metric.distance(old_center, center.data())));
+
+            NCC_clusters::centers.setRow(c, center.data());
+        }
+
+        iteration++;
+
+        // Check the convergence
+        smoothed_inertia = iteration == 1 ? inertia : (1 - alpha) * smoothed_inertia + alpha * inertia;
+
+        if (smoothed_inertia < best_inertia) {
+            best_inertia = smoothed_inertia;
+            no_improvement = 0;
+        } else {
+            no_improvement++;
+        }
+
+        bool converged = largest_movement < MINI_BATCH_TOLERANCE * smoothed_inertia;
+        bool stalled = no_improvement >= MINI_BATCH_PATIENCE;
+
+        if (iteration % 10 == 0 || converged || stalled) {
+            std::cout << "        Mini-batch " << std::setw(4) << iteration << ": inertia " << std::fixed
+                      << std::setprecision(2) << smoothed_inertia << ", largest center movement "
+                      << std::setprecision(4) << largest_movement << std::endl;
+        }
+
+        if (converged || stalled) {
+            std::cout << "        Stopped, " << (converged ? "the centers converged" : "the inertia stopped improving")
+                      << std::endl;
+            break;
+        }
+    }
+
+    // The clusters of images of the final centers
+    std::vector<int> assignments(n_images);
+    int n_chunks = (n_images + LLOYD_CHUNK_IMAGES - 1) / LLOYD_CHUNK_IMAGES;
+
+    pool.parallelFor(n_chunks, [&](int chunk, int) {
+        int end = std::min(n_images, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+        double distance;
+
+        for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+            assignments[i] = NCC_clusters::nearestCenter(i, distance);
+        }
+    });
+
+    for (int i = 0; i < n_images; i++) {
+        NCC_clusters::clusters.at(assignments[i]).push_back(NCC_clusters::training_images[i]);
+    }
+
+    return iteration;
+}
+
+/**
+ * Find the nearest center of a training image
+ *
+ * @param image_index  The index of the training image
+ * @param distance     The distance to the nearest center, converted with Metric::toMetric()
+ * @return             The index of the nearest center
+ */
+template <class Metric>
+int NCC_clusters<Metric>::nearestCenter(int image_index, double &distance) const {
+    int nearest = 0;
+    distance = std::numeric_limits<double>::infinity();
+
+    for (int c = 0; c < NCC_clusters::n_clusters; c++) {
+        double center_distance = NCC_clusters::distanceTo(image_index, c);
+
+        if (center_distance < distance) {
+            distance = center_distance;
+            nearest = c;
+        }
+    }
+
+    return nearest;
+}
+
+/**
+ * Find the nearest center of a training image. Without the bounds all the distances are calculated, with them only
+ * the distances of the centers the bounds can not rule out
+ *
+ * @param image_index       The index of the training image
+ * @param cluster           The current cluster of the image
+ * @param use_bounds        Whether the bounds are valid and can be used
+ * @param upper             The upper bound of the distance to the own center, updated
+ * @param lower             The k lower bounds of the distances to the centers, updated
+ * @param center_distances  The k x k distances between the centers
+ * @param half_gaps         Half the distance of every center to the nearest other center
+ * @param n_distances       Incremented by the number of distances calculated
+ * @return                  The index of the nearest center
+ */
+template <class Metric>
+int NCC_clusters<Metric>::assignImage(int image_index, int cluster, bool use_bounds, double &upper, double *lower,
+                                      const std::vector<double> &center_distances,
+                                      const std::vector<double> &half_gaps, uint64_t &n_distances) const {
+    int k = NCC_clusters::n_clusters;
+
+    if (!use_bounds) {
+        int nearest = 0;
+
+        for (int c = 0; c < k; c++) {
+            lower[c] = NCC_clusters::distanceTo(image_index, c);
+
+            if (lower[c] < lower[nearest]) {
+                nearest = c;
+            }
+        }
+
+        n_distances += k;
+        upper = lower[nearest];
+
+        return nearest;
+    }
+
+    // No other center is nearer than half the distance to the nearest one
+    if (upper <= half_gaps[cluster]) {
+        return cluster;
+    }
+
+    bool tight = false;  // Whether the upper bound is the exact distance
+
+    for (int c = 0; c < k; c++) {
+        if (c == cluster || upper <= lower[c] || upper <= center_distances[size_t(cluster) * k + c] / 2) {
+            continue;
+        }
+
+        // Tighten the upper bound and check again
+        if (!tight) {
+            upper = NCC_clusters::distanceTo(image_index, cluster);
+            lower[cluster] = upper;
+            tight = true;
+            n_distances++;
+
+            if (upper <= lower[c] || upper <= center_distances[size_t(cluster) * k + c] / 2) {
+                continue;
+            }
+        }
+
+        lower[c] = NCC_clusters::distanceTo(image_index, c);
+        n_distances++;
+
+        if (lower[c] < upper) {
+            cluster = c;
+            upper = lower[c];
+        }
+    }
+
+    return cluster;
+}
+
+/**
+ * Find the nearest center of a training image with Hamerly's bounds. The lower bound is a bound of the distance to
+ * every center but the own one, so when the upper bound is below it, or below half the distance to the nearest other
+ * center, no other center can be nearer. Otherwise all the distances are calculated and the lower bound becomes the
+ * distance to the second nearest center
+ *
+ * @param image_index  The index of the training image
+ * @param cluster      The current cluster of the image
+ * @param use_bounds   Whether the bounds are valid and can be used
+ * @param upper        The upper bound of the distance to the own center, updated
+ * @param lower        The lower bound of the distances to the other centers, updated
+ * @param half_gaps    Half the distance of every center to the nearest other center
+ * @param n_distances  Incremented by the number of distances calculated
+ * @return             The index of the nearest center
+ */
+template <class Metric>
+int NCC_clusters<Metric>::assignImageHamerly(int image_index, int cluster, bool use_bounds, double &upper,
+                                             double &lower, const std::vector<double> &half_gaps,
+                                             uint64_t &n_distances) const {
+    if (use_bounds) {
+        double bound = std::max(half_gaps[cluster], lower);
+
+        if (upper <= bound) {
+            return cluster;
+        }
+
+        // Tighten the upper bound and check again
+        upper = NCC_clusters::distanceTo(image_index, cluster);
+        n_distances++;
+
+        if (upper <= bound) {
+            return cluster;
+        }
+    }
+
+    // The upper bound is the exact distance to the own center when the bounds were used
+    int known = use_bounds ? cluster : -1;
+    int nearest = known;
+    double nearest_distance = use_bounds ? upper : std::numeric_limits<double>::infinity();
+    double second_distance = std::numeric_limits<double>::infinity();
+
+    for (int c = 0; c < NCC_clusters::n_clusters; c++) {
+        if (c == known) {
+            continue;
+        }
+
+        double distance = NCC_clusters::distanceTo(image_index, c);
+        n_distances++;
+
+        if (distance < nearest_distance) {
+            second_distance = nearest_distance;
+            nearest_distance = distance;
+            nearest = c;
+
+        } else if (distance < second_distance) {
+            second_distance = distance;
+        }
+    }
+
+    upper = nearest_distance;
+    lower = second_distance;
+
+    return nearest;
+}
+
+/**
+ * Calculate the distance of a training image to a center
+ *
+ * @param image_index  The index of the training image
+ * @param center       The index of the center
+ * @return             The distance converted with Metric::toMetric()
+ */
+template <class Metric>
+double NCC_clusters<Metric>::distanceTo(int image_index, int center) const {
+    return Metric::toMetric(NCC_clusters::metric.distance(NCC_clusters::centers.getRow(center),
+                                                          NCC_clusters::centers.getSquaredNorm(center),
+                                                          *NCC_clusters::training_images[image_index]));
+}
+
+/**
+ * Reduce the pixel sums of the threads and move every center to the mean of the images assigned to it, one task per
+ * center. Centers without images stay in place
+ *
+ * @param pool           The thread pool
+ * @param thread_sums    The k x MNIST_IMAGE_SIZE pixel sums of every thread
+ * @param thread_counts  The k image counts of every thread
+ * @param movements      How far every center moved, in the metric distance
+ */
+template <class Metric>
+void NCC_clusters<Metric>::updateCenters(Thread_Pool &pool, const std::vector<float> &thread_sums,
+                                         const std::vector<int> &thread_counts, std::vector<double> &movements) {
+    int k = NCC_clusters::n_clusters;
+    int n_threads = pool.getThreadCount();
+
+    pool.parallelFor(k, [&](int c, int) {
+        std::array<double, MNIST_IMAGE_SIZE> sum {};
+        int count = 0;
+
+        for (int t = 0; t < n_threads; t++) {
+            const float *partial = thread_sums.data() + (size_t(t) * k + c) * MNIST_IMAGE_SIZE;
+
+            for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+                sum[pixel] += partial[pixel];
+            }
+
+            count += thread_counts[size_t(t) * k + c];
+        }
+
+        if (count == 0) {
+            movements[c] = 0;
+            return;
+        }
+
+        std::array<float, MNIST_IMAGE_SIZE> mean {};
+
+        for (int pixel = 0; pixel < MNIST_IMAGE_SIZE; pixel++) {
+            mean[pixel] = float(sum[pixel] / count);
+        }
+
+        movements[c] = Metric::toMetric(NCC_clusters::metric.distance(NCC_clusters::centers.getRow(c), mean.data()));
+        NCC_clusters::centers.setRow(c, mean.data());
+    });
+}
+
 /**
  * Update the cluster mean
  * @param cluster_index The index of the cluster
  * @param image         The image to add to the cluster
  */
-void NCC_clusters::updateClusterMean(int cluster_index, MNIST_Image *image, int n_images) {
+template <class Metric>
+void NCC_clusters<Metric>::updateClusterMean(int cluster_index, MNIST_Image *image, int n_images) {
     // Calculate the new mean
     if (n_images == 0) {
         for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
@@ -271,11 +862,12 @@ void NCC_clusters::updateClusterMean(int cluster_index, MNIST_Image *image, int
 /**
  * Determine the cluster label by finding the most common label in each cluster
  */
-void NCC_clusters::determineClusterLabel() {
+template <class Metric>
+void NCC_clusters<Metric>::determineClusterLabel() {
     // Find the most common label in each cluster
     for (int i = 0; i < NCC_clusters::n_clusters; i++) {
         // Count the number of times each label appears in the cluster
-        std::vector<uint8_t> label_counts(10, 0);
+        std::vector<int> label_counts(10, 0);
 
         for (auto & image : NCC_clusters::clusters.at(i)) {
             label_counts.at(image->getLabel())++;
@@ -286,200 +878,250 @@ void NCC_clusters::determineClusterLabel() {
         int label = int(std::distance(label_counts.begin(), max_count));
 
         // Set the mean cluster label
-        NCC_clusters::cluster_means.at(i)->setLabel(label);
+        NCC_clusters::centers.setLabel(i, uint8_t(label));
     }
 }
 
 /**
  * Classify the test images using the cluster means
  */
-int NCC_clusters::classifyImage(int test_index, bool verbose) {
-    // Find the distance to each cluster mean
-    std::vector<double> distances;
-    distances.reserve(this->n_clusters);
+template <class Metric>
+int NCC_clusters<Metric>::classifyImage(int test_index, bool verbose) {
+    uint64_t start_time = Classifier_Stats::now();
 
-    for (auto & cluster_mean : NCC_clusters::cluster_means) {
-        distances.push_back(NCC_clusters::test_images.at(test_index)->calculateDistance(*cluster_mean));
-    }
+    const MNIST_Image &image = *NCC_clusters::test_images.at(test_index);
 
-    // Find the minimum distance and assign the image reference to the corresponding cluster
-    auto min_distance = std::min_element(distances.begin(), distances.end());
-    int cluster_index = int(std::distance(distances.begin(), min_distance));
+    // Find the nearest cluster center, in the mapped model if the clusters were loaded from one
+    uint8_t label;
 
-    // Update the statistics
-    if (NCC_clusters::test_images.at(test_index)->getLabel() == NCC_clusters::cluster_means.at(cluster_index)->getLabel()) {
-        NCC_clusters::incrementCorrect();
+    if (NCC_clusters::from_file) {
+        label = NCC_clusters::model->getLabel(NCC_clusters::nearestRow(*NCC_clusters::model, image));
     } else {
-        NCC_clusters::incrementIncorrect();
+        label = NCC_clusters::centers.getLabel(NCC_clusters::nearestRow(NCC_clusters::centers, image));
     }
 
+    // Update the statistics
+    NCC_clusters::stats->recordClassification(NCC_clusters::stats_slot, image.getLabel(), label,
+                                              Classifier_Stats::now() - start_time);
+
     if (verbose) {
-        std::cout << "Test image " << test_index << " is a " << int(test_images.at(test_index)->getLabel()) << std::endl;
-        std::cout << "Test image " << test_index << " classified as " << int(NCC_clusters::cluster_means.at(cluster_index)->getLabel()) << std::endl;
+        std::cout << "Test image " << test_index << " is a " << int(image.getLabel()) << std::endl;
+        std::cout << "Test image " << test_index << " classified as " << int(label) << std::endl;
     }
 
-    return NCC_clusters::cluster_means.at(cluster_index)->getLabel();
+    return label;
 }
 
 /**
  * Print the classification statistics
  */
-void NCC_clusters::printStats() {
-    calculateAccuracy();  // Calculate the accuracy
+template <class Metric>
+void NCC_clusters<Metric>::printStats() {
+    Stats_Snapshot snapshot = NCC_clusters::stats->getSnapshot();
 
     // Print the results
     std::cout << std::endl;
     std::cout << "Classification Summary:" << std::endl << std::endl;
 
-    std::cout << "    Number of tests: " << n_tests << std::endl;
-    std::cout << "    Number of correct classifications: " << n_correct << std::endl;
-    std::cout << "    Number of incorrect classifications: " << n_incorrect << std::endl;
+    std::cout << "    Number of tests: " << snapshot.n_tests << std::endl;
+    std::cout << "    Number of correct classifications: " << snapshot.n_correct << std::endl;
+    std::cout << "    Number of incorrect classifications: " << snapshot.n_incorrect << std::endl;
     std::cout.precision(3);
-    std::cout << "    Accuracy: " << std::fixed << accuracy << "%" << std::endl;
+    std::cout << "    Accuracy: " << std::fixed << snapshot.getAccuracy() << "%" << std::endl;
+    std::cout << "    Latency p50 / p99: " << double(snapshot.getLatencyPercentile(50)) / 1000 << "us / "
+              << double(snapshot.getLatencyPercentile(99)) / 1000 << "us" << std::endl;
+
+    Evaluation_Report(snapshot).printReport();
 }
 
 /**
- * Calculate the accuracy
+ * Exports the evaluation report (confusion matrix, per class precision, recall and latency) as JSON and CSV
+ *
+ * @param name  The path of the files without the extension
+ * @return      True if the files were written
  */
-void NCC_clusters::calculateAccuracy() {
-    NCC_clusters::accuracy = (double) NCC_clusters::n_correct / (double) NCC_clusters::n_tests * 100;
+template <class Metric>
+bool NCC_clusters<Metric>::saveReport(const std::string &name) const {
+    return Evaluation_Report(NCC_clusters::stats->getSnapshot()).saveReport(name);
 }
 
 /**
- * Save the mean cluster image as a .pgm file
+ * Find the nearest row of a set of centers to an image
+ *
+ * @tparam Rows   Centroid_Matrix or Centroid_Model
+ * @param rows    The centers
+ * @param image   The image
+ * @return        The index of the nearest row
  */
-void NCC_clusters::saveMeanClusters() {
-    // Create a stats file to save the number of clusters
-    std::ofstream stats_file;
-    stats_file.open("pre_fit/stats");
-    stats_file << NCC_clusters::n_clusters << std::endl;
-
-    // Save the mean clusters
-    for (int i = 0; i < NCC_clusters::n_clusters; i++) {
-        std::string filename = "pre_fit/mean_cluster_" + std::to_string(i);
-        NCC_clusters::cluster_means.at(i)->saveImage(filename);
-
-        // Save the class label to the stats file
-        stats_file << int(NCC_clusters::cluster_means.at(i)->getLabel()) << std::endl;
+template <class Metric>
+template <class Rows>
+int NCC_clusters<Metric>::nearestRow(const Rows &rows, const MNIST_Image &image) const {
+    int nearest = 0;
+    double min_distance = std::numeric_limits<double>::infinity();
+
+    for (int i = 0; i < rows.getRowCount(); i++) {
+        double distance = NCC_clusters::metric.distance(rows.getRow(i), rows.getSquaredNorm(i), image);
+
+        if (distance < min_distance) {
+            min_distance = distance;
+            nearest = i;
+        }
     }
 
+    return nearest;
 }
 
-typedef struct {
-    std::vector<double> *distances;  // Distances to each cluster mean
-    int cluster_index;  // Index of the cluster with the minimum distance
-    int thread_id;      // Thread ID
-    int start_index;    // Start index of the training images
-    int end_index;      // End index of the training images
-
-    std::vector<MNIST_Image *> *images;  // Clusters
-    NCC_clusters *clusters;  // Pointer to the NCC_clusters object
-} CentroidArgs;
-
 /**
- * Thread function for calculating the distances to the cluster means
+ * Save the fitted clusters as a single binary model file, with the centers, their labels, the number of training
+ * images of every cluster, the metric and its learned parameters
+ *
+ * @param path  The path of the model file
+ * @return      True if the file was written
  */
-void *centroidThread(void *arg){
-    auto *args = (CentroidArgs *) arg;
-    NCC_clusters *clusters = args->clusters;
+template <class Metric>
+bool NCC_clusters<Metric>::saveModel(const std::string &path) const {
+    std::vector<int> counts;
+    counts.reserve(NCC_clusters::n_clusters);
 
-    for (int i = args->start_index; i < args->end_index; i++) {
-//        MNIST_Image *training_image = clusters->training_images.at(i);
-        MNIST_Image *training_image = args->images->at(i);
-
-        // Find the distance to the nearest centroid
-        double min_distance = std::numeric_limits<double>::max();
-
-        for (auto & cluster_mean : clusters->cluster_means) {
-            double distance = training_image->calculateDistance(*cluster_mean);
-
-            if (distance < min_distance) {
-                min_distance = distance;
-            }
-        }
-
-        // Keep the minimum distance for each training image
-        args->distances->push_back(min_distance);
+    for (auto & cluster : NCC_clusters::clusters) {
+        counts.push_back(int(cluster.size()));
     }
 
-    pthread_exit(nullptr);
+    return Centroid_Model::save(path, NCC_clusters::centers, counts, Metric::getName(),
+                                NCC_clusters::metric.getParameters());
 }
 
 /**
- * Initialise the cluster means using the k-means++ algorithm
+ * Initialise the cluster means with k-means|| (scalable k-means++).
+ *
+ * The first centroid is a random image. Every image keeps its distance to the nearest candidate so far, and in each
+ * of the SEEDING_ROUNDS rounds every image becomes a candidate with probability SEEDING_OVERSAMPLING * k times its
+ * distance over the sum of the distances, so about k/2 far away images are added per round. The images only compare
+ * themselves with the candidates of the last round, so the distances are kept up to date with n x (new candidates)
+ * distance calculations instead of n x k per centroid. Both steps run on a thread pool, and every task samples with
+ * its own generator seeded from the round, so the candidates do not depend on the number of threads.
  *
- * @param dataset_fraction Fraction of the training dataset to use for initialisation
+ * The candidates are weighted with the number of images nearest to them and reduced to k centroids with weighted
+ * k-means++.
  */
-void NCC_clusters::initializeCentroids(int dataset_fraction) {
+template <class Metric>
+void NCC_clusters<Metric>::initializeCentroids() {
+    int n_images = int(NCC_clusters::training_images.size());
+    int k = NCC_clusters::n_clusters;
+    int n_chunks = (n_images + LLOYD_CHUNK_IMAGES - 1) / LLOYD_CHUNK_IMAGES;
+
+    Thread_Pool pool(N_THREADS);
+
+    std::vector<int> candidates;                                              // The image indices of the candidates
+    std::vector<double> distances(n_images, std::numeric_limits<double>::infinity());  // The distance to the nearest
+    std::vector<int> nearest(n_images, 0);                                    // The nearest candidate of every image
+
+    // Updates the distances of the images with the candidates from first_candidate on
+    auto updateDistances = [&](int first_candidate) {
+        pool.parallelFor(n_chunks, [&](int chunk, int) {
+            int end = std::min(n_images, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+
+            for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+                const MNIST_Image &image = *NCC_clusters::training_images[i];
+
+                for (int j = first_candidate; j < int(candidates.size()); j++) {
+                    double distance = NCC_clusters::metric.distance(image, *NCC_clusters::training_images[candidates[j]]);
+
+                    if (distance < distances[i]) {
+                        distances[i] = distance;
+                        nearest[i] = j;
+                    }
+                }
+            }
+        });
+    };
+
     // Select the first centroid at random
-    int first_centroid = int((*generator)() % NCC_clusters::training_images.size());
-    NCC_clusters::cluster_means.push_back(NCC_clusters::training_images.at(first_centroid));
+    candidates.push_back(int((*generator)() % n_images));
+    updateDistances(0);
 
-    progressbar p_bar((NCC_clusters::n_clusters - 1) * 60);
+    double cost = std::accumulate(distances.begin(), distances.end(), 0.0);  // The sum of the distances
 
-    // Select the remaining centroids
-    for (int i = 1; i < NCC_clusters::n_clusters; i++) {
-        // create a random part of the training images
-        auto *random_training_images = new std::vector<MNIST_Image *>;
-        random_training_images->reserve(NCC_clusters::training_images.size() / dataset_fraction);
+    // Oversample far away images in a few rounds
+    std::vector<std::vector<int>> chunk_samples(n_chunks);
 
-        // assign random images from the training images to the random training images
-        for (int j = 0; j < NCC_clusters::training_images.size() / dataset_fraction; j++) {
-            random_training_images->push_back(NCC_clusters::training_images.at((*generator)() % NCC_clusters::training_images.size()));
-        }
+    for (int round = 0; round < SEEDING_ROUNDS && cost > 0; round++) {
+        double scale = SEEDING_OVERSAMPLING * k / cost;
+        auto round_seed = (*generator)();
 
-        // Calculate the distance to the nearest centroid for each training image
-        std::vector<std::vector<double>> thread_distances;
-        thread_distances.reserve(N_THREADS);
+        pool.parallelFor(n_chunks, [&](int chunk, int) {
+            std::mt19937 chunk_generator(round_seed + chunk);
+            std::uniform_real_distribution<double> uniform(0, 1);
 
-        for (int j = 0; j < N_THREADS; ++j) {
-            thread_distances.emplace_back();
-        }
+            int end = std::min(n_images, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+            chunk_samples[chunk].clear();
 
-        // thread attributes
-        pthread_t threads[N_THREADS];
-        CentroidArgs args[N_THREADS];
+            for (int i = chunk * LLOYD_CHUNK_IMAGES; i < end; i++) {
+                if (uniform(chunk_generator) < distances[i] * scale) {
+                    chunk_samples[chunk].push_back(i);
+                }
+            }
+        });
 
-        // create the threads
-        for (int j = 0; j < N_THREADS; j++) {
-            args[j].distances = &thread_distances.at(j);
-            args[j].distances->reserve(random_training_images->size() / N_THREADS);
-            args[j].cluster_index = i;
-            args[j].thread_id = j;
-            args[j].start_index = int(j * (random_training_images->size() / N_THREADS));
-            args[j].end_index = int((j + 1) * (random_training_images->size() / N_THREADS));
-            args[j].images = random_training_images;
-            args[j].clusters = this;
+        int first_candidate = int(candidates.size());
 
-            pthread_create(&threads[j], nullptr, centroidThread, (void *) &args[j]);
+        for (auto & samples : chunk_samples) {
+            candidates.insert(candidates.end(), samples.begin(), samples.end());
         }
 
-        // join the threads
-        for (unsigned long thread : threads) {
-            pthread_join(thread, nullptr);
-        }
+        updateDistances(first_candidate);
+        cost = std::accumulate(distances.begin(), distances.end(), 0.0);
 
-        // accumulate the distances
-        std::vector<double> distances;
-        distances.reserve(random_training_images->size());
+        std::cout << "        Round " << round + 1 << ": " << std::setw(5) << candidates.size() << " candidates, cost "
+                  << std::scientific << std::setprecision(3) << cost << std::defaultfloat << std::endl;
+    }
 
-        for (int j = 0; j < N_THREADS; j++) {
-            distances.insert(distances.end(), thread_distances.at(j).begin(), thread_distances.at(j).end());
-        }
+    // Weight every candidate with the number of images nearest to it
+    int n_candidates = int(candidates.size());
+    std::vector<double> weights(n_candidates, 0);
 
-        // Find the maximum distance of all the training images from all the centroids
-        auto max_distance = std::max_element(distances.begin(), distances.end());
-        int max_distance_index = int(std::distance(distances.begin(), max_distance));
+    for (int i = 0; i < n_images; i++) {
+        weights[nearest[i]]++;
+    }
 
-        // Add the training image with the maximum distance to the cluster means
-        NCC_clusters::cluster_means.push_back(random_training_images->at(max_distance_index));
+    // Reduce the candidates to k centroids with weighted k-means++
+    std::vector<double> candidate_distances(n_candidates, std::numeric_limits<double>::infinity());
+    for (int c = 0; c < k; c++) {
+        int chosen = 0;
 
-        // Update the progress bar
-        for (int j = 0; j < 60; ++j) {
-            p_bar.update();
+        if (c == 0) {
+            chosen = std::discrete_distribution<int>(weights.begin(), weights.end())(*generator);
+
+        } else {
+            double total = 0;
+
+            for (int j = 0; j < n_candidates; j++) {
+                total += weights[j] * candidate_distances[j];
+            }
+
+            // With fewer distinct candidates than clusters the remaining centroids are random candidates
+            chosen = int((*generator)() % n_candidates);
+
+            if (total > 0) {
+                double target = std::uniform_real_distribution<double>(0, total)(*generator);
+
+                for (chosen = 0; chosen < n_candidates - 1 && target >= weights[chosen] * candidate_distances[chosen]; chosen++) {
+                    target -= weights[chosen] * candidate_distances[chosen];
+                }
+            }
         }
 
-        delete random_training_images;
+        MNIST_Image *centroid = NCC_clusters::training_images[candidates[chosen]];
+        NCC_clusters::cluster_means.push_back(centroid);
+
+        pool.parallelFor((n_candidates + LLOYD_CHUNK_IMAGES - 1) / LLOYD_CHUNK_IMAGES, [&](int chunk, int) {
+            int end = std::min(n_candidates, (chunk + 1) * LLOYD_CHUNK_IMAGES);
+
+            for (int j = chunk * LLOYD_CHUNK_IMAGES; j < end; j++) {
+                double distance = NCC_clusters::metric.distance(*centroid, *NCC_clusters::training_images[candidates[j]]);
+                candidate_distances[j] = std::min(candidate_distances[j], distance);
+            }
+        });
     }
 }
 
@@ -488,7 +1130,8 @@ void NCC_clusters::initializeCentroids(int dataset_fraction) {
  *
  * @param cluster_index Index of the cluster
  */
-void NCC_clusters::printClusterCounts(int cluster_index) {
+template <class Metric>
+void NCC_clusters<Metric>::printClusterCounts(int cluster_index) {
     // Count the number of times each label appears in the cluster
     std::vector<int> label_counts(10, 0);
 
@@ -505,3 +1148,10 @@ void NCC_clusters::printClusterCounts(int cluster_index) {
     std::cout << std::endl;
     std::cout << std::endl;
 }
+
+
+// Instantiate the classifier for every available metric
+template class NCC_clusters<L2_Metric>;
+template class NCC_clusters<L1_Metric>;
+template class NCC_clusters<Cosine_Metric>;
+template class NCC_clusters<Mahalanobis_Metric>;
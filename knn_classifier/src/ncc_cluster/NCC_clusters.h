@@ -5,15 +5,36 @@
 #include <vector>
 #include <random>
 #include "../mnist/MNIST_Image.h"
+#include "../metrics/Distance_Metrics.h"
+#include "../utils/Centroid_Matrix.h"
+#include "../utils/Centroid_Model.h"
+#include "Evaluation_Report.h"
+#include "Thread_Pool.h"
+
+
+/**
+ * The algorithms the clusters can be fitted with
+ */
+enum class KMeans_Algorithm {
+    ONLINE,      /// Every image moves its cluster mean as soon as it is assigned, on random samples of the training set
+    LLOYD,       /// Batch k-means on the whole training set, accelerated with the triangle inequality when possible
+    MINI_BATCH   /// Mini-batch k-means that stops as soon as the centers or the inertia converge
+};
+
 
+/**
+ * Nearest centroid classifier with k-means clusters. Every cluster is labeled with the most common label of its images
+ *
+ * @tparam Metric  The distance metric used to assign the images to the clusters (see metrics/Distance_Metrics.h)
+ */
+template <class Metric>
 class NCC_clusters {
 public:
     // Constructors
     NCC_clusters(int n_clusters, const std::vector<MNIST_Image *>& training_images,
-                 const std::vector<MNIST_Image *>& test_images);
+                 const std::vector<MNIST_Image *>& test_images, KMeans_Algorithm algorithm, unsigned seed);
 
-    NCC_clusters(const std::string& cluster_dir, const std::vector<MNIST_Image *>& training_images,
-                 const std::vector<MNIST_Image *>& test_images);
+    NCC_clusters(const std::string& model_path, const std::vector<MNIST_Image *>& test_images);
 
     NCC_clusters() = delete;
 
@@ -23,22 +44,22 @@ public:
     // Getters
 
     // Setters
-    void incrementCorrect();
-    void incrementIncorrect();
+    void shareStats(Classifier_Stats *shared_stats, int slot);
 
     // Functions
     int classifyImage(int test_index, bool verbose = false);
     void printStats();
+    bool saveReport(const std::string &name) const;
     void printClusterCounts(int cluster_index);
-    void saveMeanClusters();
-
-    // Friend functions
-    friend void *centroidThread(void *arg);
+    bool saveModel(const std::string &path) const;
 
 private:
     // Variables
-    std::vector<MNIST_Image *> cluster_means{};           /// The mean vector of each cluster
+    Metric metric {};                                     /// The distance metric
+    std::vector<MNIST_Image *> cluster_means{};           /// The mean vector of each cluster while fitting online
     std::vector<std::vector<MNIST_Image *>> clusters{};   /// The clusters of images
+    Centroid_Matrix centers {};                           /// The labeled cluster centers used for the classification
+    Centroid_Model *model {nullptr};                      /// The mapped model the clusters were loaded from
 
     std::vector<MNIST_Image *> training_images;   /// The training images
     std::vector<MNIST_Image *> test_images;       /// The training images
@@ -46,19 +67,30 @@ private:
     std::default_random_engine *generator;        /// The random number generator
 
     int n_clusters {0};     /// The number of clusters
-    int n_tests {0};        /// The number of tests performed
-    int n_correct {0};      /// The number of correct classifications
-    int n_incorrect {0};    /// The number of incorrect classifications
-    double accuracy {0};    /// The accuracy of the classifier
     bool from_file {false}; /// Whether the clusters were loaded from a file
 
+    Classifier_Stats own_stats {1};         /// The stats of the classifier when they are not shared
+    Classifier_Stats *stats {&own_stats};   /// The stats the classifications are recorded to
+    int stats_slot {0};                     /// The slot of the stats written by this classifier
+
     // Functions
-    void initializeCentroids(int dataset_fraction = 30);
+    void initializeCentroids();
     void fitClusters(bool is_final = false, int dataset_fraction = 60);
     void updateClusterMean(int cluster_index, MNIST_Image *image, int n_images);
-//    void detectConvergence(int cluster_index);
+    int fitLloyd();
+    int fitMiniBatch();
+    int nearestCenter(int image_index, double &distance) const;
+    void updateCenters(Thread_Pool &pool, const std::vector<float> &thread_sums, const std::vector<int> &thread_counts,
+                       std::vector<double> &movements);
+    template <class Rows>
+    int nearestRow(const Rows &rows, const MNIST_Image &image) const;
+    int assignImage(int image_index, int cluster, bool use_bounds, double &upper, double *lower,
+                    const std::vector<double> &center_distances, const std::vector<double> &half_gaps,
+                    uint64_t &n_distances) const;
+    int assignImageHamerly(int image_index, int cluster, bool use_bounds, double &upper, double &lower,
+                           const std::vector<double> &half_gaps, uint64_t &n_distances) const;
+    double distanceTo(int image_index, int center) const;
     void determineClusterLabel();
-    void calculateAccuracy();
 };
 
 #endif
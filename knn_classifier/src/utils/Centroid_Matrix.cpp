@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "Centroid_Matrix.h"
+
+
+/**
+ * Class constructor. The centroids start at zero
+ *
+ * @param n_rows  The number of centroids
+ */
+Centroid_Matrix::Centroid_Matrix(int n_rows) : n_rows(n_rows) {
+    Centroid_Matrix::values.assign(size_t(n_rows) * MNIST_IMAGE_SIZE, 0);
+    Centroid_Matrix::labels.assign(n_rows, 0);
+    Centroid_Matrix::squared_norms.assign(n_rows, 0);
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of centroids
+ *
+ * @return The number of centroids
+ */
+int Centroid_Matrix::getRowCount() const {
+    return Centroid_Matrix::n_rows;
+}
+
+/**
+ * Get the pixels of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     Pointer to the MNIST_IMAGE_SIZE pixels of the centroid
+ */
+const float *Centroid_Matrix::getRow(int row) const {
+    return Centroid_Matrix::values.data() + size_t(row) * MNIST_IMAGE_SIZE;
+}
+
+/**
+ * Get the pixels of a centroid for writing. updateNorm must be called after the pixels are changed
+ *
+ * @param row  The index of the centroid
+ * @return     Pointer to the MNIST_IMAGE_SIZE pixels of the centroid
+ */
+float *Centroid_Matrix::getRow(int row) {
+    return Centroid_Matrix::values.data() + size_t(row) * MNIST_IMAGE_SIZE;
+}
+
+/**
+ * Get the label of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     The label of the centroid
+ */
+uint8_t Centroid_Matrix::getLabel(int row) const {
+    return Centroid_Matrix::labels[row];
+}
+
+/**
+ * Get the squared norm of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     The sum of the squared pixels of the centroid
+ */
+float Centroid_Matrix::getSquaredNorm(int row) const {
+    return Centroid_Matrix::squared_norms[row];
+}
+
+/**
+ * Get a centroid as an image. The pixels are rounded to the nearest integer
+ *
+ * @param row  The index of the centroid
+ * @return     The image of the centroid
+ */
+MNIST_Image Centroid_Matrix::getImage(int row) const {
+    const float *pixels = getRow(row);
+    std::array<uint8_t, MNIST_IMAGE_SIZE> rounded {};
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        rounded[i] = uint8_t(std::min(std::max(std::lround(pixels[i]), 0L), 255L));
+    }
+
+    return MNIST_Image(getLabel(row), rounded);
+}
+
+
+// ------------- Setters ------------- //
+/**
+ * Set the label of a centroid
+ *
+ * @param row    The index of the centroid
+ * @param label  The label
+ */
+void Centroid_Matrix::setLabel(int row, uint8_t label) {
+    Centroid_Matrix::labels[row] = label;
+}
+
+/**
+ * Copy the pixels of a centroid and update its norm
+ *
+ * @param row     The index of the centroid
+ * @param pixels  The MNIST_IMAGE_SIZE pixels
+ */
+void Centroid_Matrix::setRow(int row, const float *pixels) {
+    std::copy(pixels, pixels + MNIST_IMAGE_SIZE, getRow(row));
+    updateNorm(row);
+}
+
+/**
+ * Copy the pixels and the label of an image to a centroid and update its norm
+ *
+ * @param row    The index of the centroid
+ * @param image  The image
+ */
+void Centroid_Matrix::setRow(int row, const MNIST_Image &image) {
+    const uint8_t *pixels = image.getPixelData();
+
+    std::copy(pixels, pixels + MNIST_IMAGE_SIZE, getRow(row));
+    setLabel(row, image.getLabel());
+    updateNorm(row);
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Recalculate the squared norm of a centroid after its pixels have changed
+ *
+ * @param row  The index of the centroid
+ */
+void Centroid_Matrix::updateNorm(int row) {
+    const float *pixels = getRow(row);
+    double norm = 0;
+
+    for (int i = 0; i < MNIST_IMAGE_SIZE; i++) {
+        norm += double(pixels[i]) * pixels[i];
+    }
+
+    Centroid_Matrix::squared_norms[row] = float(norm);
+}
+
+/**
+ * Save a centroid as a pgm image. The pixels are rounded to the nearest integer
+ *
+ * @param row   The index of the centroid
+ * @param name  The path of the image without the extension
+ */
+void Centroid_Matrix::saveRow(int row, const std::string &name) const {
+    getImage(row).saveImage(name);
+}
@@ -0,0 +1,52 @@
+#ifndef KNN_CLASSIFIER_CENTROID_MATRIX_H
+#define KNN_CLASSIFIER_CENTROID_MATRIX_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../mnist/MNIST_Image.h"
+
+
+/**
+ * Contiguous matrix of float centroids. Every row holds the MNIST_IMAGE_SIZE pixels of a centroid at full precision,
+ * together with the label and the squared norm of the centroid. The rows are stored back to back, so the distance
+ * kernels stream through the centroids without chasing pointers.
+ */
+class Centroid_Matrix {
+public:
+    // Constructors
+    Centroid_Matrix() = default;
+    explicit Centroid_Matrix(int n_rows);
+
+    // Destructor
+    ~Centroid_Matrix() = default;
+
+    // Getters
+    int getRowCount() const;
+    const float *getRow(int row) const;
+    float *getRow(int row);
+    uint8_t getLabel(int row) const;
+    float getSquaredNorm(int row) const;
+    MNIST_Image getImage(int row) const;
+
+    // Setters
+    void setLabel(int row, uint8_t label);
+    void setRow(int row, const float *pixels);
+    void setRow(int row, const MNIST_Image &image);
+
+    // Functions
+    void updateNorm(int row);
+    void saveRow(int row, const std::string &name) const;
+
+private:
+    // Variables
+    int n_rows {0};                       /// The number of centroids
+    std::vector<float> values {};         /// The pixels of the centroids, one row of MNIST_IMAGE_SIZE per centroid
+    std::vector<uint8_t> labels {};       /// The label of every centroid
+    std::vector<float> squared_norms {};  /// The squared norm of every centroid
+};
+
+
+#endif
@@ -0,0 +1,276 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Centroid_Model.h"
+
+#define MODEL_ALIGNMENT 64  // The alignment of the sections of a model file
+
+
+/**
+ * Class constructor. Maps a model file into memory and checks it
+ *
+ * @param path  The path of the model file
+ * @throws std::runtime_error if the file can not be mapped or is not a valid model
+ */
+Centroid_Model::Centroid_Model(const std::string &path) {
+    static_assert(sizeof(Header) == MODEL_ALIGNMENT, "The header must fill the first section");
+
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+
+    struct stat file_stat {};
+
+    if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error("Invalid model file: " + path);
+    }
+
+    Centroid_Model::mapping_size = size_t(file_stat.st_size);
+    Centroid_Model::mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    // The mapping stays valid after the file is closed
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::runtime_error("Could not map file: " + path);
+    }
+
+    const auto *data = (const uint8_t *) mapping;
+    Centroid_Model::header = (const Header *) data;
+
+    std::string error;
+
+    if (std::memcmp(header->magic, MODEL_MAGIC, sizeof(header->magic)) != 0) {
+        error = "Invalid magic number in model file: ";
+
+    } else if (header->version != MODEL_VERSION) {
+        error = "Unsupported model version " + std::to_string(header->version) + " in model file: ";
+
+    } else if (header->row_size != MNIST_IMAGE_SIZE || header->metric[sizeof(header->metric) - 1] != '\0' ||
+               layout(header->n_rows, header->n_parameters).end != mapping_size || header->payload_size != mapping_size - sizeof(Header)) {
+        error = "Invalid layout of model file: ";
+
+    } else if (checksum(data + sizeof(Header), header->payload_size) != header->checksum) {
+        error = "Checksum mismatch in model file: ";
+    }
+
+    if (!error.empty()) {
+        munmap(mapping, mapping_size);
+        throw std::runtime_error(error + path);
+    }
+
+    Layout offsets = layout(header->n_rows, header->n_parameters);
+
+    Centroid_Model::values = (const float *) (data + offsets.values);
+    Centroid_Model::norms = (const float *) (data + offsets.norms);
+    Centroid_Model::counts = (const int32_t *) (data + offsets.counts);
+    Centroid_Model::labels = data + offsets.labels;
+    Centroid_Model::parameters = (const float *) (data + offsets.parameters);
+}
+
+/**
+ * Class destructor. Unmaps the file
+ */
+Centroid_Model::~Centroid_Model() {
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of centroids
+ *
+ * @return The number of centroids
+ */
+int Centroid_Model::getRowCount() const {
+    return int(Centroid_Model::header->n_rows);
+}
+
+/**
+ * Get the pixels of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     Pointer to the MNIST_IMAGE_SIZE pixels of the centroid
+ */
+const float *Centroid_Model::getRow(int row) const {
+    return Centroid_Model::values + size_t(row) * MNIST_IMAGE_SIZE;
+}
+
+/**
+ * Get the squared norm of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     The squared norm of the centroid
+ */
+float Centroid_Model::getSquaredNorm(int row) const {
+    return Centroid_Model::norms[row];
+}
+
+/**
+ * Get the label of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     The label of the centroid
+ */
+uint8_t Centroid_Model::getLabel(int row) const {
+    return Centroid_Model::labels[row];
+}
+
+/**
+ * Get the number of training images of a centroid
+ *
+ * @param row  The index of the centroid
+ * @return     The number of training images the centroid was fitted on
+ */
+int Centroid_Model::getCount(int row) const {
+    return Centroid_Model::counts[row];
+}
+
+/**
+ * Get the name of the metric the model was fitted with
+ *
+ * @return The name of the metric
+ */
+std::string Centroid_Model::getMetric() const {
+    return std::string(Centroid_Model::header->metric);
+}
+
+/**
+ * Get the number of parameters of the metric
+ *
+ * @return The number of parameters, 0 for the metrics that learn nothing
+ */
+int Centroid_Model::getParameterCount() const {
+    return int(Centroid_Model::header->n_parameters);
+}
+
+/**
+ * Get the parameters the metric learned from the training set
+ *
+ * @return Pointer to the getParameterCount() parameters
+ */
+const float *Centroid_Model::getParameters() const {
+    return Centroid_Model::parameters;
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Save the centroids as a model file. The file is written next to the path and renamed over it, so processes that
+ * have the old model mapped keep using it and never see a partial file
+ *
+ * @param path       The path of the model file
+ * @param centroids  The centroids with their labels
+ * @param counts     The number of training images of every centroid
+ * @param metric     The name of the metric the centroids were fitted with
+ * @param parameters The parameters the metric learned from the training set
+ * @return           True if the file was written
+ */
+bool Centroid_Model::save(const std::string &path, const Centroid_Matrix &centroids, const std::vector<int> &counts,
+                          const std::string &metric, const std::vector<float> &parameters) {
+    auto n_rows = uint32_t(centroids.getRowCount());
+    auto n_parameters = uint32_t(parameters.size());
+    Layout offsets = layout(n_rows, n_parameters);
+
+    std::vector<uint8_t> data(offsets.end, 0);
+
+    for (uint32_t row = 0; row < n_rows; row++) {
+        std::memcpy(data.data() + offsets.values + size_t(row) * MNIST_IMAGE_SIZE * sizeof(float),
+                    centroids.getRow(int(row)), MNIST_IMAGE_SIZE * sizeof(float));
+
+        float norm = centroids.getSquaredNorm(int(row));
+        auto count = int32_t(counts.at(row));
+
+        std::memcpy(data.data() + offsets.norms + row * sizeof(float), &norm, sizeof(float));
+        std::memcpy(data.data() + offsets.counts + row * sizeof(int32_t), &count, sizeof(int32_t));
+        data[offsets.labels + row] = centroids.getLabel(int(row));
+    }
+
+    if (n_parameters > 0) {
+        std::memcpy(data.data() + offsets.parameters, parameters.data(), n_parameters * sizeof(float));
+    }
+
+    Header file_header {};
+    std::memcpy(file_header.magic, MODEL_MAGIC, sizeof(file_header.magic));
+    file_header.version = MODEL_VERSION;
+    file_header.n_rows = n_rows;
+    file_header.row_size = MNIST_IMAGE_SIZE;
+    file_header.n_parameters = n_parameters;
+    std::strncpy(file_header.metric, metric.c_str(), sizeof(file_header.metric) - 1);
+    file_header.payload_size = offsets.end - sizeof(Header);
+    file_header.checksum = checksum(data.data() + sizeof(Header), file_header.payload_size);
+
+    std::memcpy(data.data(), &file_header, sizeof(Header));
+
+    std::string temporary_path = path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary);
+
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file " << temporary_path << std::endl;
+        return false;
+    }
+
+    file.write((const char *) data.data(), std::streamsize(data.size()));
+    file.close();
+
+    if (!file || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Could not write the file " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Calculate the offsets of the sections of a model
+ *
+ * @param n_rows        The number of centroids
+ * @param n_parameters  The number of parameters of the metric
+ * @return              The offsets of the sections
+ */
+Centroid_Model::Layout Centroid_Model::layout(uint32_t n_rows, uint32_t n_parameters) {
+    auto align = [](size_t offset) {
+        return (offset + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+    };
+
+    Layout offsets {};
+    offsets.values = align(sizeof(Header));
+    offsets.norms = align(offsets.values + size_t(n_rows) * MNIST_IMAGE_SIZE * sizeof(float));
+    offsets.counts = align(offsets.norms + size_t(n_rows) * sizeof(float));
+    offsets.labels = align(offsets.counts + size_t(n_rows) * sizeof(int32_t));
+    offsets.parameters = align(offsets.labels + n_rows);
+    offsets.end = offsets.parameters + size_t(n_parameters) * sizeof(float);
+
+    return offsets;
+}
+
+/**
+ * Calculate the 64 bit FNV-1a hash of a block of bytes
+ *
+ * @param data  The bytes
+ * @param size  The number of bytes
+ * @return      The hash
+ */
+uint64_t Centroid_Model::checksum(const uint8_t *data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
@@ -0,0 +1,104 @@
+#ifndef KNN_CLASSIFIER_CENTROID_MODEL_H
+#define KNN_CLASSIFIER_CENTROID_MODEL_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Centroid_Matrix.h"
+
+#define MODEL_MAGIC "NCCMODEL"  // The first 8 bytes of a model file
+#define MODEL_VERSION 2         // Incremented for every change of the layout
+
+
+/**
+ * A fitted centroid model loaded from a single binary file. The file is mapped read only into memory and the
+ * centroids are used in place, so loading does not parse or copy anything and every process that loads the same
+ * model shares the same pages of the page cache.
+ *
+ * The file is a 64 byte header followed by the sections of the model, each starting at a multiple of 64 bytes:
+ *
+ *      header      magic, version, number of rows, row size, number of metric parameters, metric name, payload size
+ *                  and checksum
+ *      values      n_rows x MNIST_IMAGE_SIZE floats, the centroids
+ *      norms       n_rows floats, the squared norms of the centroids
+ *      counts      n_rows int32, the number of training images of every centroid
+ *      labels      n_rows bytes, the label of every centroid
+ *      parameters  n_parameters floats, the parameters the metric learned from the training set (see
+ *                  Distance_Metrics.h), so the model is used with the exact metric it was fitted with
+ *
+ * The checksum is the 64 bit FNV-1a hash of everything after the header. All the values are stored in the byte order
+ * of the machine that saved the model.
+ */
+class Centroid_Model {
+public:
+    // Constructors
+    explicit Centroid_Model(const std::string &path);
+
+    // Copy constructors
+    Centroid_Model(const Centroid_Model &other) = delete;
+
+    // Destructor
+    ~Centroid_Model();
+
+    // Getters
+    int getRowCount() const;
+    const float *getRow(int row) const;
+    float getSquaredNorm(int row) const;
+    uint8_t getLabel(int row) const;
+    int getCount(int row) const;
+    std::string getMetric() const;
+    int getParameterCount() const;
+    const float *getParameters() const;
+
+    // Functions
+    static bool save(const std::string &path, const Centroid_Matrix &centroids, const std::vector<int> &counts,
+                     const std::string &metric, const std::vector<float> &parameters);
+
+private:
+    /**
+     * The header of a model file
+     */
+    struct Header {
+        char magic[8];           // MODEL_MAGIC
+        uint32_t version;        // MODEL_VERSION
+        uint32_t n_rows;         // The number of centroids
+        uint32_t row_size;       // The number of values of a centroid, MNIST_IMAGE_SIZE
+        uint32_t n_parameters;   // The number of parameters of the metric
+        char metric[16];         // The name of the metric the model was fitted with, zero terminated
+        uint64_t payload_size;   // The number of bytes after the header
+        uint64_t checksum;       // The FNV-1a hash of the payload
+        uint64_t padding;        // Zero
+    };
+
+    /**
+     * The offsets of the sections of a model, from the start of the file
+     */
+    struct Layout {
+        size_t values;
+        size_t norms;
+        size_t counts;
+        size_t labels;
+        size_t parameters;
+        size_t end;
+    };
+
+    // Functions
+    static Layout layout(uint32_t n_rows, uint32_t n_parameters);
+    static uint64_t checksum(const uint8_t *data, size_t size);
+
+    // Variables
+    void *mapping {nullptr};            /// The mapped file
+    size_t mapping_size {0};            /// The size of the mapped file
+    const Header *header {nullptr};     /// The header of the model
+
+    const float *values {nullptr};      /// The centroids, in the mapping
+    const float *norms {nullptr};       /// The squared norms of the centroids, in the mapping
+    const int32_t *counts {nullptr};    /// The number of training images of every centroid, in the mapping
+    const uint8_t *labels {nullptr};    /// The labels of the centroids, in the mapping
+    const float *parameters {nullptr};  /// The parameters of the metric, in the mapping
+};
+
+
+#endif
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "Linear_Scorer.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Class constructor. All the weights and biases start at zero
+ *
+ * @param n_rows  The number of rows
+ */
+Linear_Scorer::Linear_Scorer(int n_rows) : n_rows(n_rows) {
+    Linear_Scorer::n_panels = (n_rows + SCORER_PANEL_ROWS - 1) / SCORER_PANEL_ROWS;
+
+    Linear_Scorer::panels.assign(size_t(n_panels) * MNIST_IMAGE_SIZE * SCORER_PANEL_ROWS, 0);
+    Linear_Scorer::biases.assign(n_rows, 0);
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the number of rows
+ *
+ * @return The number of rows
+ */
+int Linear_Scorer::getRowCount() const {
+    return Linear_Scorer::n_rows;
+}
+
+
+// ------------- Setters ------------- //
+/**
+ * Set the weights and the bias of a row
+ *
+ * @param row      The index of the row
+ * @param weights  The MNIST_IMAGE_SIZE weights of the row
+ * @param bias     The bias of the row
+ */
+void Linear_Scorer::setRow(int row, const float *weights, float bias) {
+    float *panel = panels.data() + size_t(row / SCORER_PANEL_ROWS) * MNIST_IMAGE_SIZE * SCORER_PANEL_ROWS;
+    int column = row % SCORER_PANEL_ROWS;
+
+    for (int k = 0; k < MNIST_IMAGE_SIZE; k++) {
+        panel[k * SCORER_PANEL_ROWS + column] = weights[k];
+    }
+
+    Linear_Scorer::biases[row] = bias;
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Find the row with the smallest score for every image of a block. Ties go to the first row
+ *
+ * @param images    The images
+ * @param n_images  The number of images
+ * @param rows      The index of the nearest row of every image
+ */
+void Linear_Scorer::nearest(const MNIST_Image *const *images, int n_images, int *rows) const {
+    Pixel_Block pixels {};
+    std::array<float, SCORER_BLOCK_IMAGES * SCORER_PANEL_ROWS> dots {};  // The dot products of a panel
+
+    for (int first = 0; first < n_images; first += SCORER_BLOCK_IMAGES) {
+        int n_block = loadBlock(images + first, n_images - first, pixels);
+
+        std::array<float, SCORER_BLOCK_IMAGES> best {};  // The smallest score of every image so far
+        best.fill(std::numeric_limits<float>::infinity());
+
+        for (int i = 0; i < n_block; i++) {
+            rows[first + i] = 0;
+        }
+
+        for (int p = 0; p < n_panels; p++) {
+            panelDots(pixels.data(), p, dots.data());
+
+            int first_row = p * SCORER_PANEL_ROWS;
+            int n_panel_rows = std::min(SCORER_PANEL_ROWS, n_rows - first_row);
+
+            for (int i = 0; i < n_block; i++) {
+                for (int j = 0; j < n_panel_rows; j++) {
+                    float score = biases[first_row + j] - dots[i * SCORER_PANEL_ROWS + j];
+
+                    if (score < best[i]) {
+                        best[i] = score;
+                        rows[first + i] = first_row + j;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Convert the pixels of up to SCORER_BLOCK_IMAGES images to floats. The missing images of the last block stay zero
+ *
+ * @param images    The images
+ * @param n_images  The number of images left
+ * @param pixels    The pixels of the block
+ * @return          The number of images of the block
+ */
+int Linear_Scorer::loadBlock(const MNIST_Image *const *images, int n_images, Pixel_Block &pixels) {
+    int n_block = std::min(SCORER_BLOCK_IMAGES, n_images);
+
+    for (int i = 0; i < n_block; i++) {
+        const uint8_t *image = images[i]->getPixelData();
+        std::copy(image, image + MNIST_IMAGE_SIZE, pixels.data() + i * MNIST_IMAGE_SIZE);
+    }
+
+    std::fill(pixels.begin() + n_block * MNIST_IMAGE_SIZE, pixels.end(), 0.0f);
+
+    return n_block;
+}
+
+/**
+ * Calculate the dot products of SCORER_BLOCK_IMAGES images with the rows of a panel
+ *
+ * @param pixels  The SCORER_BLOCK_IMAGES x MNIST_IMAGE_SIZE pixels of the images
+ * @param p       The index of the panel
+ * @param dots    The SCORER_BLOCK_IMAGES x SCORER_PANEL_ROWS dot products, row major
+ */
+void Linear_Scorer::panelDots(const float *pixels, int p, float *dots) const {
+    const float *panel = panels.data() + size_t(p) * MNIST_IMAGE_SIZE * SCORER_PANEL_ROWS;
+
+#ifdef __AVX2__
+    // 6 images x 16 rows of dot products in 12 registers, plus the 2 registers of the weights of a pixel
+    const float *x0 = pixels;
+    const float *x1 = pixels + MNIST_IMAGE_SIZE;
+    const float *x2 = pixels + 2 * MNIST_IMAGE_SIZE;
+    const float *x3 = pixels + 3 * MNIST_IMAGE_SIZE;
+    const float *x4 = pixels + 4 * MNIST_IMAGE_SIZE;
+    const float *x5 = pixels + 5 * MNIST_IMAGE_SIZE;
+
+    __m256 d00 = _mm256_setzero_ps(), d01 = _mm256_setzero_ps();
+    __m256 d10 = _mm256_setzero_ps(), d11 = _mm256_setzero_ps();
+    __m256 d20 = _mm256_setzero_ps(), d21 = _mm256_setzero_ps();
+    __m256 d30 = _mm256_setzero_ps(), d31 = _mm256_setzero_ps();
+    __m256 d40 = _mm256_setzero_ps(), d41 = _mm256_setzero_ps();
+    __m256 d50 = _mm256_setzero_ps(), d51 = _mm256_setzero_ps();
+
+    for (int k = 0; k < MNIST_IMAGE_SIZE; k++) {
+        __m256 w0 = _mm256_loadu_ps(panel + k * SCORER_PANEL_ROWS);
+        __m256 w1 = _mm256_loadu_ps(panel + k * SCORER_PANEL_ROWS + 8);
+        __m256 x;
+
+#ifdef __FMA__
+        x = _mm256_broadcast_ss(x0 + k); d00 = _mm256_fmadd_ps(x, w0, d00); d01 = _mm256_fmadd_ps(x, w1, d01);
+        x = _mm256_broadcast_ss(x1 + k); d10 = _mm256_fmadd_ps(x, w0, d10); d11 = _mm256_fmadd_ps(x, w1, d11);
+        x = _mm256_broadcast_ss(x2 + k); d20 = _mm256_fmadd_ps(x, w0, d20); d21 = _mm256_fmadd_ps(x, w1, d21);
+        x = _mm256_broadcast_ss(x3 + k); d30 = _mm256_fmadd_ps(x, w0, d30); d31 = _mm256_fmadd_ps(x, w1, d31);
+        x = _mm256_broadcast_ss(x4 + k); d40 = _mm256_fmadd_ps(x, w0, d40); d41 = _mm256_fmadd_ps(x, w1, d41);
+        x = _mm256_broadcast_ss(x5 + k); d50 = _mm256_fmadd_ps(x, w0, d50); d51 = _mm256_fmadd_ps(x, w1, d51);
+#else
+        x = _mm256_broadcast_ss(x0 + k);
+        d00 = _mm256_add_ps(d00, _mm256_mul_ps(x, w0)); d01 = _mm256_add_ps(d01, _mm256_mul_ps(x, w1));
+        x = _mm256_broadcast_ss(x1 + k);
+        d10 = _mm256_add_ps(d10, _mm256_mul_ps(x, w0)); d11 = _mm256_add_ps(d11, _mm256_mul_ps(x, w1));
+        x = _mm256_broadcast_ss(x2 + k);
+        d20 = _mm256_add_ps(d20, _mm256_mul_ps(x, w0)); d21 = _mm256_add_ps(d21, _mm256_mul_ps(x, w1));
+        x = _mm256_broadcast_ss(x3 + k);
+        d30 = _mm256_add_ps(d30, _mm256_mul_ps(x, w0)); d31 = _mm256_add_ps(d31, _mm256_mul_ps(x, w1));
+        x = _mm256_broadcast_ss(x4 + k);
+        d40 = _mm256_add_ps(d40, _mm256_mul_ps(x, w0)); d41 = _mm256_add_ps(d41, _mm256_mul_ps(x, w1));
+        x = _mm256_broadcast_ss(x5 + k);
+        d50 = _mm256_add_ps(d50, _mm256_mul_ps(x, w0)); d51 = _mm256_add_ps(d51, _mm256_mul_ps(x, w1));
+#endif
+    }
+
+    float *d = dots;
+    _mm256_storeu_ps(d, d00); _mm256_storeu_ps(d + 8, d01);
+    _mm256_storeu_ps(d + 16, d10); _mm256_storeu_ps(d + 24, d11);
+    _mm256_storeu_ps(d + 32, d20); _mm256_storeu_ps(d + 40, d21);
+    _mm256_storeu_ps(d + 48, d30); _mm256_storeu_ps(d + 56, d31);
+    _mm256_storeu_ps(d + 64, d40); _mm256_storeu_ps(d + 72, d41);
+    _mm256_storeu_ps(d + 80, d50); _mm256_storeu_ps(d + 88, d51);
+#else
+    std::fill(dots, dots + SCORER_BLOCK_IMAGES * SCORER_PANEL_ROWS, 0.0f);
+
+    for (int k = 0; k < MNIST_IMAGE_SIZE; k++) {
+        const float *w = panel + k * SCORER_PANEL_ROWS;
+
+        for (int i = 0; i < SCORER_BLOCK_IMAGES; i++) {
+            float x = pixels[i * MNIST_IMAGE_SIZE + k];
+
+            for (int j = 0; j < SCORER_PANEL_ROWS; j++) {
+                dots[i * SCORER_PANEL_ROWS + j] += x * w[j];
+            }
+        }
+    }
+#endif
+}
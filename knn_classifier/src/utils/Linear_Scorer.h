@@ -0,0 +1,63 @@
+#ifndef KNN_CLASSIFIER_LINEAR_SCORER_H
+#define KNN_CLASSIFIER_LINEAR_SCORER_H
+
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "../mnist/MNIST_Image.h"
+
+#define SCORER_PANEL_ROWS 16   // The number of rows packed together, two AVX registers of floats
+#define SCORER_BLOCK_IMAGES 6  // The number of images scored together by the register blocked kernel
+
+
+/**
+ * Scores a block of images against a set of rows with a single matrix multiplication. The score of image x against
+ * row r is
+ *
+ *      score(x, r) = bias[r] - x . weights[r]
+ *
+ * so the rows with the smallest scores are the nearest ones for every metric that can be written in this form (see
+ * linearize() in metrics/Distance_Metrics.h).
+ *
+ * The weights are packed in panels of SCORER_PANEL_ROWS rows: for every pixel the weights of the 16 rows of the panel
+ * are contiguous. The kernel keeps a SCORER_BLOCK_IMAGES x SCORER_PANEL_ROWS block of dot products in registers and
+ * streams through the pixels, so every pixel of an image is broadcast once per panel and every packed weight is used
+ * SCORER_BLOCK_IMAGES times. nearest() keeps the running minimum of every image instead of storing the scores, so
+ * it finds the nearest of any number of rows (e.g. all the prototypes of all the classes) in the same pass.
+ */
+class Linear_Scorer {
+public:
+    // Constructors
+    Linear_Scorer() = default;
+    explicit Linear_Scorer(int n_rows);
+
+    // Destructor
+    ~Linear_Scorer() = default;
+
+    // Getters
+    int getRowCount() const;
+
+    // Setters
+    void setRow(int row, const float *weights, float bias);
+
+    // Functions
+    void nearest(const MNIST_Image *const *images, int n_images, int *rows) const;
+
+private:
+    typedef std::array<float, SCORER_BLOCK_IMAGES * MNIST_IMAGE_SIZE> Pixel_Block;
+
+    // Functions
+    static int loadBlock(const MNIST_Image *const *images, int n_images, Pixel_Block &pixels);
+    void panelDots(const float *pixels, int panel, float *dots) const;
+
+    // Variables
+    int n_rows {0};                  /// The number of rows
+    int n_panels {0};                /// The number of panels, the last one is padded with zeros
+    std::vector<float> panels {};    /// The packed weights, MNIST_IMAGE_SIZE x SCORER_PANEL_ROWS values per panel
+    std::vector<float> biases {};    /// The bias of every row
+};
+
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef KNN_CLASSIFIER_RCU_POINTER_H
+#define KNN_CLASSIFIER_RCU_POINTER_H
+
+
+#include <array>
+#include <atomic>
+#include <sched.h>
+#include <vector>
+
+#define RCU_RETIRED_SNAPSHOTS 16  // The number of replaced snapshots the writer keeps before it frees them
+
+
+/**
+ * A pointer to an immutable snapshot that the readers use without locks while a writer replaces it (read-copy-update).
+ *
+ * A reader enters one of two reader counters, loads the raw pointer and leaves the counter when it is done with the
+ * snapshot. It never waits for anything. The writer swaps the pointer atomically and retires the old snapshot. The
+ * retired snapshots are freed after a grace period: the writer switches the counter the new readers enter and waits
+ * for the old one to drain, once for each counter, so every reader that could have loaded a retired pointer has left.
+ * Only the writer ever waits, and only once every RCU_RETIRED_SNAPSHOTS replacements.
+ *
+ * The writes must be serialized by the caller.
+ *
+ * @tparam T  The type of the snapshots
+ */
+template <typename T>
+class Rcu_Pointer {
+public:
+    /**
+     * A read side critical section. The snapshot stays valid until the reader is destroyed
+     */
+    class Reader {
+    public:
+        explicit Reader(const Rcu_Pointer &pointer) : pointer(pointer) {
+            phase = pointer.phase.load();
+            pointer.readers[phase].count.fetch_add(1);
+            snapshot = pointer.current.load();
+        }
+
+        Reader(const Reader &other) = delete;
+
+        ~Reader() {
+            pointer.readers[phase].count.fetch_sub(1);
+        }
+
+        const T *operator->() const {
+            return snapshot;
+        }
+
+        const T &operator*() const {
+            return *snapshot;
+        }
+
+    private:
+        const Rcu_Pointer &pointer;    /// The pointer the snapshot was loaded from
+        const T *snapshot {nullptr};   /// The snapshot
+        int phase {0};                 /// The reader counter the reader entered
+    };
+
+    // Constructors
+    Rcu_Pointer() = default;
+
+    // Copy constructors
+    Rcu_Pointer(const Rcu_Pointer &other) = delete;
+
+    // Destructor
+    ~Rcu_Pointer() {
+        delete current.load();
+
+        for (auto & snapshot : retired) {
+            delete snapshot;
+        }
+    }
+
+    // Getters
+    /**
+     * The current snapshot, without entering a reader counter. Only for the writer, which is the only one that can
+     * free it
+     *
+     * @return  The current snapshot
+     */
+    const T *getForWriter() const {
+        return current.load();
+    }
+
+    // Functions
+    /**
+     * Replace the snapshot. The old one is freed after a later grace period
+     *
+     * @param snapshot  The new snapshot, owned by the pointer from now on
+     */
+    void publish(const T *snapshot) {
+        const T *old = current.exchange(snapshot);
+
+        if (old != nullptr) {
+            retired.push_back(old);
+        }
+
+        if (retired.size() >= RCU_RETIRED_SNAPSHOTS) {
+            synchronize();
+
+            for (auto & retired_snapshot : retired) {
+                delete retired_snapshot;
+            }
+
+            retired.clear();
+        }
+    }
+
+private:
+    /**
+     * A reader counter on its own cache line
+     */
+    struct alignas(64) Reader_Count {
+        std::atomic<int> count {0};
+    };
+
+    /**
+     * Wait until every reader that entered before the call has left
+     */
+    void synchronize() {
+        for (int i = 0; i < 2; i++) {
+            int old_phase = phase.load();
+            phase.store(1 - old_phase);
+
+            while (readers[old_phase].count.load() != 0) {
+                sched_yield();
+            }
+        }
+    }
+
+    // Variables
+    std::atomic<const T *> current {nullptr};      /// The current snapshot
+    std::vector<const T *> retired {};             /// The replaced snapshots that readers may still be using
+    std::atomic<int> phase {0};                    /// The reader counter the new readers enter
+    mutable std::array<Reader_Count, 2> readers {};  /// The number of readers in every counter
+};
+
+
+#endif
@@ -1,13 +1,17 @@
 #include "Network.h"
 
+#include <algorithm>
 #include <utility>
 #include <random>
 
 #include "../include/progressbar.h"
 #include "network_functions/activation_functions.h"
 #include "network_functions/initialization_functions.h"
+#include "network_functions/matrix_functions.h"
+#include "utils/Allocation_Counter.h"
 
 #define BATCH_SIZE 600
+#define TEST_INTERVAL 10  // The network is tested every TEST_INTERVAL epochs, unless set with setTestInterval()
 
 // TODO : Detect convergence
 // TODO : Test the network after each epoch with a small subset of the test data
@@ -25,11 +29,20 @@
  * @param initialization_function  Initialization algorithm of the network
  * @param training_set             Training dataset of the network
  * @param test_set                 Test dataset of the network
+ * @param n_threads                The number of worker threads. Every batch is split in one shard per thread
+ * @param training_mode            How the workers update the weights
+ * @param mixed_precision          Whether the matrix products use bfloat16 copies of the weights and activations
+ * @param seed                     The seed of the initial weights and of the batches, 0 for a random one. The same
+ *                                 seed gives the same weights and the same synchronous batches
  */
-Network::Network(int n_layers, double l_rate, int epochs, std::vector<int>& n_perceptrons,
-                 const std::string& activation_function, const std::string& initialization_function,
-                 std::vector<MNIST_Image *> &training_set, std::vector<MNIST_Image *> &test_set) : n_layers(n_layers),
-                 layers_sizes(n_perceptrons), learning_rate(l_rate), n_epochs(epochs){
+template <typename T>
+Network<T>::Network(int n_layers, double l_rate, int epochs, const std::vector<int>& n_perceptrons,
+                    const std::string& activation_function, const std::string& initialization_function,
+                    std::vector<MNIST_Image *> &training_set, std::vector<MNIST_Image *> &test_set, int n_threads,
+                    Training_Mode training_mode, bool mixed_precision, unsigned seed) : n_layers(n_layers),
+                    layers_sizes(n_perceptrons), learning_rate(l_rate), n_epochs(epochs), test_interval(TEST_INTERVAL),
+                    training_mode(training_mode),
+                    mixed_precision(mixed_precision), seed(seed != 0 ? seed : std::random_device()()) {
 
     // Deep copy of the training and test sets  // TODO optimize this not to deep copy
     Network::training_images.reserve(training_set.size());
@@ -76,20 +89,99 @@ Network::Network(int n_layers, double l_rate, int epochs, std::vector<int>& n_pe
         }
     }
 
+    // Start the workers
+    Network::pool = new Thread_Pool(n_threads);
+    Network::n_shards = std::min(Network::pool->getThreadCount(), BATCH_SIZE);
+    Network::shard_size = (BATCH_SIZE + Network::n_shards - 1) / Network::n_shards;
+
+    // Create the arena of all the buffers of the network
+    size_t arena_size = Arena::alignedSize(size_t(BATCH_SIZE) * MNIST_IMAGE_SIZE * sizeof(T)) +
+                        Arena::alignedSize(size_t(BATCH_SIZE) * sizeof(int)) +
+                        size_t(Network::n_shards) * Arena::alignedSize(size_t(GEMM_PACKING_SIZE) * sizeof(T));
+
+    if (mixed_precision) {
+        arena_size += Arena::alignedSize(size_t(BATCH_SIZE) * MNIST_IMAGE_SIZE * sizeof(Bfloat16));
+    }
+
+    for (int i = 1; i < n_layers; i++) {
+        arena_size += Dense_Layer<T>::getArenaSize(n_perceptrons[i - 1], n_perceptrons[i], Network::shard_size,
+                                                   Network::n_shards, mixed_precision);
+    }
+
+    Network::arena = new Arena(arena_size);
+
     // Initialize the network
     initializeNetwork(n_perceptrons);
 }
 
 /**
- * Destructor of the Network class. The destructor deletes the allocated perceptrons.
+ * Destructor of the Network class. The destructor deletes the allocated layers.
+ */
+template <typename T>
+Network<T>::~Network() {
+    // Delete the layers
+    for (auto &layer : Network::network) {
+        delete layer;
+    }
+
+    delete Network::pool;
+    delete Network::arena;
+}
+
+// ====================== Functions ======================
+
+// ====================== Getters ======================
+
+/**
+ * Get the training time it took the network to reach an accuracy. The accuracy is checked at every test, so this is
+ * the training time up to the first test that reached it
+ *
+ * @param accuracy  The accuracy, from 0 to 1
+ * @return          The training time in ns, or 0 if no test reached the accuracy
  */
-Network::~Network() {
-    // Delete the perceptrons
-    for (int i = 0; i < Network::n_layers; i++) {
-        for (int j = 0; j < Network::layers_sizes.at(i); j++) {
-            delete Network::network[i][j];
+template <typename T>
+uint64_t Network<T>::getTimeToAccuracy(double accuracy) const {
+    for (auto &point : Network::accuracy_history) {
+        if (point.second >= accuracy) {
+            return point.first;
         }
     }
+
+    return 0;
+}
+
+/**
+ * Get the accuracy of the last test of the network
+ *
+ * @return  The accuracy, from 0 to 1
+ */
+template <typename T>
+double Network<T>::getAccuracy() const {
+    return Network::test_stats.getAccuracy() / 100;
+}
+
+/**
+ * Get a hidden or output layer of the network
+ *
+ * @param layer  The layer, 0 is the first hidden layer
+ * @return       The layer, owned by the network
+ */
+template <typename T>
+Dense_Layer<T> *Network<T>::getLayer(int layer) const {
+    return Network::network[layer];
+}
+
+// ====================== Setters ======================
+
+/**
+ * Set how often the network is tested during the training. The time to accuracy is only known at the tests, so a
+ * benchmark tests more often than the default TEST_INTERVAL
+ *
+ * @param epochs  The number of epochs between two tests, at least 1
+ */
+template <typename T>
+void Network<T>::setTestInterval(int epochs) {
+    Network::test_interval = std::max(1, epochs);
 }
 
 // ====================== Functions ======================
@@ -98,189 +190,172 @@ Network::~Network() {
  * Function to train the network. The function partitions the training set into mini-batches and trains the network.
  * The training is done for the number of epochs specified in the constructor. For each epoch the training set batch is
  * created with a new random order using a uniform distribution.
+ *
+ * In the synchronous mode every batch is split between the workers and the weights are updated once with the sum of
+ * their gradients. In the Hogwild mode the workers run on their own for test_interval epochs at a time: each one draws
+ * its own shards and updates the weights after every shard without waiting for the others.
  */
-void Network::trainNetwork() {
+template <typename T>
+void Network<T>::trainNetwork() {
     // Create a random generator
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd());  // Standard mersenne_twister_engine seeded with rd()
+    std::mt19937 gen(Network::seed);  // Standard mersenne_twister_engine seeded with the seed of the network
 
     // Create a uniform distribution
     std::uniform_int_distribution<> dis(0, int(Network::training_images.size()) - 1);
 
-    std::vector<int> image_indexes;  // Vector to store the indexes of the images in the batch
+    uint64_t n_allocations = 0;  // The heap allocations of the training steps, the tests are not included
+
+    Network::training_time = 0;
+    Network::accuracy_history.clear();
 
     std::cout << "Training the network..." << std::endl;
 
     // for each batch
-    for (int epoch = 0; epoch < Network::n_epochs; epoch++) {
-
-        // Create the batch
-        for (int i = 0; i < BATCH_SIZE; i++) {
-            image_indexes.push_back(dis(gen));
-        }
-
-        // Save the first image of the batch
-//        Network::training_images[image_indexes[0]]->saveImage("batch_" + std::to_string(epoch), 255);
+    for (int epoch = 0; epoch < Network::n_epochs;) {
+        uint64_t start_time = Classifier_Stats::now();
+        uint64_t start_allocations = Allocation_Counter::getCount();
 
-        std::cout << "    Epoch: " << epoch << "  ";
-        progressbar bar(BATCH_SIZE);  // Progress bar to display the progress of the training
+        if (Network::training_mode == Training_Mode::HOGWILD) {
+            // 1. The workers train on their own until the next test
+            int n_batches = std::min(Network::test_interval - epoch % Network::test_interval,
+                                     Network::n_epochs - epoch);
 
-        // for each image in the batch
-        for (auto &image_index : image_indexes) {
-            bar.update();  // Update the progress bar
+            Network::trainHogwild(n_batches, gen());
 
-            // 1. input the image to the network...
-            Network::inputImage(Network::training_images[image_index]);
+            uint64_t round_time = Classifier_Stats::now() - start_time;
+            n_allocations += Allocation_Counter::getCount() - start_allocations;
+            Network::training_time += round_time;
 
-            // ... and get the label
-            int label = Network::training_images[image_index]->getLabel();
-
-            // 2. Call the activation function of every layer starting from the input layer
-            for (int layer_idx = 0; layer_idx < Network::n_layers; layer_idx++) {
-
-                // call the activation function of every perceptron in the layer
-                for (int perceptron_idx = 0; perceptron_idx < Network::layers_sizes[layer_idx]; perceptron_idx++) {
-                    Network::network[layer_idx][perceptron_idx]->activate();
-                }
-            }
+            std::cout << "    Epochs: " << epoch << " - " << epoch + n_batches - 1 << "  "
+                      << samplesPerSecond(uint64_t(n_batches) * BATCH_SIZE, round_time)
+                      << " samples/s" << std::endl;
 
-            // 3. Use softmax to get the output layer values ...
-            std::vector<double> softmax_outputs = Softmax(Network::outputs);
+            epoch += n_batches;
 
-            // and set the output layer values
-            for (int i = 0; i < Network::layers_sizes[Network::n_layers - 1]; i++) {
-                Network::network[Network::n_layers - 1][i]->setOutput(softmax_outputs[i]);
-            }
-
-            // 4. Update the error of the output layer
-            for (int perceptron_idx = 0; perceptron_idx < Network::layers_sizes[Network::n_layers - 1]; perceptron_idx++) {
-
-                // The output layer has 10 perceptrons, one for each digit
-                if (perceptron_idx == label) {
-                    //If the index of the perceptron is equal to the label of the image then the target value is 1 ...
-                    (*Network::output_layer)[perceptron_idx]->updateError(1.0);
-
-                } else {
-                    // ...otherwise it is 0
-                    (*Network::output_layer)[perceptron_idx]->updateError(0.0);
-                }
-
-                (*Network::output_layer)[perceptron_idx]->updateGradient();
+        } else {
+            // 1. Create the batch
+            for (int i = 0; i < BATCH_SIZE; i++) {
+                Network::loadImage(i, Network::training_images[dis(gen)]);
             }
 
-            // 5. Update the errors and gradients of all the layers using the error of the output layer
-
-            // For each layer starting from the last hidden layer ....
-            for (int layer_idx = Network::n_layers - 2; layer_idx > 0; --layer_idx) {
+            int n_rows = BATCH_SIZE;
 
-                // ... and for each perceptron in each layer ...
-                for (int perceptron_idx = 0; perceptron_idx < Network::layers_sizes[layer_idx]; perceptron_idx++) {
+            // 2. Every worker passes its shard of the batch through the network and adds up the gradients of its
+            // images
+            Network::pool->parallelFor(Network::n_shards, [&](int shard, int) {
+                Network::trainShard(shard, n_rows);
+            });
 
-                    auto & perceptron = Network::network[layer_idx][perceptron_idx];  // reference to the perceptron
+            // 3. Once the batch is finished, sum the gradients of the workers and update the weights and biases
+            Network::backPropagate();
 
-                    std::vector<double> next_layer_error; // vector of the errors of the next layer
+            uint64_t epoch_time = Classifier_Stats::now() - start_time;
+            n_allocations += Allocation_Counter::getCount() - start_allocations;
+            Network::training_time += epoch_time;
 
-                    // 5.1 get the errors of the next layer
-                    for (int next_idx = 0; next_idx < Network::layers_sizes[layer_idx + 1]; next_idx++) {
-                        auto & next_layer_perceptron = Network::network[layer_idx + 1][next_idx];
-                        next_layer_error.push_back(next_layer_perceptron->getError());
-                    }
+            std::cout << "    Epoch: " << epoch << "  " << samplesPerSecond(n_rows, epoch_time) << " samples/s"
+                      << std::endl;
 
-
-                    std::vector<double> next_layer_weights;  // vector of the weights of the next layer
-
-                    // 5.2 get the weights of the next layer that connect to the current perceptron
-                    for (int next_idx = 0; next_idx < Network::layers_sizes[layer_idx + 1]; next_idx++) {
-                        auto & next_layer_perceptron = Network::network[layer_idx + 1][next_idx];
-                        next_layer_weights.push_back(next_layer_perceptron->getWeight(perceptron_idx));
-                    }
-
-                    // 5.3 update the error of the perceptron
-                    perceptron->updateError(0.0, next_layer_error, next_layer_weights);
-
-                    // 5.4 update the gradient of the perceptron
-                    perceptron->updateGradient();
-                }
-            }
+            epoch++;
         }
 
-        std::cout << std :: endl;
-
-        // 6. Once the batch is finished, update the weights and biases of the network
-        Network::backPropagate();
-
-        // 7. Clear the image indexes and repeat
-        image_indexes.clear();
-
-        // 8. Print the accuracy of the network every 10 epochs
-        if ((epoch + 1) % 10 == 0 && epoch != 0 && epoch != Network::n_epochs - 1) {
+        // Print the accuracy of the network every test_interval epochs
+        if (epoch % Network::test_interval == 0 && epoch != Network::n_epochs) {
             Network::testNetwork();
         }
     }
 
+    std::cout << std::endl << "Training throughput: "
+              << samplesPerSecond(uint64_t(Network::n_epochs) * BATCH_SIZE, Network::training_time) << " samples/s"
+              << std::endl;
+    std::cout << "Heap allocations while training: " << n_allocations << std::endl;
+
     std::cout << std::endl << std::endl << "Resulted network: " << std::endl;
-    Network::testNetwork();
+    Network::testNetwork(true);
 }
 
 /**
- * Function to test the network. The function passes the hole training set to the network.
+ * Function to test the network. The function passes the hole test set to the network, BATCH_SIZE images at a time.
+ * The latency of every image is the latency of its batch divided by the images of the batch.
+ *
+ * @param print_report  Whether to print the per class results and the confusion matrix
  */
-void Network::testNetwork() {
-    int n_correct = 0;
-    int n_wrong = 0;
+template <typename T>
+void Network<T>::testNetwork(bool print_report) {
+    Classifier_Stats stats(1);  // The results and the latency of every test image
 
     std::cout << std::endl <<  "        Testing the network:  ";
 
-    progressbar bar(int(Network::test_images.size()));  // Progress bar to display the progress of the training
+    int n_images = int(Network::test_images.size());
+    int n_batches = (n_images + BATCH_SIZE - 1) / BATCH_SIZE;
 
-    // for each image in the training set
-    for (auto & test_image : Network::test_images) {
+    progressbar bar(n_batches);  // Progress bar to display the progress of the testing
+
+    // for each batch of the test set
+    for (int first = 0; first < n_images; first += BATCH_SIZE) {
         bar.update();  // Update the progress bar
 
-        // 1. input the image to the network ...
-        Network::inputImage(test_image);
+        uint64_t start_time = Classifier_Stats::now();
 
-        // ... and get the label
-        int label = test_image->getLabel();
+        // 1. Pass the shards of the batch through the network
+        int n_rows = Network::loadBatch(Network::test_images.data() + first, n_images - first);
 
-        // 2. Call the activation function of every layer starting from the input layer
-        for (int layer_idx = 0; layer_idx < Network::n_layers; layer_idx++) {
+        Network::pool->parallelFor(Network::n_shards, [&](int shard, int) {
+            Network::forward(shard, n_rows);
+        });
 
-            // call the activation function of every perceptron in the layer
-            for (int perceptron_idx = 0; perceptron_idx < Network::layers_sizes[layer_idx]; perceptron_idx++) {
-                Network::network[layer_idx][perceptron_idx]->activate();
-            }
-        }
+        uint64_t latency = (Classifier_Stats::now() - start_time) / n_rows;
+
+        int stride = Network::network.back()->getStride();
 
-        // 3. Use softmax to get the output layer values ...
-        std::vector<double> softmax_outputs = Softmax(Network::outputs);
+        for (int r = 0; r < n_rows; r++) {
+            int shard = r / Network::shard_size;
+            const T *row = Network::network.back()->getOutputs(shard) + size_t(r % Network::shard_size) * stride;
 
-        // 3. Get the index of the maximum output
-        int max_idx = 0;
-        for (int i = 1; i < softmax_outputs.size(); i++) {
-            if (softmax_outputs[i] > softmax_outputs[max_idx]) {
-                max_idx = i;
+            // 2. Get the index of the maximum output
+            int max_idx = 0;
+            for (int i = 1; i < Network::layers_sizes[Network::n_layers - 1]; i++) {
+                if (row[i] > row[max_idx]) {
+                    max_idx = i;
+                }
             }
-        }
 
-        // 4. check if the output is correct
-        if (max_idx == label) {
-            n_correct++;
-        } else {
-            n_wrong++;
+            // 3. record the result
+            stats.recordClassification(0, uint8_t(Network::batch_labels[r]), uint8_t(max_idx), latency);
         }
     }
     std::cout << std::endl;
 
-    std::cout << "        Correct: " << n_correct << std::endl;
-    std::cout << "        Wrong: " << n_wrong << std::endl;
-    std::cout << "        Accuracy: " << double(n_correct) / (n_correct + n_wrong) << std::endl << std::endl;
+    Network::test_stats = stats.getSnapshot();
+    Network::accuracy_history.emplace_back(Network::training_time, Network::test_stats.getAccuracy() / 100);
+
+    std::cout << "        Correct: " << Network::test_stats.n_correct << std::endl;
+    std::cout << "        Wrong: " << Network::test_stats.n_incorrect << std::endl;
+    std::cout << "        Accuracy: " << Network::test_stats.getAccuracy() / 100 << std::endl << std::endl;
+
+    if (print_report) {
+        Evaluation_Report(Network::test_stats).printReport();
+        std::cout << std::endl;
+    }
+}
+
+/**
+ * Export the evaluation report (confusion matrix, per class precision, recall and latency) of the last test as JSON
+ * and CSV
+ *
+ * @param name  The path of the files without the extension
+ * @return      True if the files were written
+ */
+template <typename T>
+bool Network<T>::saveReport(const std::string &name) const {
+    return Evaluation_Report(Network::test_stats).saveReport(name);
 }
 
 /**
  * Print information about the network and the perceptrons
  */
-void Network::printNetwork() const {
+template <typename T>
+void Network<T>::printNetwork() const {
     std::cout << std::endl << "Network: " << std::endl;
     std::cout << "    Layers (" <<  Network::n_layers << "):  Input layer " << Network::layers_sizes[0] << " -> ";
     for (int i = 1; i < Network::n_layers - 1; i++) {
@@ -293,99 +368,75 @@ void Network::printNetwork() const {
     std::cout << "    Initialization function: " << Network::initialization_function << std::endl << std::endl;
     std::cout << "    Learning rate:       " << Network::learning_rate << std::endl;
     std::cout << "    Training Batch size: " << BATCH_SIZE << std::endl;
-    std::cout << "    Number of epochs:    " << Network::n_epochs << std::endl << std::endl << std::endl;
+    std::cout << "    Threads:             " << Network::pool->getThreadCount() << std::endl;
+    std::cout << "    Training mode:       "
+              << (Network::training_mode == Training_Mode::HOGWILD ? "Hogwild" : "Synchronous") << std::endl;
+    std::cout << "    Number of epochs:    " << Network::n_epochs << std::endl;
+    std::cout << "    Precision:           " << (Network::mixed_precision ? "bfloat16, " : "")
+              << (sizeof(T) == sizeof(float) ? "float32" : "float64")
+              << (Network::mixed_precision ? " master weights" : "") << std::endl;
+    std::cout << "    Memory:              " << double(Network::arena->getSize()) / (1024 * 1024) << " MiB"
+              << std::endl << std::endl << std::endl;
 
 
-//    std::cout << std::endl << "Network:" << std::endl;
-//    for (int i = 0; i < Network::n_layers; i++) {
-//        std::cout << "    Layer " << i << std::endl;
-//        for (int j = 0; j < Network::layers_sizes[i]; j++) {
-//            std::cout << "        Perceptron " << j << std::endl;
-//            Network::network[i][j]->printPerceptron();
-//        }
-//    }
 }
 
 /**
- * Initialize the network with the given parameters
+ * Initialize the network with the given parameters. Every layer after the input layer becomes a Dense_Layer. The input
+ * layer has no weights, its outputs are the normalized pixels of the image.
  *
  * @param n_perceptrons Vector of the number of perceptrons in each layer
  */
-void Network::initializeNetwork(std::vector<int>& n_perceptrons) {
-    // Reserve space for the layers
-    Network::network.reserve(Network::n_layers);
-
-    // create the layers
-    for (int i = 0; i < Network::n_layers; i++) {
-        std::vector<Perceptron *> layer;
-        for (int j = 0; j < n_perceptrons[i]; j++) {
-            if (i == 0) {
-                layer.push_back(new Perceptron(1, true));  // this is the input layer
-            } else if (i != Network::n_layers - 1) {
-                layer.push_back(new Perceptron(n_perceptrons[i - 1]));
-            } else {
-                layer.push_back(new Perceptron(n_perceptrons[i - 1], false, true));  // this is the output layer
-            }
-        }
-        Network::network.push_back(layer);
+template <typename T>
+void Network<T>::initializeNetwork(const std::vector<int>& n_perceptrons) {
+    // The inputs of the first layer
+    Network::batch_inputs = Network::arena->allocate<T>(size_t(BATCH_SIZE) * MNIST_IMAGE_SIZE);
+    Network::batch_labels = Network::arena->allocate<int>(BATCH_SIZE);
+
+    if (Network::mixed_precision) {
+        Network::batch_inputs_bf16 = Network::arena->allocate<Bfloat16>(size_t(BATCH_SIZE) * MNIST_IMAGE_SIZE);
     }
 
-    // Set the input and output layers for easy access
-    Network::input_layer = &Network::network[0];
-    Network::output_layer = &Network::network[Network::n_layers - 1];
-
-    /*
-     * Connect the input of each perceptron to the output of the previous layer. The only unconnected perceptrons are
-     * the input of the first layer and the output of the last layer. The input of the first layer is set to the image
-     * vector and the output of the last layer is the prediction.
-     */
-    for (int layer_idx = 1; layer_idx < Network::n_layers; layer_idx++) {
-        for (int perc_idx = 0; perc_idx < n_perceptrons[layer_idx]; perc_idx++) {
-            for (int k = 0; k < n_perceptrons[layer_idx - 1]; k++) {
-                Network::network[layer_idx][perc_idx]->setInput(Network::network[layer_idx - 1][k]->getOutputPtr(), k);
-            }
-        }
+    // The packing buffers of the matrix products of every worker, shared by all the layers
+    std::vector<T *> packing(Network::n_shards);
+
+    for (auto &buffer : packing) {
+        buffer = Network::arena->allocate<T>(GEMM_PACKING_SIZE);
     }
 
-    // Set the outputs
-    Network::outputs.reserve(n_perceptrons[Network::n_layers - 1]);
+    // Reserve space for the layers
+    Network::network.reserve(Network::n_layers - 1);
 
-    for (int i = 0; i < n_perceptrons[Network::n_layers - 1]; i++) {
-        Network::outputs.push_back(Network::network[Network::n_layers - 1][i]->getOutputPtr());
+    // create the layers, each one is connected to the outputs of the previous one
+    for (int i = 1; i < Network::n_layers; i++) {
+        Network::network.push_back(new Dense_Layer<T>(n_perceptrons[i - 1], n_perceptrons[i], Network::shard_size,
+                                                      packing, *Network::arena, Network::mixed_precision));
     }
 
-    // Set the activation function and the derivative for every perceptron
-    void (*activation_function_ptr)(double &, std::vector<double *> &, std::vector<double> &, double);
-    double (*derivative_function_ptr)(double);
+    // Set the activation function for every layer, it also calculates the derivatives
+    void (*activation_function_ptr)(T *, const T *, T *, int, int, int);
 
     if (activation_function == "ReLU"){
-        activation_function_ptr = ReLU;
-        derivative_function_ptr = ReLUDerivative;
+        activation_function_ptr = ReLU<T>;
 
-    } else if (activation_function == "Sigmoid"){
-        activation_function_ptr = Sigmoid;
-        derivative_function_ptr = SigmoidDerivative;
+    } else {
+        activation_function_ptr = Sigmoid<T>;
     }
 
-    // Set the activation function of each perceptron except the input and the output layer
-    for (int i = 1; i < n_layers - 1; i++) {
-        for (int j = 0; j < n_perceptrons[i]; j++) {
-            Network::network[i][j]->setActivationFunction(activation_function_ptr);
-            Network::network[i][j]->setActivationFunctionDerivative(derivative_function_ptr);
-        }
+    // Set the activation function of the hidden layers...
+    for (int i = 0; i < Network::n_layers - 2; i++) {
+        Network::network[i]->setActivationFunction(activation_function_ptr);
     }
 
-    // set the activation function derivative of the output layer
-    for (int i = 0; i < n_perceptrons[n_layers - 1]; i++) {
-        Network::network[n_layers - 1][i]->setActivationFunctionDerivative(SoftmaxDerivative);
-    }
+    // ... and the softmax of the output layer
+    Network::network.back()->setActivationFunction(Softmax<T>);
 
-    // Initialize the weights and biases of each perceptron.
+    // Initialize the weights and biases of each layer.
     if (Network::initialization_function == "Xavier"){
-        XavierInitialization(Network::network);
+        XavierInitialization(Network::network, Network::seed);
 
     } else if (Network::initialization_function == "Kaiming"){
-        KaimingInitialization(Network::network);
+        KaimingInitialization(Network::network, Network::seed);
 
     } else if (Network::initialization_function == "Zero"){
         ZeroInitialization(Network::network);
@@ -393,37 +444,177 @@ void Network::initializeNetwork(std::vector<int>& n_perceptrons) {
 }
 
 /**
- * Pass an image to the input layer. The image pixes are already normalized.
+ * Copy the normalized pixels and the labels of up to BATCH_SIZE images to the batch, one image per row
  *
- * @param image  The image to pass to the input layer
+ * @param images    The images
+ * @param n_images  The number of images left
+ * @return          The number of images of the batch
  */
-void Network::inputImage(MNIST_Image *image) {
+template <typename T>
+int Network<T>::loadBatch(MNIST_Image *const *images, int n_images) {
+    int n_rows = std::min(BATCH_SIZE, n_images);
 
-    // Set the input of the first layer to the image pixels
-    for (int i = 0; i < Network::input_layer->size(); i++) {
-        (*Network::input_layer)[i]->setInput(image->getPixelPtr(i), 0);
+    for (int r = 0; r < n_rows; r++) {
+        Network::loadImage(r, images[r]);
     }
+
+    return n_rows;
 }
 
 /**
- * Update the weights and biases of the network using the backpropagation algorithm. Every perceptron has already
- * calculated the sum of the gradients of the weights and biases so we must just update the weights and biases
- * based on the calculated gradients.
+ * Copy the normalized pixels and the label of an image to a row of the batch. In mixed precision the pixels are also
+ * rounded to the bfloat16 copy of the batch
+ *
+ * @param row    The row of the batch
+ * @param image  The image
+ */
+template <typename T>
+void Network<T>::loadImage(int row, const MNIST_Image *image) {
+    const double *pixels = image->getNormalizedPixelData();
+    std::copy(pixels, pixels + MNIST_IMAGE_SIZE, Network::batch_inputs + size_t(row) * MNIST_IMAGE_SIZE);
+
+    if (Network::mixed_precision) {
+        ConvertToBfloat16(pixels, Network::batch_inputs_bf16 + size_t(row) * MNIST_IMAGE_SIZE, MNIST_IMAGE_SIZE);
+    }
+
+    Network::batch_labels[row] = image->getLabel();
+}
+
+/**
+ * The number of images of a shard of the batch
+ *
+ * @param shard   The index of the shard
+ * @param n_rows  The number of images of the batch
+ * @return        The number of images of the shard, the last shards may be empty
+ */
+template <typename T>
+int Network<T>::getShardRows(int shard, int n_rows) const {
+    return std::max(0, std::min(Network::shard_size, n_rows - shard * Network::shard_size));
+}
+
+/**
+ * Pass a shard of the batch through the network. The normalized pixels of the images are the input of the first
+ * layer and every layer writes to the workspace of the shard. In training the output layer also calculates its errors
+ * from the labels of the shard.
+ *
+ * @param shard     The index of the shard
+ * @param n_rows    The number of images of the batch
+ * @param training  Whether to calculate the errors of the output layer
+ * @return          The softmax outputs of the output layer, one row of getStride() values per image of the shard.
+ *                  Valid until the next forward pass
  */
-void Network::backPropagate() {
-    // For each layer...
-    for (int layer_idx = 1; layer_idx < Network::n_layers; layer_idx++) {
+template <typename T>
+const T *Network<T>::forward(int shard, int n_rows, bool training) {
+    int rows = Network::getShardRows(shard, n_rows);
 
-        // ... and each perceptron in the layer...
-        for (int perc_idx = 0; perc_idx < Network::layers_sizes[layer_idx]; perc_idx++) {
+    const T *input = Network::batch_inputs + size_t(shard) * Network::shard_size * MNIST_IMAGE_SIZE;
+    const Bfloat16 *input_bf16 = nullptr;
+    int input_stride = MNIST_IMAGE_SIZE;
 
-            // ... update the weights and biases
-            Network::network[layer_idx][perc_idx]->changeWeightsAndBias(Network::learning_rate);
+    if (Network::mixed_precision) {
+        input_bf16 = Network::batch_inputs_bf16 + size_t(shard) * Network::shard_size * MNIST_IMAGE_SIZE;
+    }
+
+    if (rows == 0) {
+        return nullptr;
+    }
+
+    for (auto &layer : Network::network) {
+        if (training && layer == Network::network.back()) {
+            layer->forwardCrossEntropy(shard, input, input_stride, rows,
+                                       Network::batch_labels + size_t(shard) * Network::shard_size, input_bf16);
+        } else {
+            layer->forward(shard, input, input_stride, rows, input_bf16);
         }
+
+        input = layer->getOutputs(shard);
+        input_bf16 = layer->getBfloat16Outputs(shard);
+        input_stride = layer->getStride();
     }
+
+    return input;
 }
 
+/**
+ * Pass a shard of the batch through the network and add the gradients of its images to the workspace of the shard
+ *
+ * @param shard   The index of the shard
+ * @param n_rows  The number of images of the batch
+ */
+template <typename T>
+void Network<T>::trainShard(int shard, int n_rows) {
+    if (Network::forward(shard, n_rows, true) == nullptr) {
+        return;
+    }
 
+    // The errors of the output layer are already calculated by the forward pass, only its gradients are left
+    Network::network.back()->updateGradient(shard);
+
+    // Update the errors and gradients of the hidden layers using the errors of the next layer, starting from the last
+    // hidden layer
+    for (int layer_idx = int(Network::network.size()) - 2; layer_idx >= 0; --layer_idx) {
+        Network::network[layer_idx]->updateError(shard, *Network::network[layer_idx + 1]);
+        Network::network[layer_idx]->updateGradient(shard);
+    }
+}
 
+/**
+ * Train the network asynchronously (Hogwild). Every worker draws n_batches shards of random training images into its
+ * own rows of the batch, one after the other, and applies the gradients of every shard to the shared weights as soon
+ * as it is done with it. The workers never wait for each other until all of them are finished
+ *
+ * @param n_batches  The number of shards every worker trains on
+ * @param seed       The seed of the random generators of the workers
+ */
+template <typename T>
+void Network<T>::trainHogwild(int n_batches, unsigned seed) {
+    Network::pool->parallelFor(Network::n_shards, [&](int shard, int) {
+        std::mt19937 gen(seed + unsigned(shard));  // Every worker has its own stream of images
+        std::uniform_int_distribution<> dis(0, int(Network::training_images.size()) - 1);
+
+        int first_row = shard * Network::shard_size;
+        int rows = Network::getShardRows(shard, BATCH_SIZE);
+
+        for (int batch = 0; batch < n_batches; batch++) {
+            for (int r = 0; r < rows; r++) {
+                Network::loadImage(first_row + r, Network::training_images[dis(gen)]);
+            }
+
+            Network::trainShard(shard, BATCH_SIZE);
+
+            for (auto &layer : Network::network) {
+                layer->applyGradients(shard, Network::learning_rate);
+            }
+        }
+    });
+}
+
+/**
+ * The number of samples per second
+ *
+ * @param n_samples  The number of samples
+ * @param time_ns    The time it took to process them in ns
+ * @return           The samples per second
+ */
+template <typename T>
+double Network<T>::samplesPerSecond(uint64_t n_samples, uint64_t time_ns) {
+    return time_ns == 0 ? 0 : double(n_samples) * 1e9 / double(time_ns);
+}
+
+/**
+ * Update the weights and biases of the network using the backpropagation algorithm. Every worker has already
+ * calculated the sum of the gradients of the weights and biases of its shard, so the sums are reduced and the weights
+ * and biases are updated based on them.
+ */
+template <typename T>
+void Network<T>::backPropagate() {
+    for (auto &layer : Network::network) {
+        layer->reduceGradients(*Network::pool);
+        layer->changeWeightsAndBias(Network::learning_rate, *Network::pool);
+    }
+}
 
 
+// The two scalar types of the network
+template class Network<float>;
+template class Network<double>;
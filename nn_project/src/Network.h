@@ -1,32 +1,61 @@
 #ifndef NN_PROJECT_NETWORK_H
 #define NN_PROJECT_NETWORK_H
 
+#include <utility>
 #include <vector>
 
 #include "mnist/MNIST_Image.h"
-#include "perceptrons/Perceptron.h"
+#include "layers/Dense_Layer.h"
+#include "Evaluation_Report.h"
+#include "utils/Arena.h"
+#include "Thread_Pool.h"
 
 // TODO : Add performance metrics
 
+/**
+ * How the workers of the network update the weights
+ */
+enum class Training_Mode {
+    SYNCHRONOUS,  // The gradients of all the shards of a batch are summed and applied once
+    HOGWILD       // Every worker trains on its own stream of batches and updates the weights without locks
+};
+
+/**
+ * The network is templated on the scalar type T (float or double) of its weights, activations and gradients. The float
+ * network needs half the memory and its matrix products fit twice as many values in a SIMD register. In mixed
+ * precision the weights of type T are the master copy and the matrix products use bfloat16 copies of their operands
+ * (see layers/Dense_Layer.h).
+ */
+template <typename T>
 class Network {
 public:
     // Constructors
     Network()= delete;
-    Network (int n_layers, double l_rate, int epochs, std::vector<int>& n_perceptrons,
+    Network (int n_layers, double l_rate, int epochs, const std::vector<int>& n_perceptrons,
              const std::string& activation_function, const std::string& initialization_function,
-             std::vector<MNIST_Image *>& training_set, std::vector<MNIST_Image *>& test_set);
+             std::vector<MNIST_Image *>& training_set, std::vector<MNIST_Image *>& test_set, int n_threads = 1,
+             Training_Mode training_mode = Training_Mode::SYNCHRONOUS, bool mixed_precision = false,
+             unsigned seed = 0);
 
     // Destructor
     ~Network();
 
     // Getters
+    uint64_t getTimeToAccuracy(double accuracy) const;
+    double getAccuracy() const;
 
     // Setters
+    void setTestInterval(int epochs);
 
     // Functions
     void trainNetwork();
-    void testNetwork();
+    void testNetwork(bool print_report = false);
     void printNetwork() const;
+    bool saveReport(const std::string &name) const;
+
+protected:
+    // Getters
+    Dense_Layer<T> *getLayer(int layer) const;
 
 private:
     std::vector<MNIST_Image *> training_images {};   // Training images
@@ -35,24 +64,43 @@ private:
     int n_layers {0};                              // Number of layers
     std::vector<int> layers_sizes {0};             // Number of neurons in each layer
 
-    std::vector<std::vector<Perceptron *>> network;     // Layers of the network
-
-    std::vector<Perceptron *> *output_layer {nullptr};  // Output layer of the network
-    std::vector<Perceptron *> *input_layer {nullptr};   // Input layer of the network
-
-    std::vector<double *> outputs {};                   // Outputs of the network
+    std::vector<Dense_Layer<T> *> network;               // Hidden and output layers of the network, the input layer is the image
 
     std::string activation_function {};                 // Activation function of the network
     std::string initialization_function {};             // Initialization function of the network
 
     double learning_rate {0};                      // Learning rate of the network
     int n_epochs {0};                              // Number of epochs
+    int test_interval {0};                         // The network is tested every test_interval epochs
+
+    Thread_Pool *pool {nullptr};                   // The workers of the network
+    int n_shards {0};                              // The number of shards of a batch, one per worker
+    int shard_size {0};                            // The maximum number of images of a shard
+
+    Arena *arena {nullptr};                        // The memory of all the buffers of the network and its layers
+
+    T *batch_inputs {nullptr};                     // The normalized pixels of the images of the batch, one per row
+    Bfloat16 *batch_inputs_bf16 {nullptr};         // The bfloat16 copy of the pixels of the batch in mixed precision
+    int *batch_labels {nullptr};                   // The labels of the images of the batch
+
+    Training_Mode training_mode {Training_Mode::SYNCHRONOUS};  // How the workers update the weights
+    bool mixed_precision {false};                  // Whether the layers multiply bfloat16 copies of their operands
+    unsigned seed {0};                             // The seed of the initial weights and of the batches
+
+    Stats_Snapshot test_stats {};                  // The stats of the last test of the network
 
-    std::array<double, 10> expected_output {};     // Expected output of the network for a given image
+    uint64_t training_time {0};                    // The training time so far in ns, the tests are not included
+    std::vector<std::pair<uint64_t, double>> accuracy_history {};  // The training time and accuracy of every test
 
     // Functions
-    void initializeNetwork(std::vector<int>& n_perceptrons);
-    void inputImage(MNIST_Image *image);
+    void initializeNetwork(const std::vector<int>& n_perceptrons);
+    int loadBatch(MNIST_Image *const *images, int n_images);
+    void loadImage(int row, const MNIST_Image *image);
+    int getShardRows(int shard, int n_rows) const;
+    const T *forward(int shard, int n_rows, bool training = false);
+    void trainShard(int shard, int n_rows);
+    void trainHogwild(int n_batches, unsigned seed);
+    static double samplesPerSecond(uint64_t n_samples, uint64_t time_ns);
     void backPropagate();
 };
 
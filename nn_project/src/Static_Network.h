@@ -0,0 +1,184 @@
+#ifndef NN_PROJECT_STATIC_NETWORK_H
+#define NN_PROJECT_STATIC_NETWORK_H
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Network.h"
+#include "Classifier_Stats.h"
+#include "network_functions/fixed_matrix_functions.h"
+
+/**
+ * A Network whose topology is fixed at compile time, e.g. Static_Network<float, 784, 256, 16, 10>. The sizes of the
+ * layers are template arguments, so a topology that does not fit MNIST, or has an empty layer, does not compile, and
+ * the topology can be compared with the one a program expects (hasTopology()).
+ *
+ * The layers with at most FIXED_GEMM_MAX_OUTPUTS perceptrons (16 and 10 in the default topology) multiply with
+ * products instantiated for their sizes (see network_functions/fixed_matrix_functions.h): their loops have fixed trip
+ * counts and they skip the packing and the edge handling of the blocked products. The wide layers keep the blocked
+ * products, which are faster there, and so do all the layers in mixed precision.
+ *
+ * The template is defined in this header so that any topology can be instantiated.
+ */
+template <typename T, int... Sizes>
+class Static_Network : public Network<T> {
+    static_assert(sizeof...(Sizes) >= 2, "The network needs at least an input and an output layer");
+
+public:
+    static constexpr int n_layers = int(sizeof...(Sizes));  /// The number of layers, the input layer included
+
+    // Constructors
+    Static_Network() = delete;
+    Static_Network(double l_rate, int epochs, const std::string &activation_function,
+                   const std::string &initialization_function, std::vector<MNIST_Image *> &training_set,
+                   std::vector<MNIST_Image *> &test_set, int n_threads = 1,
+                   Training_Mode training_mode = Training_Mode::SYNCHRONOUS, bool mixed_precision = false,
+                   unsigned seed = 0);
+
+    // Getters
+    static constexpr int getLayerSize(int layer);
+    static std::vector<int> getTopology();
+    static bool hasTopology(const std::vector<int> &sizes);
+
+private:
+    static constexpr bool isValid();
+
+    template <size_t... Layers>
+    void setFixedProducts(std::index_sequence<Layers...>);
+
+    template <int N_INPUTS, int N_OUTPUTS>
+    static const Fixed_Products<T> *getFixedProducts(std::true_type);
+
+    template <int N_INPUTS, int N_OUTPUTS>
+    static const Fixed_Products<T> *getFixedProducts(std::false_type);
+};
+
+
+/**
+ * Constructor. The arguments are the ones of Network without the topology
+ *
+ * @param l_rate                   Learning rate of the network
+ * @param epochs                   Number of epochs
+ * @param activation_function      Activation function of the network
+ * @param initialization_function  Initialization function of the network
+ * @param training_set             Training set
+ * @param test_set                 Test set
+ * @param n_threads                The number of threads used for training and testing
+ * @param training_mode            How the workers update the weights
+ * @param mixed_precision          Whether the matrix products use bfloat16 copies of the weights and activations
+ * @param seed                     The seed of the initial weights and of the batches, 0 for a random one
+ */
+template <typename T, int... Sizes>
+Static_Network<T, Sizes...>::Static_Network(double l_rate, int epochs, const std::string &activation_function,
+                                            const std::string &initialization_function,
+                                            std::vector<MNIST_Image *> &training_set,
+                                            std::vector<MNIST_Image *> &test_set, int n_threads,
+                                            Training_Mode training_mode, bool mixed_precision, unsigned seed)
+        : Network<T>(n_layers, l_rate, epochs, getTopology(), activation_function, initialization_function,
+                     training_set, test_set, n_threads, training_mode, mixed_precision, seed) {
+
+    static_assert(isValid(), "The input layer must have MNIST_IMAGE_SIZE perceptrons, the output layer "
+                             "STATS_N_CLASSES and all the layers at least one");
+
+    setFixedProducts(std::make_index_sequence<n_layers - 1>());
+}
+
+/**
+ * The number of perceptrons of a layer
+ *
+ * @param layer  The layer, 0 is the input layer
+ * @return       The number of perceptrons
+ */
+template <typename T, int... Sizes>
+constexpr int Static_Network<T, Sizes...>::getLayerSize(int layer) {
+    constexpr int sizes[] = {Sizes...};
+
+    return sizes[layer];
+}
+
+/**
+ * The sizes of the layers as the vector a Network is constructed with
+ *
+ * @return  The number of perceptrons of every layer
+ */
+template <typename T, int... Sizes>
+std::vector<int> Static_Network<T, Sizes...>::getTopology() {
+    return {Sizes...};
+}
+
+/**
+ * Check if the network has the given topology
+ *
+ * @param sizes  The number of perceptrons of every layer
+ * @return       True if the sizes are the ones of the network
+ */
+template <typename T, int... Sizes>
+bool Static_Network<T, Sizes...>::hasTopology(const std::vector<int> &sizes) {
+    return sizes == getTopology();
+}
+
+/**
+ * Check the topology at compile time
+ *
+ * @return  True if the input and output layers fit MNIST and no layer is empty
+ */
+template <typename T, int... Sizes>
+constexpr bool Static_Network<T, Sizes...>::isValid() {
+    for (int i = 0; i < n_layers; i++) {
+        if (getLayerSize(i) < 1) {
+            return false;
+        }
+    }
+
+    return getLayerSize(0) == MNIST_IMAGE_SIZE && getLayerSize(n_layers - 1) == STATS_N_CLASSES;
+}
+
+/**
+ * Give every small layer the products of its sizes
+ *
+ * @param Layers  The hidden and output layers, 0 is the first hidden layer
+ */
+template <typename T, int... Sizes>
+template <size_t... Layers>
+void Static_Network<T, Sizes...>::setFixedProducts(std::index_sequence<Layers...>) {
+    const Fixed_Products<T> *products[] = {
+            getFixedProducts<getLayerSize(Layers), getLayerSize(Layers + 1)>(
+                    std::integral_constant<bool, getLayerSize(Layers + 1) <= FIXED_GEMM_MAX_OUTPUTS>())...
+    };
+
+    for (int layer = 0; layer < n_layers - 1; layer++) {
+        this->getLayer(layer)->setFixedProducts(products[layer]);
+    }
+}
+
+/**
+ * The products of a layer with at most FIXED_GEMM_MAX_OUTPUTS perceptrons
+ *
+ * @return  The products instantiated for the sizes of the layer
+ */
+template <typename T, int... Sizes>
+template <int N_INPUTS, int N_OUTPUTS>
+const Fixed_Products<T> *Static_Network<T, Sizes...>::getFixedProducts(std::true_type) {
+    static const Fixed_Products<T> products = {
+            &FixedGemmNT<T, N_OUTPUTS, N_INPUTS>,
+            &FixedGemmNN<T, N_INPUTS, N_OUTPUTS>,
+            &FixedGemmTN<T, N_OUTPUTS, N_INPUTS>
+    };
+
+    return &products;
+}
+
+/**
+ * A wide layer keeps the blocked products
+ *
+ * @return  nullptr
+ */
+template <typename T, int... Sizes>
+template <int N_INPUTS, int N_OUTPUTS>
+const Fixed_Products<T> *Static_Network<T, Sizes...>::getFixedProducts(std::false_type) {
+    return nullptr;
+}
+
+
+#endif
@@ -0,0 +1,508 @@
+#include <algorithm>
+
+#include "Dense_Layer.h"
+#include "../network_functions/activation_functions.h"
+#include "../network_functions/matrix_functions.h"
+
+
+/**
+ * Constructor of the Dense_Layer class. The weights and biases start at zero
+ *
+ * @param n_inputs         Number of inputs of the layer (the size of the previous layer)
+ * @param n_outputs        Number of perceptrons of the layer
+ * @param max_rows         The maximum number of samples of a forward pass of a workspace
+ * @param packing          The packing buffer of every worker, one workspace is created for each
+ * @param arena            The arena of the buffers of the layer, it must outlive the layer
+ * @param mixed_precision  Whether the matrix products use bfloat16 copies of their operands
+ */
+template <typename T>
+Dense_Layer<T>::Dense_Layer(int n_inputs, int n_outputs, int max_rows, const std::vector<T *> &packing,
+                            Arena &arena, bool mixed_precision) : n_inputs(n_inputs), n_outputs(n_outputs),
+                            max_rows(max_rows), mixed_precision(mixed_precision) {
+    Dense_Layer::row_size = paddedSize(n_inputs);
+    Dense_Layer::stride = paddedSize(n_outputs);
+    Dense_Layer::gradients_size = size_t(n_outputs) * row_size + stride;
+
+    Dense_Layer::weights = arena.allocate<T>(size_t(n_outputs) * row_size);
+    Dense_Layer::biases = arena.allocate<T>(n_outputs);
+
+    if (mixed_precision) {
+        Dense_Layer::weights_bf16 = arena.allocate<Bfloat16>(size_t(n_outputs) * row_size);
+    }
+
+    Dense_Layer::workspaces.resize(packing.size());
+
+    for (size_t w = 0; w < packing.size(); w++) {
+        Workspace &workspace = Dense_Layer::workspaces[w];
+
+        workspace.outputs = arena.allocate<T>(size_t(max_rows) * stride);
+        workspace.derivatives = arena.allocate<T>(size_t(max_rows) * stride);
+        workspace.errors = arena.allocate<T>(size_t(max_rows) * stride);
+        workspace.gradients = arena.allocate<T>(gradients_size);
+        workspace.packing = packing[w];
+
+        if (mixed_precision) {
+            workspace.outputs_bf16 = arena.allocate<Bfloat16>(size_t(max_rows) * stride);
+            workspace.errors_bf16 = arena.allocate<Bfloat16>(size_t(max_rows) * stride);
+        }
+    }
+}
+
+
+// ======================= Getters =======================
+
+template <typename T>
+int Dense_Layer<T>::getInputCount() const {
+    return Dense_Layer::n_inputs;
+}
+
+template <typename T>
+int Dense_Layer<T>::getOutputCount() const {
+    return Dense_Layer::n_outputs;
+}
+
+template <typename T>
+int Dense_Layer<T>::getStride() const {
+    return Dense_Layer::stride;
+}
+
+template <typename T>
+T Dense_Layer<T>::getWeight(int output, int input) const {
+    return Dense_Layer::weights[size_t(output) * row_size + input];
+}
+
+template <typename T>
+T Dense_Layer<T>::getBias(int output) const {
+    return Dense_Layer::biases[output];
+}
+
+template <typename T>
+const T *Dense_Layer<T>::getOutputs(int workspace) const {
+    return Dense_Layer::workspaces[workspace].outputs;
+}
+
+template <typename T>
+const Bfloat16 *Dense_Layer<T>::getBfloat16Outputs(int workspace) const {
+    return Dense_Layer::workspaces[workspace].outputs_bf16;
+}
+
+
+// ======================= Setters =======================
+
+template <typename T>
+void Dense_Layer<T>::setWeight(int output, int input, T weight) {
+    Dense_Layer::weights[size_t(output) * row_size + input] = weight;
+
+    if (Dense_Layer::mixed_precision) {
+        Dense_Layer::weights_bf16[size_t(output) * row_size + input] = FloatToBfloat16(float(weight));
+    }
+}
+
+template <typename T>
+void Dense_Layer<T>::setBias(int output, T bias) {
+    Dense_Layer::biases[output] = bias;
+}
+
+template <typename T>
+void Dense_Layer<T>::setActivationFunction(void (*activation_function)(T *, const T *, T *, int, int, int)) {
+    Dense_Layer::activationFunction = activation_function;
+}
+
+/**
+ * Use products instantiated for the sizes of the layer instead of the blocked ones. They must have been instantiated
+ * with n_inputs and n_outputs, and are not used in mixed precision
+ *
+ * @param products  The products, nullptr for the blocked ones
+ */
+template <typename T>
+void Dense_Layer<T>::setFixedProducts(const Fixed_Products<T> *products) {
+    Dense_Layer::fixed_products = products;
+}
+
+
+// ======================= Functions =======================
+
+/**
+ * The forward propagation function of the layer. The weighted sums of all the perceptrons for all the samples are
+ * calculated with one matrix product into the outputs and then one pass of the activation function adds the biases,
+ * applies the activation and stores its derivatives for the backward pass. In mixed precision the outputs are also
+ * rounded to bfloat16 for the next layer.
+ *
+ * @param workspace  The workspace of the calling worker
+ * @param in         The n_rows x n_inputs inputs of the layer. They must stay valid until updateGradient() is called
+ * @param in_stride  The distance between two rows of the inputs
+ * @param rows       The number of samples, at most max_rows
+ * @param in_bf16    The bfloat16 copy of the inputs with the same stride, only used in mixed precision
+ */
+template <typename T>
+void Dense_Layer<T>::forward(int workspace, const T *in, int in_stride, int rows, const Bfloat16 *in_bf16) {
+    Workspace &ws = Dense_Layer::workspaces[workspace];
+
+    Dense_Layer::weightedSums(ws, in, in_stride, rows, in_bf16);
+
+    // outputs = f(outputs + b), derivatives = f'(outputs + b)
+    Dense_Layer::activationFunction(ws.outputs, biases, ws.derivatives, rows, n_outputs, stride);
+
+    if (Dense_Layer::mixed_precision) {
+        convertRows(ws.outputs, ws.outputs_bf16, rows, n_outputs, stride);
+    }
+}
+
+/**
+ * The forward propagation function of the output layer in training. The activation of the output layer must be the
+ * softmax: the errors of the cross-entropy loss are written by the pass that normalizes the probabilities (see
+ * SoftmaxCrossEntropy() in network_functions/activation_functions.h):
+ *
+ *    δ = p - y
+ *
+ *    where:
+ *        p is the output of the perceptron, the probability of its digit
+ *        y is the target value, 1 for the perceptron of the label and 0 for the rest
+ *
+ * @param workspace  The workspace of the calling worker
+ * @param in         The n_rows x n_inputs inputs of the layer. They must stay valid until updateGradient() is called
+ * @param in_stride  The distance between two rows of the inputs
+ * @param rows       The number of samples, at most max_rows
+ * @param labels     The label of every sample
+ * @param in_bf16    The bfloat16 copy of the inputs with the same stride, only used in mixed precision
+ */
+template <typename T>
+void Dense_Layer<T>::forwardCrossEntropy(int workspace, const T *in, int in_stride, int rows, const int *labels,
+                                         const Bfloat16 *in_bf16) {
+    Workspace &ws = Dense_Layer::workspaces[workspace];
+
+    Dense_Layer::weightedSums(ws, in, in_stride, rows, in_bf16);
+
+    // outputs = softmax(outputs + b), errors = outputs - y
+    SoftmaxCrossEntropy(ws.outputs, biases, labels, ws.errors, rows, n_outputs, stride);
+
+    if (Dense_Layer::mixed_precision) {
+        convertRows(ws.errors, ws.errors_bf16, rows, n_outputs, stride);
+    }
+
+    ws.n_samples += rows;
+}
+
+/**
+ * Calculate the errors of a hidden layer for the samples of the last forward pass from the errors of the next layer:
+ *
+ *    δ = (δ_next * W_next) ⊙ f'(y)
+ *
+ *    where:
+ *        δ_next is the batch x n_next error matrix of the next layer
+ *        W_next is the n_next x n_outputs weight matrix of the next layer
+ *        f' is the derivative of the activation function, cached by forward()
+ *
+ * @param workspace   The workspace of the calling worker
+ * @param next_layer  The next layer, its errors in the same workspace must already be calculated
+ */
+template <typename T>
+void Dense_Layer<T>::updateError(int workspace, const Dense_Layer &next_layer) {
+    Workspace &ws = Dense_Layer::workspaces[workspace];
+    const Workspace &next_ws = next_layer.workspaces[workspace];
+
+    // errors = δ_next * W_next, the product of the sizes of the next layer if it has one
+    if (Dense_Layer::mixed_precision) {
+        GemmNN(ws.n_rows, n_outputs, next_layer.n_outputs, next_ws.errors_bf16, next_layer.stride,
+               next_layer.weights_bf16, next_layer.row_size, ws.errors, stride, ws.packing);
+    } else if (next_layer.fixed_products != nullptr) {
+        next_layer.fixed_products->input_errors(ws.n_rows, next_ws.errors, next_layer.stride, next_layer.weights,
+                                                next_layer.row_size, ws.errors, stride);
+    } else {
+        GemmNN(ws.n_rows, n_outputs, next_layer.n_outputs, next_ws.errors, next_layer.stride, next_layer.weights,
+               next_layer.row_size, ws.errors, stride, ws.packing);
+    }
+
+    for (int r = 0; r < ws.n_rows; r++) {
+        const T *row_derivatives = ws.derivatives + size_t(r) * stride;
+        T *row_errors = ws.errors + size_t(r) * stride;
+
+        for (int i = 0; i < Dense_Layer::n_outputs; i++) {
+            row_errors[i] *= row_derivatives[i];
+        }
+    }
+
+    if (Dense_Layer::mixed_precision) {
+        convertRows(ws.errors, ws.errors_bf16, ws.n_rows, n_outputs, stride);
+    }
+
+    ws.n_samples += ws.n_rows;
+}
+
+/**
+ * Add the gradients of the samples of the last forward pass to the gradient sums of the workspace. The averages are
+ * calculated in changeWeightsAndBias():
+ *
+ *    ∂C/∂W = δ^T * X
+ *    ∂C/∂b = Σ δ
+ *
+ *    where:
+ *        δ is the batch x n_outputs error matrix of the layer
+ *        X is the batch x n_inputs input matrix of the layer
+ *
+ * @param workspace  The workspace of the calling worker
+ */
+template <typename T>
+void Dense_Layer<T>::updateGradient(int workspace) {
+    Workspace &ws = Dense_Layer::workspaces[workspace];
+    T *bias_grad_sum = ws.gradients + size_t(n_outputs) * row_size;
+
+    // weight_grad_sum += δ^T * X
+    if (Dense_Layer::mixed_precision) {
+        GemmTN(n_outputs, n_inputs, ws.n_rows, ws.errors_bf16, stride, ws.input_bf16, ws.input_stride, ws.gradients,
+               row_size, ws.packing, true);
+    } else if (Dense_Layer::fixed_products != nullptr) {
+        fixed_products->weight_gradients(ws.n_rows, ws.errors, stride, ws.input, ws.input_stride, ws.gradients,
+                                         row_size);
+    } else {
+        GemmTN(n_outputs, n_inputs, ws.n_rows, ws.errors, stride, ws.input, ws.input_stride, ws.gradients, row_size,
+               ws.packing, true);
+    }
+
+    for (int r = 0; r < ws.n_rows; r++) {
+        const T *row_errors = ws.errors + size_t(r) * stride;
+
+        for (int j = 0; j < Dense_Layer::n_outputs; j++) {
+            bias_grad_sum[j] += row_errors[j];
+        }
+    }
+}
+
+/**
+ * Sum the gradients of all the workspaces into the first one. At every level of the tree workspace i adds the
+ * gradients of workspace i + step and clears them, so the sums end up in workspace 0 after log2(n_workspaces) levels.
+ * The pairs of a level and the chunks of their gradients are reduced in parallel. The order of the additions only
+ * depends on the number of workspaces, so the result is the same whatever thread runs what.
+ *
+ * @param pool  The pool of the workers
+ */
+template <typename T>
+void Dense_Layer<T>::reduceGradients(Thread_Pool &pool) {
+    int n_workspaces = int(Dense_Layer::workspaces.size());
+
+    for (int step = 1; step < n_workspaces; step *= 2) {
+        int n_pairs = (n_workspaces - step + 2 * step - 1) / (2 * step);  // The i = 0, 2 step, ... with i + step < n
+
+        // Split every pair in enough chunks to keep all the threads busy. The chunks are whole cache lines
+        int n_chunks = (pool.getThreadCount() + n_pairs - 1) / n_pairs;
+        size_t line = LAYER_ALIGNMENT / sizeof(T);
+        size_t chunk_size = (Dense_Layer::gradients_size / n_chunks + line - 1) / line * line;
+
+        pool.parallelFor(n_pairs * n_chunks, [&](int task, int) {
+            int i = task / n_chunks * 2 * step;
+
+            T *sums = Dense_Layer::workspaces[i].gradients;
+            T *other = Dense_Layer::workspaces[i + step].gradients;
+
+            size_t first = size_t(task % n_chunks) * chunk_size;
+            size_t last = std::min(first + chunk_size, Dense_Layer::gradients_size);
+
+            for (size_t k = first; k < last; k++) {
+                sums[k] += other[k];
+                other[k] = 0;
+            }
+        });
+
+        for (int i = 0; i + step < n_workspaces; i += 2 * step) {
+            Dense_Layer::workspaces[i].n_samples += Dense_Layer::workspaces[i + step].n_samples;
+            Dense_Layer::workspaces[i + step].n_samples = 0;
+        }
+    }
+}
+
+/**
+ * The weights and biases are updated using the gradient descent algorithm with the average of the gradients of the
+ * samples since the last update. The gradients must already be reduced to the first workspace and are reset. The rows
+ * of the weights are updated in parallel. In mixed precision the updated master weights are rounded to their bfloat16
+ * copy
+ *
+ * @param learning_rate  The learning rate of the gradient descent algorithm
+ * @param pool           The pool of the workers
+ */
+template <typename T>
+void Dense_Layer<T>::changeWeightsAndBias(double learning_rate, Thread_Pool &pool) {
+    Workspace &ws = Dense_Layer::workspaces[0];
+
+    if (ws.n_samples == 0) {
+        return;
+    }
+
+    T step = T(learning_rate / ws.n_samples);
+    T *bias_grad_sum = ws.gradients + size_t(n_outputs) * row_size;
+
+    int n_tasks = std::min(pool.getThreadCount(), Dense_Layer::n_outputs);
+    int rows_per_task = (Dense_Layer::n_outputs + n_tasks - 1) / n_tasks;
+
+    pool.parallelFor(n_tasks, [&](int task, int) {
+        int last = std::min(Dense_Layer::n_outputs, (task + 1) * rows_per_task);
+
+        for (int j = task * rows_per_task; j < last; j++) {
+            T *row = Dense_Layer::weights + size_t(j) * row_size;
+            T *grad_row = ws.gradients + size_t(j) * row_size;
+
+            for (int i = 0; i < Dense_Layer::n_inputs; i++) {
+                row[i] -= step * grad_row[i];
+                grad_row[i] = 0;
+            }
+
+            // The products of the next pass use the rounded master weights
+            if (Dense_Layer::mixed_precision) {
+                ConvertToBfloat16(row, Dense_Layer::weights_bf16 + size_t(j) * row_size, Dense_Layer::n_inputs);
+            }
+
+            Dense_Layer::biases[j] -= step * bias_grad_sum[j];
+            bias_grad_sum[j] = 0;
+        }
+    });
+
+    ws.n_samples = 0;
+}
+
+/**
+ * Apply the gradients of one workspace to the shared weights and biases without waiting for the other workers
+ * (Hogwild). The workers do not lock the weights: every weight is read and written with a relaxed atomic load and
+ * store, so a value is never torn but an update of another worker between the two may be lost. The gradients of the
+ * workspace are reset.
+ *
+ * The forward passes of the other workers read the same weights in weightedSums() with the plain and SIMD loads of
+ * GemmNT() while they are stored here. This is the data race Hogwild accepts by design: it is undefined behaviour for
+ * the C++ memory model, but the weights are naturally aligned, so on x86 every scalar of a load is either the old or
+ * the new value, and a forward pass may only see a mix of old and new weights
+ *
+ * @param workspace      The workspace of the calling worker
+ * @param learning_rate  The learning rate of the gradient descent algorithm
+ */
+template <typename T>
+void Dense_Layer<T>::applyGradients(int workspace, double learning_rate) {
+    Workspace &ws = Dense_Layer::workspaces[workspace];
+
+    if (ws.n_samples == 0) {
+        return;
+    }
+
+    T step = T(learning_rate / ws.n_samples);
+    T *bias_grad_sum = ws.gradients + size_t(n_outputs) * row_size;
+
+    for (int j = 0; j < Dense_Layer::n_outputs; j++) {
+        T *row = Dense_Layer::weights + size_t(j) * row_size;
+        T *grad_row = ws.gradients + size_t(j) * row_size;
+
+        for (int i = 0; i < Dense_Layer::n_inputs; i++) {
+            T weight;
+
+            __atomic_load(&row[i], &weight, __ATOMIC_RELAXED);
+            weight -= step * grad_row[i];
+            __atomic_store(&row[i], &weight, __ATOMIC_RELAXED);
+
+            if (Dense_Layer::mixed_precision) {
+                Bfloat16 rounded = FloatToBfloat16(float(weight));
+                __atomic_store(&Dense_Layer::weights_bf16[size_t(j) * row_size + i], &rounded, __ATOMIC_RELAXED);
+            }
+
+            grad_row[i] = 0;
+        }
+
+        T bias;
+
+        __atomic_load(&Dense_Layer::biases[j], &bias, __ATOMIC_RELAXED);
+        bias -= step * bias_grad_sum[j];
+        __atomic_store(&Dense_Layer::biases[j], &bias, __ATOMIC_RELAXED);
+
+        bias_grad_sum[j] = 0;
+    }
+
+    ws.n_samples = 0;
+}
+
+/**
+ * Calculate the weighted sums X * W^T of the samples of a forward pass into the outputs of a workspace and keep the
+ * inputs for updateGradient(). In mixed precision the product uses the bfloat16 copies of the inputs and the weights
+ *
+ * @param ws         The workspace of the calling worker
+ * @param in         The n_rows x n_inputs inputs of the layer
+ * @param in_stride  The distance between two rows of the inputs
+ * @param rows       The number of samples, at most max_rows
+ * @param in_bf16    The bfloat16 copy of the inputs with the same stride
+ */
+template <typename T>
+void Dense_Layer<T>::weightedSums(Workspace &ws, const T *in, int in_stride, int rows, const Bfloat16 *in_bf16) {
+    ws.input = in;
+    ws.input_bf16 = in_bf16;
+    ws.input_stride = in_stride;
+    ws.n_rows = rows;
+
+    // outputs = X * W^T. In the Hogwild mode other workers may store the weights meanwhile (see applyGradients())
+    if (Dense_Layer::mixed_precision) {
+        GemmNT(rows, n_outputs, n_inputs, in_bf16, in_stride, weights_bf16, row_size, ws.outputs, stride, ws.packing);
+    } else if (Dense_Layer::fixed_products != nullptr) {
+        fixed_products->weighted_sums(rows, in, in_stride, weights, row_size, ws.outputs, stride, ws.packing);
+    } else {
+        GemmNT(rows, n_outputs, n_inputs, in, in_stride, weights, row_size, ws.outputs, stride, ws.packing);
+    }
+}
+
+/**
+ * Round the first n_cols values of every row of a matrix to bfloat16
+ *
+ * @param values     The matrix
+ * @param converted  The bfloat16 matrix with the same stride
+ * @param n_rows     The number of rows
+ * @param n_cols     The number of values to convert of every row
+ * @param stride     The distance between two rows
+ */
+template <typename T>
+void Dense_Layer<T>::convertRows(const T *values, Bfloat16 *converted, int n_rows, int n_cols, int stride) {
+    for (int r = 0; r < n_rows; r++) {
+        ConvertToBfloat16(values + size_t(r) * stride, converted + size_t(r) * stride, n_cols);
+    }
+}
+
+/**
+ * Round a number of values up so that a row of them takes up a multiple of LAYER_ALIGNMENT bytes
+ *
+ * @param n_values  The number of values of the row
+ * @return          The padded number of values
+ */
+template <typename T>
+int Dense_Layer<T>::paddedSize(int n_values) {
+    const int row_alignment = LAYER_ALIGNMENT / int(sizeof(T));
+
+    return (n_values + row_alignment - 1) / row_alignment * row_alignment;
+}
+
+/**
+ * The bytes of the arena a layer needs
+ *
+ * @param n_inputs         Number of inputs of the layer
+ * @param n_outputs        Number of perceptrons of the layer
+ * @param max_rows         The maximum number of samples of a forward pass of a workspace
+ * @param n_workspaces     The number of workspaces
+ * @param mixed_precision  Whether the layer keeps bfloat16 copies of the operands of its products
+ * @return                 The size in bytes
+ */
+template <typename T>
+size_t Dense_Layer<T>::getArenaSize(int n_inputs, int n_outputs, int max_rows, int n_workspaces,
+                                    bool mixed_precision) {
+    size_t weights_size = Arena::alignedSize(size_t(n_outputs) * paddedSize(n_inputs) * sizeof(T));
+    size_t biases_size = Arena::alignedSize(size_t(n_outputs) * sizeof(T));
+
+    size_t matrix_size = Arena::alignedSize(size_t(max_rows) * paddedSize(n_outputs) * sizeof(T));
+    size_t gradients_size = Arena::alignedSize((size_t(n_outputs) * paddedSize(n_inputs) + paddedSize(n_outputs)) *
+                                               sizeof(T));
+
+    size_t size = weights_size + biases_size + size_t(n_workspaces) * (3 * matrix_size + gradients_size);
+
+    if (mixed_precision) {
+        size_t weights_bf16_size = Arena::alignedSize(size_t(n_outputs) * paddedSize(n_inputs) * sizeof(Bfloat16));
+        size_t matrix_bf16_size = Arena::alignedSize(size_t(max_rows) * paddedSize(n_outputs) * sizeof(Bfloat16));
+
+        size += weights_bf16_size + size_t(n_workspaces) * 2 * matrix_bf16_size;
+    }
+
+    return size;
+}
+
+
+// The two scalar types of the network
+template class Dense_Layer<float>;
+template class Dense_Layer<double>;
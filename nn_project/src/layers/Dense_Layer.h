@@ -0,0 +1,156 @@
+#ifndef NN_PROJECT_DENSE_LAYER_H
+#define NN_PROJECT_DENSE_LAYER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "../network_functions/bfloat16_functions.h"
+#include "../utils/Arena.h"
+#include "Thread_Pool.h"
+
+#define LAYER_ALIGNMENT ARENA_ALIGNMENT  // The alignment of the rows of the matrices of a layer in bytes (a cache line)
+
+
+/**
+ * The matrix products of a layer whose sizes are known at compile time, instantiated for the sizes of the layer (see
+ * network_functions/fixed_matrix_functions.h). They replace the blocked products of the layer, outside of mixed
+ * precision
+ */
+template <typename T>
+struct Fixed_Products {
+    void (*weighted_sums)(int, const T *, int, const T *, int, T *, int, T *);  // outputs = X * W^T
+    void (*input_errors)(int, const T *, int, const T *, int, T *, int);        // errors of the previous layer = δ * W
+    void (*weight_gradients)(int, const T *, int, const T *, int, T *, int);    // gradient sums += δ^T * X
+};
+
+/**
+ * A fully connected layer of the network. All the perceptrons of the layer are stored together and a whole batch of
+ * samples goes through the layer at once:
+ *
+ *      outputs     = f(X * W^T + b)
+ *      derivatives = f'(X * W^T + b)
+ *
+ * where X is the batch x n_inputs matrix of the inputs, one sample per row. The weights are a single
+ * n_outputs x n_inputs row major matrix and the outputs, derivatives and errors are batch x n_outputs row major
+ * matrices. Every row is padded to a multiple of LAYER_ALIGNMENT bytes and starts on its own aligned address. The
+ * forward pass, the errors and the gradients are all matrix products (see network_functions/matrix_functions.h). The
+ * matrix product writes the weighted sums straight into the outputs and one fused pass of the activation function
+ * adds the biases, applies the activation and caches its derivatives (see network_functions/activation_functions.h),
+ * so the backward pass only multiplies the errors by them. The output layer is trained with forwardCrossEntropy(),
+ * which calculates the softmax and the errors of the cross-entropy loss in the same pass.
+ *
+ * The weights and biases are shared by all the workers of the network. Everything a worker writes during a pass (the
+ * outputs, derivatives, errors and gradient sums of its shard of the batch) lives in its own workspace, so the
+ * workers never write to the same memory. reduceGradients() sums the gradients of all the workspaces into the first
+ * one with a tree reduction before the update. In the asynchronous (Hogwild) mode every worker instead applies the
+ * gradients of its workspace to the shared weights on its own with applyGradients().
+ *
+ * The layer is templated on the scalar type T (float or double) of its weights and buffers, the float layer moves
+ * half the bytes and fits twice as many values in a SIMD register.
+ *
+ * In mixed precision the weights of type T are the master copy: the updates are applied to them and every update also
+ * rounds them to a bfloat16 copy. The matrix products read the bfloat16 copy of the weights and bfloat16 copies of the
+ * inputs, outputs and errors, and accumulate in float, so they move half the bytes of a float layer. The biases, the
+ * activations and the gradient sums stay in T. bfloat16 has the exponent range of a float, so the small gradients do
+ * not underflow and the loss does not have to be scaled.
+ *
+ * All the buffers of the layer are carved out of the arena of the network at construction (getArenaSize() tells how
+ * much it needs), so the passes never allocate.
+ *
+ * Every workspace keeps a pointer to the input of its last forward pass (the outputs of the previous layer or the
+ * pixels of the shard) which is used by updateGradient().
+ *
+ * A layer of a Static_Network may get products of its own sizes with setFixedProducts(), which then replace GemmNT(),
+ * GemmNN() and GemmTN() of the layer.
+ */
+template <typename T>
+class Dense_Layer {
+public:
+    // Constructors
+    Dense_Layer() = delete;
+    Dense_Layer(int n_inputs, int n_outputs, int max_rows, const std::vector<T *> &packing, Arena &arena,
+                bool mixed_precision = false);
+
+    // Copy constructors
+    Dense_Layer(const Dense_Layer &other) = delete;
+
+    // Destructor
+    ~Dense_Layer() = default;
+
+    // Getters
+    int getInputCount() const;
+    int getOutputCount() const;
+    int getStride() const;
+    T getWeight(int output, int input) const;
+    T getBias(int output) const;
+    const T *getOutputs(int workspace) const;
+    const Bfloat16 *getBfloat16Outputs(int workspace) const;
+
+    // Setters
+    void setWeight(int output, int input, T weight);
+    void setBias(int output, T bias);
+    void setActivationFunction(void (*activation_function)(T *, const T *, T *, int, int, int));
+    void setFixedProducts(const Fixed_Products<T> *products);
+
+    // Functions
+    void forward(int workspace, const T *in, int in_stride, int n_rows, const Bfloat16 *in_bf16 = nullptr);
+    void forwardCrossEntropy(int workspace, const T *in, int in_stride, int n_rows, const int *labels,
+                             const Bfloat16 *in_bf16 = nullptr);
+    void updateError(int workspace, const Dense_Layer &next_layer);
+    void updateGradient(int workspace);
+    void reduceGradients(Thread_Pool &pool);
+    void changeWeightsAndBias(double learning_rate, Thread_Pool &pool);
+    void applyGradients(int workspace, double learning_rate);
+
+    static int paddedSize(int n_values);
+    static size_t getArenaSize(int n_inputs, int n_outputs, int max_rows, int n_workspaces,
+                               bool mixed_precision = false);
+
+private:
+    /**
+     * The buffers written by one worker
+     */
+    struct Workspace {
+        T *outputs {nullptr};                  // The outputs of the last forward pass, max_rows x stride
+        T *derivatives {nullptr};              // f'(X * W^T + b) of the last forward pass, max_rows x stride
+        T *errors {nullptr};                   // The errors (δ) of the rows of the last forward pass, max_rows x stride
+        T *gradients {nullptr};                // The weight gradient sums (n_outputs x row_size) and then the bias ones
+        T *packing {nullptr};                  // The packing buffer of the matrix products of the worker
+        Bfloat16 *outputs_bf16 {nullptr};      // The bfloat16 copy of the outputs in mixed precision
+        Bfloat16 *errors_bf16 {nullptr};       // The bfloat16 copy of the errors in mixed precision
+
+        const T *input {nullptr};              // The input of the last forward pass
+        const Bfloat16 *input_bf16 {nullptr};  // The bfloat16 copy of the input in mixed precision
+        int input_stride {0};                  // The distance between two rows of the input
+        int n_rows {0};                        // The number of rows of the last forward pass
+        int n_samples {0};                     // The number of samples since the last update
+    };
+
+    // Variables
+    int n_inputs {0};                  /// The number of inputs of the layer
+    int n_outputs {0};                 /// The number of perceptrons of the layer
+    int max_rows {0};                  /// The maximum number of rows of a forward pass of a workspace
+    int row_size {0};                  /// The number of values of a padded row of the weights
+    int stride {0};                    /// The number of values of a padded row of the outputs and the errors
+    size_t gradients_size {0};         /// The number of values of the gradients of a workspace
+
+    T *weights {nullptr};              /// The n_outputs x row_size weights
+    T *biases {nullptr};               /// The bias of every perceptron
+
+    bool mixed_precision {false};      /// Whether the matrix products use the bfloat16 copies
+    Bfloat16 *weights_bf16 {nullptr};  /// The bfloat16 copy of the weights in mixed precision
+
+    const Fixed_Products<T> *fixed_products {nullptr};  /// The products of the sizes of the layer, if there are any
+
+    std::vector<Workspace> workspaces {};  /// The buffers of every worker
+
+    // Functions
+    void weightedSums(Workspace &ws, const T *in, int in_stride, int rows, const Bfloat16 *in_bf16);
+    static void convertRows(const T *values, Bfloat16 *converted, int n_rows, int n_cols, int stride);
+
+    // Pointer to the activation function, it also calculates the derivatives
+    void (*activationFunction)(T *, const T *, T *, int, int, int) {nullptr};
+};
+
+
+#endif
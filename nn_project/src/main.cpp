@@ -1,9 +1,287 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
+#include <cstring>
+#include <memory>
+#include <thread>
 
 #include "Network.h"
+#include "Static_Network.h"
 #include "mnist/MNIST_Import.h"
 
-int main() {
+// The topology of the static network, checked and specialized at compile time. It has to match the layers of main()
+template <typename T>
+using Default_Static_Network = Static_Network<T, 784, 256, 16, 10>;
+
+#define BENCHMARK_SEED 1             // The seed of both networks of the benchmark (-b), the same initial weights
+#define BENCHMARK_LEARNING_RATE 1.0  // The learning rate of the benchmark, high enough to converge in BENCHMARK_EPOCHS
+#define BENCHMARK_EPOCHS 200         // The number of epochs of the benchmark
+#define BENCHMARK_TEST_INTERVAL 2    // The benchmark tests the networks every BENCHMARK_TEST_INTERVAL epochs
+
+#define CHECK_SEED 1               // The seed of the networks compared by the precision check (-c)
+#define CHECK_LEARNING_RATE 1.0    // The learning rate of the precision check, high enough to train in CHECK_EPOCHS
+#define CHECK_EPOCHS 100           // The number of epochs of the precision check
+#define CHECK_MIN_ACCURACY 0.5     // The accuracy the double network must reach for the check to be meaningful
+
+/**
+ * Train and test a network, or benchmark the time to accuracy of the two training modes
+ *
+ * @param new_network      Creates a network with the given training mode. Both networks of the benchmark must have
+ *                         the same seed
+ * @param epochs           The number of epochs
+ * @param training_mode    The training mode, unless benchmarking
+ * @param target_accuracy  The accuracy of the benchmark, negative if there is no benchmark
+ * @param report_name      The name of the evaluation report files, empty if there is no report
+ * @return                 0
+ */
+template <typename Net, typename Factory>
+static int trainAndTest(const Factory &new_network, int epochs, Training_Mode training_mode, double target_accuracy,
+                        const std::string &report_name) {
+    // Benchmark the time to accuracy of the two training modes
+    if (target_accuracy > 0) {
+        std::array<uint64_t, 2> times {};
+        std::array<Training_Mode, 2> modes {Training_Mode::SYNCHRONOUS, Training_Mode::HOGWILD};
+
+        for (int i = 0; i < 2; i++) {
+            std::unique_ptr<Net> network(new_network(modes[i]));
+
+            network->setTestInterval(BENCHMARK_TEST_INTERVAL);  // The time to accuracy is only known at the tests
+            network->printNetwork();
+            network->trainNetwork();
+
+            times[i] = network->getTimeToAccuracy(target_accuracy);
+        }
+
+        std::cout << std::endl << "Training time to reach an accuracy of " << target_accuracy << ":" << std::endl;
+
+        for (int i = 0; i < 2; i++) {
+            std::cout << "    " << (modes[i] == Training_Mode::HOGWILD ? "Hogwild:     " : "Synchronous: ");
+
+            if (times[i] == 0) {
+                std::cout << "not reached in " << epochs << " epochs" << std::endl;
+            } else {
+                std::cout << double(times[i]) / 1e9 << " s" << std::endl;
+            }
+        }
+
+        return 0;
+    }
+
+    std::unique_ptr<Net> network(new_network(training_mode));
+
+    network->printNetwork();  // Print information about the network
+
+    network->trainNetwork();  // Train the network. Testing is done automatically during training
+
+    // Export the evaluation report of the final test if requested
+    if (!report_name.empty() && network->saveReport(report_name)) {
+        std::cout << "Report saved as " << report_name << ".json and " << report_name << ".csv" << std::endl;
+    }
+
+    return 0;
+}
+
+/**
+ * Train and test a dynamic or a static network with the given scalar type. The benchmark replaces the learning rate
+ * and the number of epochs with its own settings and creates both networks from BENCHMARK_SEED
+ *
+ * @param layers           The number of perceptrons of every layer
+ * @param l_rate           The learning rate
+ * @param epochs           The number of epochs
+ * @param training_images  The training set
+ * @param test_images      The test set
+ * @param n_threads        The number of threads
+ * @param training_mode    The training mode, unless benchmarking
+ * @param target_accuracy  The accuracy of the benchmark, negative if there is no benchmark
+ * @param report_name      The name of the evaluation report files, empty if there is no report
+ * @param mixed_precision  Whether the matrix products use bfloat16 copies of the weights and activations
+ * @param static_topology  Whether to use Default_Static_Network, the topology fixed at compile time
+ * @return                 0, or 1 if the layers are not the ones of the static network
+ */
+template <typename T>
+static int run(std::vector<int> &layers, double l_rate, int epochs, std::vector<MNIST_Image *> &training_images,
+               std::vector<MNIST_Image *> &test_images, int n_threads, Training_Mode training_mode,
+               double target_accuracy, const std::string &report_name, bool mixed_precision, bool static_topology) {
+    unsigned seed = 0;  // A random seed, unless benchmarking
+
+    if (target_accuracy > 0) {
+        l_rate = BENCHMARK_LEARNING_RATE;
+        epochs = BENCHMARK_EPOCHS;
+        seed = BENCHMARK_SEED;
+    }
+
+    if (static_topology) {
+        if (!Default_Static_Network<T>::hasTopology(layers)) {
+            std::cerr << "The layers do not match the topology of the static network" << std::endl;
+            return 1;
+        }
+
+        auto new_network = [&](Training_Mode mode) {
+            return new Default_Static_Network<T>(l_rate, epochs, "Sigmoid", "Xavier", training_images, test_images,
+                                                 n_threads, mode, mixed_precision, seed);
+        };
+
+        return trainAndTest<Default_Static_Network<T>>(new_network, epochs, training_mode, target_accuracy,
+                                                       report_name);
+    }
+
+    auto new_network = [&](Training_Mode mode) {
+        return new Network<T>(int(layers.size()), l_rate, epochs, layers, "Sigmoid", "Xavier", training_images,
+                              test_images, n_threads, mode, mixed_precision, seed);
+    };
+
+    return trainAndTest<Network<T>>(new_network, epochs, training_mode, target_accuracy, report_name);
+}
+
+/**
+ * Check that a float network reaches an accuracy comparable to the double one: both are trained synchronously from the
+ * same seed, so they start from the same weights (rounded to float) and see the same batches, and only the precision
+ * of the arithmetic differs. The check trains with its own learning rate and number of epochs, so the networks learn
+ * instead of staying at chance level where any two accuracies would agree, and fails if the double network does not
+ * reach CHECK_MIN_ACCURACY
+ *
+ * @param layers           The number of perceptrons of every layer
+ * @param training_images  The training set
+ * @param test_images      The test set
+ * @param n_threads        The number of threads
+ * @param mixed_precision  Whether the float network uses bfloat16 matrix products
+ * @param tolerance        The largest accepted difference of the final accuracies (0 to 1)
+ * @return                 0 if the double network trained and the accuracies are within the tolerance, 1 otherwise
+ */
+static int checkFloatAccuracy(std::vector<int> &layers, std::vector<MNIST_Image *> &training_images,
+                              std::vector<MNIST_Image *> &test_images, int n_threads, bool mixed_precision,
+                              double tolerance) {
+    Network<double> double_network(int(layers.size()), CHECK_LEARNING_RATE, CHECK_EPOCHS, layers, "Sigmoid", "Xavier",
+                                   training_images, test_images, n_threads, Training_Mode::SYNCHRONOUS, false,
+                                   CHECK_SEED);
+
+    double_network.printNetwork();
+    double_network.trainNetwork();
+
+    Network<float> float_network(int(layers.size()), CHECK_LEARNING_RATE, CHECK_EPOCHS, layers, "Sigmoid", "Xavier",
+                                 training_images, test_images, n_threads, Training_Mode::SYNCHRONOUS, mixed_precision,
+                                 CHECK_SEED);
+
+    float_network.printNetwork();
+    float_network.trainNetwork();
+
+    double difference = std::abs(double_network.getAccuracy() - float_network.getAccuracy());
+
+    std::cout << std::endl << "Final accuracy:" << std::endl;
+    std::cout << "    double: " << double_network.getAccuracy() << std::endl;
+    std::cout << "    " << (mixed_precision ? "bf16:   " : "float:  ") << float_network.getAccuracy() << std::endl;
+    std::cout << "    Difference: " << difference << " (tolerance " << tolerance << ")" << std::endl;
+
+    if (double_network.getAccuracy() < CHECK_MIN_ACCURACY) {
+        std::cerr << "The double network did not reach an accuracy of " << CHECK_MIN_ACCURACY << std::endl;
+        return 1;
+    }
+
+    if (difference > tolerance) {
+        std::cerr << "The accuracies differ by more than the tolerance" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Main function trains and tests the network.
+ *
+ * Optional arguments:
+ *   -r The name of the evaluation report files of the final test (<name>.json and <name>.csv)
+ *   -t The number of threads used for training and testing (default: the number of cores)
+ *   -m The training mode: sync (default) or hogwild
+ *   -b Benchmark: train a synchronous and a Hogwild network from the same seed with the settings of the benchmark and
+ *      compare the training time they take to reach the given test accuracy (0 to 1)
+ *   -p The precision of the network: double (default), float, or bf16 (bfloat16 matrix products with float master
+ *      weights)
+ *   -s Use the static network: the topology is checked at compile time and the small layers use matrix products
+ *      instantiated for their sizes (see Static_Network.h)
+ *   -c Check the float network: train a double and a float network (bf16 with -p bf16) from the same seed with the
+ *      settings of the check and fail if the double network does not learn or their final accuracies differ by more
+ *      than the given tolerance (0 to 1)
+ *
+ * ./main -r report -t 8 -m hogwild -p float -s
+ * ./main -t 8 -b 0.8
+ * ./main -c 0.02
+ *
+ * @return 0, or 1 for invalid arguments or a failed check
+ */
+int main(int argc, char *argv[]) {
+    std::string report_name;
+    int n_threads = std::max(1, int(std::thread::hardware_concurrency()));
+    Training_Mode training_mode = Training_Mode::SYNCHRONOUS;
+    double target_accuracy = -1;  // The accuracy of the benchmark, negative if there is no benchmark
+    bool use_float = false;       // Whether the network uses floats instead of doubles
+    bool mixed_precision = false; // Whether the matrix products use bfloat16
+    bool static_topology = false; // Whether to use the network with the topology fixed at compile time
+    double tolerance = -1;        // The tolerance of the precision check, negative if there is no check
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            report_name = argv[++i];
+
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            n_threads = std::stoi(argv[++i]);
+
+            if (n_threads < 1 || n_threads > 256) {
+                std::cerr << "The number of threads must be greater than 0 and less than 256" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            std::string mode = argv[++i];
+
+            if (mode == "sync") {
+                training_mode = Training_Mode::SYNCHRONOUS;
+
+            } else if (mode == "hogwild") {
+                training_mode = Training_Mode::HOGWILD;
+
+            } else {
+                std::cerr << "The training mode must be sync or hogwild" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            target_accuracy = std::stod(argv[++i]);
+
+            if (target_accuracy <= 0 || target_accuracy > 1) {
+                std::cerr << "The benchmark accuracy must be greater than 0 and at most 1" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            std::string precision = argv[++i];
+
+            if (precision == "float" || precision == "double" || precision == "bf16") {
+                use_float = precision != "double";
+                mixed_precision = precision == "bf16";
+
+            } else {
+                std::cerr << "The precision must be double, float or bf16" << std::endl;
+                return 1;
+            }
+
+        } else if (strcmp(argv[i], "-s") == 0) {
+            static_topology = true;
+
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            tolerance = std::stod(argv[++i]);
+
+            if (tolerance < 0 || tolerance > 1) {
+                std::cerr << "The tolerance of the precision check must be from 0 to 1" << std::endl;
+                return 1;
+            }
+
+        } else {
+            std::cerr << "Invalid argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
     // Import the MNIST dataset
     MNIST_Import mnist(
             "data/train-images.idx3-ubyte",
@@ -33,16 +311,21 @@ int main() {
     // Create the network
 
     // The network must have 784 input neurons and 10 output neurons. The hidden layers can be any number of neurons.
+    // The static network (-s) has the topology of Default_Static_Network, change both together.
     std::vector<int> layers = {784, 256, 16, 10};
 
     double l_rate = 0.001;  // The learning rate
     int epochs = 20;        // The number of epochs to train the network
 
-    Network network(int(layers.size()), l_rate, epochs, layers, "Sigmoid", "Xavier", training_images, test_images);
-
-    network.printNetwork();  // Print information about the network
+    if (tolerance >= 0) {
+        return checkFloatAccuracy(layers, training_images, test_images, n_threads, mixed_precision, tolerance);
+    }
 
-    network.trainNetwork();  // Train the network. Testing is done automatically during training
+    if (use_float) {
+        return run<float>(layers, l_rate, epochs, training_images, test_images, n_threads, training_mode,
+                          target_accuracy, report_name, mixed_precision, static_topology);
+    }
 
-    return 0;
+    return run<double>(layers, l_rate, epochs, training_images, test_images, n_threads, training_mode, target_accuracy,
+                       report_name, false, static_topology);
 }
@@ -177,6 +177,15 @@ double *MNIST_Image::getPixelPtr(int index) {
     return &(MNIST_Image::normalized_pixels.at(index));
 }
 
+/**
+ * Get a pointer to the MNIST_IMAGE_SIZE contiguous normalized pixels of the image
+ *
+ * @return The normalized pixels
+ */
+const double *MNIST_Image::getNormalizedPixelData() const {
+    return MNIST_Image::normalized_pixels.data();
+}
+
 double MNIST_Image::getNormalizedPixel(int index) const {
     return MNIST_Image::normalized_pixels.at(index);
 }
@@ -23,6 +23,7 @@ public:
     // Getters
     uint8_t getLabel() const;
     double* getPixelPtr(int index);
+    const double *getNormalizedPixelData() const;
     uint8_t getPixel(int index) const;
     std::array<uint8_t, MNIST_IMAGE_SIZE> getPixels() const;
 
@@ -1,71 +1,550 @@
 #include "activation_functions.h"
 
-#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define EXP_MAX 709.0    // exp(x) of larger x overflows a double
+#define EXP_MIN (-708.0) // exp(x) of smaller x is subnormal
+#define EXP_MAX_FLOAT 88.0f    // exp(x) of larger x overflows a float
+#define EXP_MIN_FLOAT (-87.0f) // exp(x) of smaller x is subnormal
+
+/*
+ * exp(x) is reduced to exp(x) = 2^n * exp(r) with n = round(x / ln2) and |r| <= ln2 / 2. exp(r) is its Taylor
+ * polynomial of degree 11, whose truncation error is below r^12 / 12! < 7e-15 relative, and 2^n is built directly in
+ * the exponent bits. ln2 is split in a high and a low part so that r is exact. x is clamped to [EXP_MIN, EXP_MAX], so
+ * there are no infinities or subnormals.
+ */
+static const double LOG2_E = 1.4426950408889634;        // 1 / ln2
+static const double LN2_HI = 6.93147180369123816490e-01; // The high bits of ln2, n * LN2_HI is exact
+static const double LN2_LO = 1.90821492927058770002e-10; // ln2 - LN2_HI
+static const double SHIFTER = 6755399441055744.0;       // 1.5 * 2^52, adding it rounds to an integer in the low bits
+
+static const double EXP_COEFFICIENTS[12] = {
+        1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320, 1.0 / 362880,
+        1.0 / 3628800, 1.0 / 39916800
+};
+
+/*
+ * The float version is the same with a polynomial of degree 7, whose truncation error (< 6e-9) is below the rounding
+ * error of a float.
+ */
+static const float LN2_HI_FLOAT = 0.693145751953125f;      // The high bits of ln2, n * LN2_HI_FLOAT is exact
+static const float LN2_LO_FLOAT = 1.428606765330187e-06f;  // ln2 - LN2_HI_FLOAT
+static const float SHIFTER_FLOAT = 12582912.0f;           // 1.5 * 2^23
+
+static const float EXP_COEFFICIENTS_FLOAT[8] = {
+        1.0f, 1.0f, 1.0f / 2, 1.0f / 6, 1.0f / 24, 1.0f / 120, 1.0f / 720, 1.0f / 5040
+};
+
 
 /**
- * Sigmoid activation function
+ * Scalar version of the exp approximation, used for the values that do not fill a vector
  *
- * @param output   Output of the perceptron
- * @param inputs   Inputs of the perceptron
- * @param weights  Weights of the perceptron
- * @param bias     Bias of the perceptron
+ * @param x  The exponent
+ * @return   exp(x)
  */
-void Sigmoid(double &output, std::vector<double *> &inputs, std::vector<double> &weights, double bias){
-    double sum = 0;
-    for (int i = 0; i < inputs.size(); ++i) {
-        sum += *(inputs[i]) * weights[i];
+static inline double fastExp(double x) {
+    x = x > EXP_MAX ? EXP_MAX : (x < EXP_MIN ? EXP_MIN : x);
+
+    double n = (x * LOG2_E + SHIFTER) - SHIFTER;  // round(x / ln2)
+    double r = (x - n * LN2_HI) - n * LN2_LO;
+
+    double p = EXP_COEFFICIENTS[11];
+    for (int i = 10; i >= 0; i--) {
+        p = p * r + EXP_COEFFICIENTS[i];
     }
-    sum += bias;
-    output = 1 / (1 + exp(-sum));
+
+    // 2^n from the exponent bits
+    uint64_t bits = uint64_t(int64_t(n) + 1023) << 52;
+    double scale;
+    memcpy(&scale, &bits, sizeof(scale));
+
+    return p * scale;
 }
 
+#ifdef __AVX2__
 /**
- * ReLU activation function
+ * AVX2 version of the exp approximation for 4 values
  *
- * @param output   Output of the perceptron
- * @param inputs   Inputs of the perceptron
- * @param weights  Weights of the perceptron
- * @param bias     Bias of the perceptron
+ * @param x  The exponents
+ * @return   exp(x)
  */
-void ReLU(double &output, std::vector<double *> &inputs, std::vector<double> &weights, double bias){
-    double sum = 0;
-    for (int i = 0; i < inputs.size(); ++i) {
-        sum += *(inputs[i]) * weights[i];
+static inline __m256d fastExp(__m256d x) {
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(EXP_MIN)), _mm256_set1_pd(EXP_MAX));
+
+    const __m256d shifter = _mm256_set1_pd(SHIFTER);
+
+    // round(x / ln2), its integer value is in the low bits of shifted
+    __m256d shifted = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2_E)), shifter);
+    __m256d n = _mm256_sub_pd(shifted, shifter);
+
+#ifdef __FMA__
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+
+    __m256d p = _mm256_set1_pd(EXP_COEFFICIENTS[11]);
+    for (int i = 10; i >= 0; i--) {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFICIENTS[i]));
+    }
+#else
+    __m256d r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_HI)));
+    r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(LN2_LO)));
+
+    __m256d p = _mm256_set1_pd(EXP_COEFFICIENTS[11]);
+    for (int i = 10; i >= 0; i--) {
+        p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(EXP_COEFFICIENTS[i]));
+    }
+#endif
+
+    // 2^n: n + 1023 is in the low bits of shifted + 1023, shifting it into the exponent drops the bits of the shifter
+    __m256i exponent = _mm256_castpd_si256(_mm256_add_pd(shifted, _mm256_set1_pd(1023.0)));
+    __m256d scale = _mm256_castsi256_pd(_mm256_slli_epi64(exponent, 52));
+
+    return _mm256_mul_pd(p, scale);
+}
+#endif
+
+/**
+ * Scalar version of the float exp approximation
+ *
+ * @param x  The exponent
+ * @return   exp(x)
+ */
+static inline float fastExp(float x) {
+    x = x > EXP_MAX_FLOAT ? EXP_MAX_FLOAT : (x < EXP_MIN_FLOAT ? EXP_MIN_FLOAT : x);
+
+    float n = (x * float(LOG2_E) + SHIFTER_FLOAT) - SHIFTER_FLOAT;  // round(x / ln2)
+    float r = (x - n * LN2_HI_FLOAT) - n * LN2_LO_FLOAT;
+
+    float p = EXP_COEFFICIENTS_FLOAT[7];
+    for (int i = 6; i >= 0; i--) {
+        p = p * r + EXP_COEFFICIENTS_FLOAT[i];
+    }
+
+    // 2^n from the exponent bits
+    uint32_t bits = uint32_t(int32_t(n) + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+
+    return p * scale;
+}
+
+#ifdef __AVX2__
+/**
+ * AVX2 version of the float exp approximation for 8 values
+ *
+ * @param x  The exponents
+ * @return   exp(x)
+ */
+static inline __m256 fastExp(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN_FLOAT)), _mm256_set1_ps(EXP_MAX_FLOAT));
+
+    const __m256 shifter = _mm256_set1_ps(SHIFTER_FLOAT);
+
+    // round(x / ln2), its integer value is in the low bits of shifted
+    __m256 shifted = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(float(LOG2_E))), shifter);
+    __m256 n = _mm256_sub_ps(shifted, shifter);
+
+#ifdef __FMA__
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_HI_FLOAT), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_LO_FLOAT), r);
+
+    __m256 p = _mm256_set1_ps(EXP_COEFFICIENTS_FLOAT[7]);
+    for (int i = 6; i >= 0; i--) {
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_COEFFICIENTS_FLOAT[i]));
     }
-    sum += bias;
-    output = std::max(0.0, sum);
+#else
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(LN2_HI_FLOAT)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(n, _mm256_set1_ps(LN2_LO_FLOAT)));
+
+    __m256 p = _mm256_set1_ps(EXP_COEFFICIENTS_FLOAT[7]);
+    for (int i = 6; i >= 0; i--) {
+        p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(EXP_COEFFICIENTS_FLOAT[i]));
+    }
+#endif
+
+    // 2^n: n + 127 is in the low bits of shifted + 127, shifting it into the exponent drops the bits of the shifter
+    __m256i exponent = _mm256_castps_si256(_mm256_add_ps(shifted, _mm256_set1_ps(127.0f)));
+    __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23));
+
+    return _mm256_mul_ps(p, scale);
+}
+#endif
+
+#ifdef __AVX2__
+/**
+ * The sum of the 4 values of a vector
+ *
+ * @param x  The values
+ * @return   The sum
+ */
+static inline double horizontalSum(__m256d x) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+/**
+ * The maximum of the 4 values of a vector
+ *
+ * @param x  The values
+ * @return   The maximum
+ */
+static inline double horizontalMax(__m256d x) {
+    __m128d pair = _mm_max_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+
+    return _mm_cvtsd_f64(_mm_max_sd(pair, _mm_unpackhi_pd(pair, pair)));
 }
 
 /**
- * Softmax activation function. The function gets the weighted sum of each perceptron in the layer and returns the
- * softmax of each perceptron
+ * The sum of the 8 values of a vector
  *
- * @param weighted_sums   The weighted sums of all the perceptrons in the layer
- * @param index           The index of the current perceptron in the layer
+ * @param x  The values
+ * @return   The sum
+ */
+static inline float horizontalSum(__m256 x) {
+    __m128 quad = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    __m128 pair = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+
+    return _mm_cvtss_f32(_mm_add_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+}
+
+/**
+ * The maximum of the 8 values of a vector
  *
- * @return                Output of the perceptron
+ * @param x  The values
+ * @return   The maximum
  */
-std::vector<double> Softmax(std::vector<double *> &weighted_sums){
-    std::vector<double> outputs;
+static inline float horizontalMax(__m256 x) {
+    __m128 quad = _mm_max_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+    __m128 pair = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+
+    return _mm_cvtss_f32(_mm_max_ss(pair, _mm_shuffle_ps(pair, pair, 1)));
+}
+#endif
+
+/**
+ * The sigmoid of a row of weighted sums and its derivative in one pass: every vector of weighted sums gets its biases,
+ * goes through the exp approximation and is turned into the outputs and the derivatives while it is in registers
+ *
+ * @param row          The weighted sums without the biases, replaced by the outputs
+ * @param biases       The bias of every column
+ * @param derivatives  The derivatives of the outputs
+ * @param n_cols       The number of columns
+ */
+static inline void sigmoidRow(double *row, const double *biases, double *derivatives, int n_cols) {
+    int j = 0;
+
+#ifdef __AVX2__
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    for (; j + 4 <= n_cols; j += 4) {
+        __m256d sum = _mm256_add_pd(_mm256_loadu_pd(row + j), _mm256_loadu_pd(biases + j));
+        __m256d output = _mm256_div_pd(one, _mm256_add_pd(one, fastExp(_mm256_sub_pd(_mm256_setzero_pd(), sum))));
+
+        _mm256_storeu_pd(row + j, output);
+        _mm256_storeu_pd(derivatives + j, _mm256_mul_pd(output, _mm256_sub_pd(one, output)));
+    }
+#endif
+
+    for (; j < n_cols; j++) {
+        double output = 1 / (1 + fastExp(-(row[j] + biases[j])));
+
+        row[j] = output;
+        derivatives[j] = output * (1 - output);
+    }
+}
+
+/**
+ * The float version of sigmoidRow(), 8 columns at a time
+ *
+ * @param row          The weighted sums without the biases, replaced by the outputs
+ * @param biases       The bias of every column
+ * @param derivatives  The derivatives of the outputs
+ * @param n_cols       The number of columns
+ */
+static inline void sigmoidRow(float *row, const float *biases, float *derivatives, int n_cols) {
+    int j = 0;
+
+#ifdef __AVX2__
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    for (; j + 8 <= n_cols; j += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(row + j), _mm256_loadu_ps(biases + j));
+        __m256 output = _mm256_div_ps(one, _mm256_add_ps(one, fastExp(_mm256_sub_ps(_mm256_setzero_ps(), sum))));
+
+        _mm256_storeu_ps(row + j, output);
+        _mm256_storeu_ps(derivatives + j, _mm256_mul_ps(output, _mm256_sub_ps(one, output)));
+    }
+#endif
+
+    for (; j < n_cols; j++) {
+        float output = 1 / (1 + fastExp(-(row[j] + biases[j])));
+
+        row[j] = output;
+        derivatives[j] = output * (1 - output);
+    }
+}
+
+/**
+ * Sigmoid activation function, f(z) = 1 / (1 + e^-z) and f'(z) = f(z) * (1 - f(z))
+ *
+ * @param values       The weighted sums without the biases, replaced by the outputs
+ * @param biases       The bias of every column
+ * @param derivatives  The derivatives of the outputs
+ * @param n_rows       The number of rows (samples)
+ * @param n_cols       The number of columns (perceptrons)
+ * @param stride       The distance between two rows
+ */
+template <typename T>
+void Sigmoid(T *values, const T *biases, T *derivatives, int n_rows, int n_cols, int stride) {
+    for (int r = 0; r < n_rows; r++) {
+        sigmoidRow(values + size_t(r) * stride, biases, derivatives + size_t(r) * stride, n_cols);
+    }
+}
+
+/**
+ * ReLU activation function, f(z) = max(0, z) and f'(z) = 1 if z > 0 else 0
+ *
+ * @param values       The weighted sums without the biases, replaced by the outputs
+ * @param biases       The bias of every column
+ * @param derivatives  The derivatives of the outputs
+ * @param n_rows       The number of rows (samples)
+ * @param n_cols       The number of columns (perceptrons)
+ * @param stride       The distance between two rows
+ */
+template <typename T>
+void ReLU(T *values, const T *biases, T *derivatives, int n_rows, int n_cols, int stride) {
+    for (int r = 0; r < n_rows; r++) {
+        T *row = values + size_t(r) * stride;
+        T *row_derivatives = derivatives + size_t(r) * stride;
+
+        for (int j = 0; j < n_cols; j++) {
+            T sum = row[j] + biases[j];
+
+            row[j] = sum > 0 ? sum : T(0);
+            row_derivatives[j] = sum > 0 ? T(1) : T(0);
+        }
+    }
+}
+
+/**
+ * The softmax of a row of weighted sums, in place. The maximum is subtracted before the exponentials (the log-sum-exp
+ * trick), so the largest exponent is 0 and nothing overflows whatever the weighted sums.
+ *
+ * The row is read three times, the least the normalization allows: the first pass adds the biases and finds the
+ * maximum, the second stores the exponentials and sums them and the third scales them to probabilities and, if errors
+ * is given, writes them to the errors as well
+ *
+ * @param row     The weighted sums without the biases, replaced by the probabilities
+ * @param biases  The bias of every column
+ * @param errors  Receives a copy of the probabilities if not null
+ * @param n_cols  The number of columns
+ */
+static inline void softmaxRow(double *row, const double *biases, double *errors, int n_cols) {
+    double max = row[0] + biases[0];
+    int j = 0;
+
+#ifdef __AVX2__
+    __m256d max_vector = _mm256_set1_pd(max);
+
+    for (; j + 4 <= n_cols; j += 4) {
+        __m256d sum = _mm256_add_pd(_mm256_loadu_pd(row + j), _mm256_loadu_pd(biases + j));
+
+        _mm256_storeu_pd(row + j, sum);
+        max_vector = _mm256_max_pd(max_vector, sum);
+    }
+
+    max = horizontalMax(max_vector);
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] += biases[j];
+        max = row[j] > max ? row[j] : max;
+    }
+
     double sum = 0;
-    for (auto & weighted_sum : weighted_sums) {
-        sum += exp(*weighted_sum);
+    j = 0;
+
+#ifdef __AVX2__
+    __m256d sum_vector = _mm256_setzero_pd();
+
+    for (; j + 4 <= n_cols; j += 4) {
+        __m256d exponential = fastExp(_mm256_sub_pd(_mm256_loadu_pd(row + j), _mm256_set1_pd(max)));
+
+        _mm256_storeu_pd(row + j, exponential);
+        sum_vector = _mm256_add_pd(sum_vector, exponential);
+    }
+
+    sum = horizontalSum(sum_vector);
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] = fastExp(row[j] - max);
+        sum += row[j];
+    }
+
+    double inverse = 1 / sum;
+    j = 0;
+
+#ifdef __AVX2__
+    for (; j + 4 <= n_cols; j += 4) {
+        __m256d probability = _mm256_mul_pd(_mm256_loadu_pd(row + j), _mm256_set1_pd(inverse));
+
+        _mm256_storeu_pd(row + j, probability);
+
+        if (errors != nullptr) {
+            _mm256_storeu_pd(errors + j, probability);
+        }
     }
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] *= inverse;
 
-    for (auto & weighted_sum : weighted_sums) {
-        outputs.push_back(exp(*weighted_sum) / sum);
+        if (errors != nullptr) {
+            errors[j] = row[j];
+        }
     }
-    return outputs;
 }
 
-double SigmoidDerivative(double output) {
-    return output * (1 - output);
+/**
+ * The float version of softmaxRow(), 8 columns at a time
+ *
+ * @param row     The weighted sums without the biases, replaced by the probabilities
+ * @param biases  The bias of every column
+ * @param errors  Receives a copy of the probabilities if not null
+ * @param n_cols  The number of columns
+ */
+static inline void softmaxRow(float *row, const float *biases, float *errors, int n_cols) {
+    float max = row[0] + biases[0];
+    int j = 0;
+
+#ifdef __AVX2__
+    __m256 max_vector = _mm256_set1_ps(max);
+
+    for (; j + 8 <= n_cols; j += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(row + j), _mm256_loadu_ps(biases + j));
+
+        _mm256_storeu_ps(row + j, sum);
+        max_vector = _mm256_max_ps(max_vector, sum);
+    }
+
+    max = horizontalMax(max_vector);
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] += biases[j];
+        max = row[j] > max ? row[j] : max;
+    }
+
+    float sum = 0;
+    j = 0;
+
+#ifdef __AVX2__
+    __m256 sum_vector = _mm256_setzero_ps();
+
+    for (; j + 8 <= n_cols; j += 8) {
+        __m256 exponential = fastExp(_mm256_sub_ps(_mm256_loadu_ps(row + j), _mm256_set1_ps(max)));
+
+        _mm256_storeu_ps(row + j, exponential);
+        sum_vector = _mm256_add_ps(sum_vector, exponential);
+    }
+
+    sum = horizontalSum(sum_vector);
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] = fastExp(row[j] - max);
+        sum += row[j];
+    }
+
+    float inverse = 1 / sum;
+    j = 0;
+
+#ifdef __AVX2__
+    for (; j + 8 <= n_cols; j += 8) {
+        __m256 probability = _mm256_mul_ps(_mm256_loadu_ps(row + j), _mm256_set1_ps(inverse));
+
+        _mm256_storeu_ps(row + j, probability);
+
+        if (errors != nullptr) {
+            _mm256_storeu_ps(errors + j, probability);
+        }
+    }
+#endif
+
+    for (; j < n_cols; j++) {
+        row[j] *= inverse;
+
+        if (errors != nullptr) {
+            errors[j] = row[j];
+        }
+    }
 }
 
-double ReLUDerivative(double output) {
-    return output > 0 ? 1 : 0;
+/**
+ * Softmax activation function, f(z)_j = e^z_j / Σ e^z_k for every row. It is only used when there is no target (the
+ * forward pass of the tests): in training the output layer goes through SoftmaxCrossEntropy() which calculates the
+ * errors directly, so no derivatives are stored
+ *
+ * @param values       The weighted sums without the biases, replaced by the outputs
+ * @param biases       The bias of every column
+ * @param derivatives  Not used
+ * @param n_rows       The number of rows (samples)
+ * @param n_cols       The number of columns (perceptrons)
+ * @param stride       The distance between two rows
+ */
+template <typename T>
+void Softmax(T *values, const T *biases, T *, int n_rows, int n_cols, int stride) {
+    for (int r = 0; r < n_rows; r++) {
+        softmaxRow(values + size_t(r) * stride, biases, (T *) nullptr, n_cols);
+    }
 }
 
-double SoftmaxDerivative(double output) {
-    return output * (1 - output);
-}
\ No newline at end of file
+/**
+ * Softmax output layer with the cross-entropy loss, C = -log(p_y). The gradient of the loss with respect to the
+ * weighted sums of the output layer is
+ *
+ *    δ = p - y
+ *
+ *    where:
+ *        p is the softmax of the weighted sums
+ *        y is the one hot target, 1 for the column of the label and 0 for the rest
+ *
+ * so the errors are written by the pass that normalizes the probabilities, without going through the derivative of the
+ * softmax
+ *
+ * @param values  The weighted sums without the biases, replaced by the probabilities
+ * @param biases  The bias of every column
+ * @param labels  The label of every row
+ * @param errors  The errors of the rows
+ * @param n_rows  The number of rows (samples)
+ * @param n_cols  The number of columns (perceptrons)
+ * @param stride  The distance between two rows
+ */
+template <typename T>
+void SoftmaxCrossEntropy(T *values, const T *biases, const int *labels, T *errors, int n_rows, int n_cols, int stride) {
+    for (int r = 0; r < n_rows; r++) {
+        T *row_errors = errors + size_t(r) * stride;
+
+        softmaxRow(values + size_t(r) * stride, biases, row_errors, n_cols);
+
+        row_errors[labels[r]] -= 1;
+    }
+}
+
+
+// The two scalar types of the network
+template void Sigmoid(float *, const float *, float *, int, int, int);
+template void Sigmoid(double *, const double *, double *, int, int, int);
+template void ReLU(float *, const float *, float *, int, int, int);
+template void ReLU(double *, const double *, double *, int, int, int);
+template void Softmax(float *, const float *, float *, int, int, int);
+template void Softmax(double *, const double *, double *, int, int, int);
+template void SoftmaxCrossEntropy(float *, const float *, const int *, float *, int, int, int);
+template void SoftmaxCrossEntropy(double *, const double *, const int *, double *, int, int, int);
@@ -1,20 +1,19 @@
 #ifndef NN_PROJECT_ACTIVATION_FUNCTIONS_H
 #define NN_PROJECT_ACTIVATION_FUNCTIONS_H
 
-#include <vector>
+// Activation functions, fused with the bias addition and the derivatives for the backward pass, applied in place to
+// all the weighted sums of a layer. T is float or double
+template <typename T>
+void Sigmoid(T *values, const T *biases, T *derivatives, int n_rows, int n_cols, int stride);
 
-// TODO : Add softmax function
+template <typename T>
+void ReLU(T *values, const T *biases, T *derivatives, int n_rows, int n_cols, int stride);
 
-// Activation functions
-void Sigmoid(double &output, std::vector<double *> &inputs, std::vector<double> &weights, double bias);
+template <typename T>
+void Softmax(T *values, const T *biases, T *derivatives, int n_rows, int n_cols, int stride);
 
-void ReLU(double &output, std::vector<double *> &inputs, std::vector<double> &weights, double bias);
+// Output layer, fused softmax and gradient of the cross-entropy loss
+template <typename T>
+void SoftmaxCrossEntropy(T *values, const T *biases, const int *labels, T *errors, int n_rows, int n_cols, int stride);
 
-std::vector<double> Softmax(std::vector<double *> &weighted_sums);
-
-double SigmoidDerivative(double output);
-
-double ReLUDerivative(double output);
-
-double SoftmaxDerivative(double output);
-#endif
\ No newline at end of file
+#endif
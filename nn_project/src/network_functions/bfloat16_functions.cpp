@@ -0,0 +1,99 @@
+#include "bfloat16_functions.h"
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+
+/**
+ * Convert a float to bfloat16, rounded to the nearest even. NaNs stay NaNs
+ *
+ * @param value  The float
+ * @return       The bfloat16
+ */
+Bfloat16 FloatToBfloat16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+        return Bfloat16((bits >> 16) | 0x40u);  // Keep a quiet NaN, the rounding could turn it into an infinity
+    }
+
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+
+    return Bfloat16(bits >> 16);
+}
+
+/**
+ * Convert a bfloat16 to a float. The conversion is exact
+ *
+ * @param value  The bfloat16
+ * @return       The float
+ */
+float Bfloat16ToFloat(Bfloat16 value) {
+    uint32_t bits = uint32_t(value) << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+
+    return result;
+}
+
+/**
+ * Convert n floats to bfloat16
+ *
+ * @param x  The floats
+ * @param y  The bfloat16 values
+ * @param n  The number of values
+ */
+void ConvertToBfloat16(const float *x, Bfloat16 *y, int n) {
+    int i = 0;
+
+#ifdef __AVX512BF16__
+    for (; i + 16 <= n; i += 16) {
+        __m256bh converted = _mm512_cvtneps_pbh(_mm512_loadu_ps(x + i));
+        _mm256_storeu_si256((__m256i *) (y + i), (__m256i) converted);
+    }
+#elif defined(__AVX2__)
+    // The rounding of FloatToBfloat16() on 8 floats at a time, the pack keeps the upper halves of two registers
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i half = _mm256_set1_epi32(0x7FFF);
+    const __m256i quiet = _mm256_set1_epi32(0x400000);
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i halves[2];
+
+        for (int h = 0; h < 2; h++) {
+            __m256 values = _mm256_loadu_ps(x + i + 8 * h);
+            __m256i bits = _mm256_castps_si256(values);
+            __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), one);
+            __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(half, lsb));
+            __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(values, values, _CMP_UNORD_Q));
+
+            halves[h] = _mm256_srli_epi32(_mm256_blendv_epi8(rounded, _mm256_or_si256(bits, quiet), nan), 16);
+        }
+
+        // The pack works on the 128 bit lanes, the permutation puts the 4 groups of 4 values back in order
+        __m256i packed = _mm256_packus_epi32(halves[0], halves[1]);
+        _mm256_storeu_si256((__m256i *) (y + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+#endif
+
+    for (; i < n; i++) {
+        y[i] = FloatToBfloat16(x[i]);
+    }
+}
+
+/**
+ * Convert n doubles to bfloat16, through float
+ *
+ * @param x  The doubles
+ * @param y  The bfloat16 values
+ * @param n  The number of values
+ */
+void ConvertToBfloat16(const double *x, Bfloat16 *y, int n) {
+    for (int i = 0; i < n; i++) {
+        y[i] = FloatToBfloat16(float(x[i]));
+    }
+}
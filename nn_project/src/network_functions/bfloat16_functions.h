@@ -0,0 +1,23 @@
+#ifndef NN_PROJECT_BFLOAT16_FUNCTIONS_H
+#define NN_PROJECT_BFLOAT16_FUNCTIONS_H
+
+#include <cstdint>
+
+/*
+ * bfloat16 is the upper half of a float: the same sign and 8 bit exponent and only 7 bits of mantissa. It has the
+ * range of a float with about 3 significant digits, so it halves the memory of the operands of the matrix products
+ * without their values overflowing or underflowing.
+ */
+typedef uint16_t Bfloat16;
+
+// Conversions of a single value, rounded to the nearest even
+Bfloat16 FloatToBfloat16(float value);
+
+float Bfloat16ToFloat(Bfloat16 value);
+
+// Conversion of n values, vectorized
+void ConvertToBfloat16(const float *x, Bfloat16 *y, int n);
+
+void ConvertToBfloat16(const double *x, Bfloat16 *y, int n);
+
+#endif
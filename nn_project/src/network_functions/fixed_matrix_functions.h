@@ -0,0 +1,311 @@
+#ifndef NN_PROJECT_FIXED_MATRIX_FUNCTIONS_H
+#define NN_PROJECT_FIXED_MATRIX_FUNCTIONS_H
+
+#include <cstddef>
+
+#include "matrix_functions.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define FIXED_GEMM_VECTOR_BYTES 32  // The bytes of a SIMD register the blocks are sized for (AVX)
+#define FIXED_GEMM_ROWS 6           // The rows of C computed together, like GEMM_MR
+#define FIXED_GEMM_VECTORS 2        // The SIMD registers of a row of a block of C, like the panels of GEMM_NR
+#define FIXED_GEMM_MAX_OUTPUTS 32   // The most perceptrons of a layer that uses the fixed size products
+
+/*
+ * Matrix products of the small layers of a Static_Network, where the sizes of the layer are template arguments. The
+ * blocked products of matrix_functions.h pack their operands and handle the edges of every block at run time, which
+ * costs as much as the product itself when a layer has a few perceptrons. Here every trip count except the number of
+ * samples is a compile time constant: the loops over a block of C are unrolled, the block stays in registers for the
+ * whole depth of the product and the narrow last block is a block of its own width, so there is no edge handling
+ * left. The rows of B and C must be padded to whole SIMD registers (the rows of a Dense_Layer are padded to
+ * LAYER_ALIGNMENT bytes), the columns past the width of the product are read but never written.
+ *
+ * The templates are defined in this header so that any topology can be instantiated. T is float or double.
+ */
+
+/**
+ * The values of a SIMD register of the blocks
+ */
+template <typename T>
+struct Fixed_Width {
+    static const int size = int(FIXED_GEMM_VECTOR_BYTES / sizeof(T));
+};
+
+/**
+ * Round a number of columns up to whole SIMD registers
+ *
+ * @param n_values  The number of values
+ * @return          The rounded number of values
+ */
+template <typename T>
+constexpr int fixedVectorWidth(int n_values) {
+    return (n_values + Fixed_Width<T>::size - 1) / Fixed_Width<T>::size * Fixed_Width<T>::size;
+}
+
+#ifdef __AVX2__
+/**
+ * The AVX operations of the blocks for every scalar type
+ */
+template <typename T>
+struct Fixed_Vector;
+
+template <>
+struct Fixed_Vector<double> {
+    typedef __m256d Type;
+
+    static Type zero() { return _mm256_setzero_pd(); }
+    static Type broadcast(double x) { return _mm256_set1_pd(x); }
+    static Type load(const double *values) { return _mm256_loadu_pd(values); }
+    static void store(double *values, Type x) { _mm256_storeu_pd(values, x); }
+    static Type add(Type x, Type y) { return _mm256_add_pd(x, y); }
+
+#ifdef __FMA__
+    static Type multiplyAdd(Type x, Type y, Type z) { return _mm256_fmadd_pd(x, y, z); }
+#else
+    static Type multiplyAdd(Type x, Type y, Type z) { return _mm256_add_pd(_mm256_mul_pd(x, y), z); }
+#endif
+};
+
+template <>
+struct Fixed_Vector<float> {
+    typedef __m256 Type;
+
+    static Type zero() { return _mm256_setzero_ps(); }
+    static Type broadcast(float x) { return _mm256_set1_ps(x); }
+    static Type load(const float *values) { return _mm256_loadu_ps(values); }
+    static void store(float *values, Type x) { _mm256_storeu_ps(values, x); }
+    static Type add(Type x, Type y) { return _mm256_add_ps(x, y); }
+
+#ifdef __FMA__
+    static Type multiplyAdd(Type x, Type y, Type z) { return _mm256_fmadd_ps(x, y, z); }
+#else
+    static Type multiplyAdd(Type x, Type y, Type z) { return _mm256_add_ps(_mm256_mul_ps(x, y), z); }
+#endif
+};
+#endif
+
+/**
+ * Store or add the R x S block of C computed by a product of the given depth:
+ *
+ *    C[r][c] (+)= Σ_p a[r * a_rs + p * a_cs] * b[p * ldb + c]
+ *
+ * The block is computed W >= S columns wide, W a multiple of the SIMD width, and only its first S columns are stored
+ *
+ * @param depth       The depth of the product
+ * @param a           The first value of the rows of A
+ * @param a_rs        The distance between two rows of A
+ * @param a_cs        The distance between two columns of A
+ * @param b           The first value of the columns of B
+ * @param ldb         The distance between two rows of B
+ * @param C           The first value of the block of C
+ * @param ldc         The distance between two rows of C
+ * @param accumulate  Whether to add the block to C
+ */
+template <typename T, int R, int W, int S>
+inline void fixedBlock(int depth, const T *a, size_t a_rs, size_t a_cs, const T *b, size_t ldb, T *C, size_t ldc,
+                       bool accumulate) {
+#ifdef __AVX2__
+    typedef Fixed_Vector<T> V;
+    const int L = Fixed_Width<T>::size;
+
+    // R x W / L registers, plus the registers of the row of B
+    typename V::Type block[R][W / L];
+
+    for (int r = 0; r < R; r++) {
+        for (int v = 0; v < W / L; v++) {
+            block[r][v] = V::zero();
+        }
+    }
+
+    for (int p = 0; p < depth; p++) {
+        const T *b_row = b + size_t(p) * ldb;
+        typename V::Type b_values[W / L];
+
+        for (int v = 0; v < W / L; v++) {
+            b_values[v] = V::load(b_row + v * L);
+        }
+
+        for (int r = 0; r < R; r++) {
+            typename V::Type x = V::broadcast(a[r * a_rs + size_t(p) * a_cs]);
+
+            for (int v = 0; v < W / L; v++) {
+                block[r][v] = V::multiplyAdd(x, b_values[v], block[r][v]);
+            }
+        }
+    }
+
+    for (int r = 0; r < R; r++) {
+        T *row = C + r * ldc;
+
+        if (S == W) {
+            for (int v = 0; v < W / L; v++) {
+                V::store(row + v * L, accumulate ? V::add(V::load(row + v * L), block[r][v]) : block[r][v]);
+            }
+        } else {
+            // The narrow last block only stores the columns that exist
+            alignas(FIXED_GEMM_VECTOR_BYTES) T values[W];
+
+            for (int v = 0; v < W / L; v++) {
+                V::store(values + v * L, block[r][v]);
+            }
+
+            for (int c = 0; c < S; c++) {
+                row[c] = accumulate ? row[c] + values[c] : values[c];
+            }
+        }
+    }
+#else
+    T block[R][W] = {};
+
+    for (int p = 0; p < depth; p++) {
+        const T *b_row = b + size_t(p) * ldb;
+
+        for (int r = 0; r < R; r++) {
+            T x = a[r * a_rs + size_t(p) * a_cs];
+
+            for (int c = 0; c < W; c++) {
+                block[r][c] += x * b_row[c];
+            }
+        }
+    }
+
+    for (int r = 0; r < R; r++) {
+        T *row = C + r * ldc;
+
+        for (int c = 0; c < S; c++) {
+            row[c] = accumulate ? row[c] + block[r][c] : block[r][c];
+        }
+    }
+#endif
+}
+
+/**
+ * The blocks of R rows of C: the N columns in blocks of FIXED_GEMM_VECTORS registers and a narrower last block
+ *
+ * @param depth       The depth of the product
+ * @param a           The first value of the rows of A
+ * @param a_rs        The distance between two rows of A
+ * @param a_cs        The distance between two columns of A
+ * @param b           The first value of B
+ * @param ldb         The distance between two rows of B
+ * @param C           The first value of the rows of C
+ * @param ldc         The distance between two rows of C
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T, int R, int N>
+inline void fixedRows(int depth, const T *a, size_t a_rs, size_t a_cs, const T *b, size_t ldb, T *C, size_t ldc,
+                      bool accumulate) {
+    constexpr int W = FIXED_GEMM_VECTORS * Fixed_Width<T>::size;
+    constexpr int N_FULL = N / W * W;
+    constexpr int N_LAST = N - N_FULL;
+
+    for (int c = 0; c < N_FULL; c += W) {
+        fixedBlock<T, R, W, W>(depth, a, a_rs, a_cs, b + c, ldb, C + c, ldc, accumulate);
+    }
+
+    if (N_LAST > 0) {
+        // The width is never 0, even where there is no last block
+        fixedBlock<T, R, fixedVectorWidth<T>(N_LAST > 0 ? N_LAST : 1), N_LAST>(depth, a, a_rs, a_cs, b + N_FULL, ldb,
+                                                                               C + N_FULL, ldc, accumulate);
+    }
+}
+
+/**
+ * C = A * B^T, A is m x K and B is N x K (the weighted sums X * W^T of a layer). B is transposed to the packing buffer
+ * first, so the blocks read it row by row
+ *
+ * @param m        The number of rows of A and C
+ * @param A        The m x K matrix A
+ * @param lda      The distance between two rows of A
+ * @param B        The N x K matrix B
+ * @param ldb      The distance between two rows of B
+ * @param C        The m x N matrix C
+ * @param ldc      The distance between two rows of C
+ * @param packing  The packing buffer of the calling thread, GEMM_PACKING_SIZE values
+ */
+template <typename T, int N, int K>
+void FixedGemmNT(int m, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing) {
+    constexpr int N_PADDED = fixedVectorWidth<T>(N);
+
+    static_assert(size_t(K) * N_PADDED <= GEMM_PACKING_SIZE, "B^T does not fit in the packing buffer");
+
+    // B^T, K x N_PADDED
+    for (int p = 0; p < K; p++) {
+        for (int j = 0; j < N; j++) {
+            packing[p * N_PADDED + j] = B[size_t(j) * ldb + p];
+        }
+    }
+
+    int i = 0;
+
+    for (; i + FIXED_GEMM_ROWS <= m; i += FIXED_GEMM_ROWS) {
+        fixedRows<T, FIXED_GEMM_ROWS, N>(K, A + size_t(i) * lda, size_t(lda), 1, packing, N_PADDED,
+                                         C + size_t(i) * ldc, size_t(ldc), false);
+    }
+
+    for (; i < m; i++) {
+        fixedRows<T, 1, N>(K, A + size_t(i) * lda, size_t(lda), 1, packing, N_PADDED, C + size_t(i) * ldc,
+                           size_t(ldc), false);
+    }
+}
+
+/**
+ * C = A * B, A is m x K and B is K x N (the input errors δ * W of a layer)
+ *
+ * @param m    The number of rows of A and C
+ * @param A    The m x K matrix A
+ * @param lda  The distance between two rows of A
+ * @param B    The K x N matrix B
+ * @param ldb  The distance between two rows of B
+ * @param C    The m x N matrix C
+ * @param ldc  The distance between two rows of C
+ */
+template <typename T, int N, int K>
+void FixedGemmNN(int m, const T *A, int lda, const T *B, int ldb, T *C, int ldc) {
+    int i = 0;
+
+    for (; i + FIXED_GEMM_ROWS <= m; i += FIXED_GEMM_ROWS) {
+        fixedRows<T, FIXED_GEMM_ROWS, N>(K, A + size_t(i) * lda, size_t(lda), 1, B, size_t(ldb), C + size_t(i) * ldc,
+                                         size_t(ldc), false);
+    }
+
+    for (; i < m; i++) {
+        fixedRows<T, 1, N>(K, A + size_t(i) * lda, size_t(lda), 1, B, size_t(ldb), C + size_t(i) * ldc, size_t(ldc),
+                           false);
+    }
+}
+
+/**
+ * C += A^T * B, A is k x M and B is k x N (the weight gradients δ^T * X of a layer)
+ *
+ * @param k    The number of rows of A and B
+ * @param A    The k x M matrix A
+ * @param lda  The distance between two rows of A
+ * @param B    The k x N matrix B
+ * @param ldb  The distance between two rows of B
+ * @param C    The M x N matrix C
+ * @param ldc  The distance between two rows of C
+ */
+template <typename T, int M, int N>
+void FixedGemmTN(int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc) {
+    constexpr int M_FULL = M / FIXED_GEMM_ROWS * FIXED_GEMM_ROWS;
+    constexpr int M_LAST = M - M_FULL;
+
+    for (int i = 0; i < M_FULL; i += FIXED_GEMM_ROWS) {
+        fixedRows<T, FIXED_GEMM_ROWS, N>(k, A + i, 1, size_t(lda), B, size_t(ldb), C + size_t(i) * ldc, size_t(ldc),
+                                         true);
+    }
+
+    // The rows of C are known, so the last ones are one narrower block. It has at least one row, even where there is
+    // no last block
+    if (M_LAST > 0) {
+        fixedRows<T, (M_LAST > 0 ? M_LAST : 1), N>(k, A + M_FULL, 1, size_t(lda), B, size_t(ldb),
+                                                   C + size_t(M_FULL) * ldc, size_t(ldc), true);
+    }
+}
+
+
+#endif
@@ -12,27 +12,28 @@
  * Xavier initialization of the weights. It is a good initialization for the sigmoid activation functions.
  *
  * @param network   Network to initialize
+ * @param seed      The seed of the random number engine
  */
-void XavierInitialization(std::vector<std::vector<Perceptron *>> &network){
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd());  // Standard mersenne_twister_engine seeded with rd()
+template <typename T>
+void XavierInitialization(std::vector<Dense_Layer<T> *> &network, unsigned seed){
+    std::mt19937 gen(seed);  // Standard mersenne_twister_engine, the same seed gives the same weights
 
     for (auto & layer : network) {
-        for (auto & perceptron : layer) {
+        // Normal distribution
+        int fan_in = layer->getInputCount();
+        int fan_out = layer->getOutputCount();
 
-            // Normal distribution
-            int fan_in = perceptron->getNInputs();
-            int fan_out = int(layer.size());
+        double fan_avg = (fan_in + fan_out) / 2.0;
 
-            double fan_avg = (fan_in + fan_out) / 2.0;
+        std::normal_distribution<> dis(0, sqrt(1.0 / fan_avg));
 
-            std::normal_distribution<> dis(0, sqrt(1.0 / fan_avg));
-
-            // Set the weights to the generated values and the bias to 0
-            for (int k = 0; k < perceptron->getNInputs(); ++k) {
-                perceptron->setWeight(dis(gen), k);
-                perceptron->setBias(0);
+        // Set the weights to the generated values and the bias to 0
+        for (int j = 0; j < layer->getOutputCount(); ++j) {
+            for (int k = 0; k < layer->getInputCount(); ++k) {
+                layer->setWeight(j, k, T(dis(gen)));
             }
+
+            layer->setBias(j, 0);
         }
     }
 }
@@ -43,15 +44,17 @@ void XavierInitialization(std::vector<std::vector<Perceptron *>> &network){
  *
  * @param network   Network to initialize
  */
-void ZeroInitialization(std::vector<std::vector<Perceptron *>> &network){
+template <typename T>
+void ZeroInitialization(std::vector<Dense_Layer<T> *> &network){
     for (auto & layer : network) {
-        for (auto & perceptron : layer) {
 
-            // Set all weights and biases to zero
-            for (int k = 0; k < perceptron->getNInputs(); ++k) {
-                perceptron->setWeight(0, k);
-                perceptron->setBias(0);
+        // Set all weights and biases to zero
+        for (int j = 0; j < layer->getOutputCount(); ++j) {
+            for (int k = 0; k < layer->getInputCount(); ++k) {
+                layer->setWeight(j, k, 0);
             }
+
+            layer->setBias(j, 0);
         }
     }
 }
@@ -62,21 +65,32 @@ void ZeroInitialization(std::vector<std::vector<Perceptron *>> &network){
  * with mean 0 and standard deviation sqrt(2 / number of inputs). Best used with ReLU activation function.
  *
  * @param network   Network to initialize
+ * @param seed      The seed of the random number engine
  */
-void KaimingInitialization(std::vector<std::vector<Perceptron *>> &network) {
-    std::random_device rd;  // Will be used to obtain a seed for the random number engine
-    std::mt19937 gen(rd());  // Standard mersenne_twister_engine seeded with rd()
+template <typename T>
+void KaimingInitialization(std::vector<Dense_Layer<T> *> &network, unsigned seed) {
+    std::mt19937 gen(seed);  // Standard mersenne_twister_engine, the same seed gives the same weights
 
     for (auto &layer: network) {
-        for (auto & perceptron: layer) {
-            // Generate a normal distribution with mean 0 and standard deviation sqrt(2 / input_size)
-            std::normal_distribution<> dist(0.0, sqrt(2.0 / perceptron->getNInputs()));
-
-            // Set the weights to the generated values and the bias to 0  TODO: Should the bias be initialized to 0?
-            for (int k = 0; k < perceptron->getNInputs(); ++k) {
-                perceptron->setWeight(dist(gen), k);
-                perceptron->setBias(0);
+        // Generate a normal distribution with mean 0 and standard deviation sqrt(2 / input_size)
+        std::normal_distribution<> dist(0.0, sqrt(2.0 / layer->getInputCount()));
+
+        // Set the weights to the generated values and the bias to 0  TODO: Should the bias be initialized to 0?
+        for (int j = 0; j < layer->getOutputCount(); ++j) {
+            for (int k = 0; k < layer->getInputCount(); ++k) {
+                layer->setWeight(j, k, T(dist(gen)));
             }
+
+            layer->setBias(j, 0);
         }
     }
-}
\ No newline at end of file
+}
+
+
+// The two scalar types of the network
+template void XavierInitialization(std::vector<Dense_Layer<float> *> &network, unsigned seed);
+template void XavierInitialization(std::vector<Dense_Layer<double> *> &network, unsigned seed);
+template void ZeroInitialization(std::vector<Dense_Layer<float> *> &network);
+template void ZeroInitialization(std::vector<Dense_Layer<double> *> &network);
+template void KaimingInitialization(std::vector<Dense_Layer<float> *> &network, unsigned seed);
+template void KaimingInitialization(std::vector<Dense_Layer<double> *> &network, unsigned seed);
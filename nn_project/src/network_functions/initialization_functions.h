@@ -1,12 +1,17 @@
 #ifndef NN_PROJECT_INITIALIZATION_FUNCTIONS_H
 #define NN_PROJECT_INITIALIZATION_FUNCTIONS_H
 
-#include "../perceptrons/Perceptron.h"
+#include <vector>
 
-void ZeroInitialization(std::vector<std::vector<Perceptron *>> &network);
+#include "../layers/Dense_Layer.h"
 
-void XavierInitialization(std::vector<std::vector<Perceptron *>> &network);
+template <typename T>
+void ZeroInitialization(std::vector<Dense_Layer<T> *> &network);
 
-void KaimingInitialization(std::vector<std::vector<Perceptron *>> &network);
+template <typename T>
+void XavierInitialization(std::vector<Dense_Layer<T> *> &network, unsigned seed);
+
+template <typename T>
+void KaimingInitialization(std::vector<Dense_Layer<T> *> &network, unsigned seed);
 
 #endif
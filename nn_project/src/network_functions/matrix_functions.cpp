@@ -0,0 +1,757 @@
+#include "matrix_functions.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__AVX512BF16__)
+#include <immintrin.h>
+#endif
+
+/*
+ * All three products go through the same blocked algorithm. A and B are read through a row and a column stride, so a
+ * transposed operand is only a different pair of strides. The operands are packed block by block:
+ *
+ *    B: a KC x NC block in panels of NR columns, every panel is KC rows of NR contiguous values
+ *    A: a MC x KC block in panels of GEMM_MR rows, every panel is KC columns of MR contiguous values
+ *
+ * so the micro-kernel streams through both panels with unit stride whatever the layout of the operands was, and keeps
+ * the MR x NR block of C in registers for the whole depth of the block. The packed blocks live in the packing buffer
+ * of the caller. NR is two AVX registers of the scalar type: GEMM_NR doubles or GEMM_NR_FLOAT floats.
+ */
+
+/**
+ * The columns of a panel of B for every scalar type
+ */
+template <typename T>
+struct Panel_Width {
+    static const int NR = GEMM_NR;
+};
+
+template <>
+struct Panel_Width<float> {
+    static const int NR = GEMM_NR_FLOAT;
+};
+
+
+/**
+ * Pack a mc x kc block of A in panels of GEMM_MR rows. The rows of the last panel past mc are zero
+ *
+ * @param mc      The number of rows of the block
+ * @param kc      The number of columns of the block
+ * @param A       The first value of the block
+ * @param rs      The row stride of A
+ * @param cs      The column stride of A
+ * @param packed  The packed block
+ */
+template <typename T>
+static void packA(int mc, int kc, const T *A, int rs, int cs, T *packed) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = std::min(GEMM_MR, mc - i);
+
+        for (int p = 0; p < kc; p++) {
+            for (int r = 0; r < mr; r++) {
+                packed[r] = A[size_t(i + r) * rs + size_t(p) * cs];
+            }
+
+            for (int r = mr; r < GEMM_MR; r++) {
+                packed[r] = 0;
+            }
+
+            packed += GEMM_MR;
+        }
+    }
+}
+
+/**
+ * Pack a kc x nc block of B in panels of NR columns. The columns of the last panel past nc are zero
+ *
+ * @param kc      The number of rows of the block
+ * @param nc      The number of columns of the block
+ * @param B       The first value of the block
+ * @param rs      The row stride of B
+ * @param cs      The column stride of B
+ * @param packed  The packed block
+ */
+template <typename T>
+static void packB(int kc, int nc, const T *B, int rs, int cs, T *packed) {
+    const int NR = Panel_Width<T>::NR;
+
+    for (int j = 0; j < nc; j += NR) {
+        int nr = std::min(NR, nc - j);
+
+        for (int p = 0; p < kc; p++) {
+            const T *row = B + size_t(p) * rs + size_t(j) * cs;
+
+            if (cs == 1) {
+                for (int c = 0; c < nr; c++) {
+                    packed[c] = row[c];
+                }
+            } else {
+                for (int c = 0; c < nr; c++) {
+                    packed[c] = row[size_t(c) * cs];
+                }
+            }
+
+            for (int c = nr; c < NR; c++) {
+                packed[c] = 0;
+            }
+
+            packed += NR;
+        }
+    }
+}
+
+/**
+ * Store or add the mr x nr top left corner of a GEMM_MR x NR block of the micro-kernel to C. Only the part of the block
+ * that exists is written back. The block may be of a narrower type than C
+ *
+ * @param block       The GEMM_MR x NR block, row major
+ * @param C           The first value of the block of C
+ * @param ldc         The distance between two rows of C
+ * @param mr          The number of rows of C that exist
+ * @param nr          The number of columns of C that exist
+ * @param accumulate  Whether to add the block to C
+ */
+template <int NR, typename S, typename T>
+static void storeBlock(const S *block, T *C, int ldc, int mr, int nr, bool accumulate) {
+    for (int r = 0; r < mr; r++) {
+        T *row = C + size_t(r) * ldc;
+
+        if (accumulate) {
+            for (int c = 0; c < nr; c++) {
+                row[c] += block[r * NR + c];
+            }
+        } else {
+            for (int c = 0; c < nr; c++) {
+                row[c] = block[r * NR + c];
+            }
+        }
+    }
+}
+
+/**
+ * Multiply a packed GEMM_MR x kc panel of A with a packed kc x GEMM_NR panel of B and store or add the mr x nr top
+ * left corner of the result to C
+ *
+ * @param kc          The depth of the panels
+ * @param a           The packed panel of A
+ * @param b           The packed panel of B
+ * @param C           The first value of the block of C
+ * @param ldc         The distance between two rows of C
+ * @param mr          The number of rows of C that exist
+ * @param nr          The number of columns of C that exist
+ * @param accumulate  Whether to add the product to C
+ */
+static void microKernel(int kc, const double *a, const double *b, double *C, int ldc, int mr, int nr, bool accumulate) {
+    alignas(32) double block[GEMM_MR * GEMM_NR];
+
+#ifdef __AVX2__
+    // 6 rows x 8 columns of C in 12 registers, plus the 2 registers of the row of the B panel
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (int p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_loadu_pd(b);
+        __m256d b1 = _mm256_loadu_pd(b + 4);
+        __m256d x;
+
+#ifdef __FMA__
+        x = _mm256_broadcast_sd(a);     c00 = _mm256_fmadd_pd(x, b0, c00); c01 = _mm256_fmadd_pd(x, b1, c01);
+        x = _mm256_broadcast_sd(a + 1); c10 = _mm256_fmadd_pd(x, b0, c10); c11 = _mm256_fmadd_pd(x, b1, c11);
+        x = _mm256_broadcast_sd(a + 2); c20 = _mm256_fmadd_pd(x, b0, c20); c21 = _mm256_fmadd_pd(x, b1, c21);
+        x = _mm256_broadcast_sd(a + 3); c30 = _mm256_fmadd_pd(x, b0, c30); c31 = _mm256_fmadd_pd(x, b1, c31);
+        x = _mm256_broadcast_sd(a + 4); c40 = _mm256_fmadd_pd(x, b0, c40); c41 = _mm256_fmadd_pd(x, b1, c41);
+        x = _mm256_broadcast_sd(a + 5); c50 = _mm256_fmadd_pd(x, b0, c50); c51 = _mm256_fmadd_pd(x, b1, c51);
+#else
+        x = _mm256_broadcast_sd(a);
+        c00 = _mm256_add_pd(c00, _mm256_mul_pd(x, b0)); c01 = _mm256_add_pd(c01, _mm256_mul_pd(x, b1));
+        x = _mm256_broadcast_sd(a + 1);
+        c10 = _mm256_add_pd(c10, _mm256_mul_pd(x, b0)); c11 = _mm256_add_pd(c11, _mm256_mul_pd(x, b1));
+        x = _mm256_broadcast_sd(a + 2);
+        c20 = _mm256_add_pd(c20, _mm256_mul_pd(x, b0)); c21 = _mm256_add_pd(c21, _mm256_mul_pd(x, b1));
+        x = _mm256_broadcast_sd(a + 3);
+        c30 = _mm256_add_pd(c30, _mm256_mul_pd(x, b0)); c31 = _mm256_add_pd(c31, _mm256_mul_pd(x, b1));
+        x = _mm256_broadcast_sd(a + 4);
+        c40 = _mm256_add_pd(c40, _mm256_mul_pd(x, b0)); c41 = _mm256_add_pd(c41, _mm256_mul_pd(x, b1));
+        x = _mm256_broadcast_sd(a + 5);
+        c50 = _mm256_add_pd(c50, _mm256_mul_pd(x, b0)); c51 = _mm256_add_pd(c51, _mm256_mul_pd(x, b1));
+#endif
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    _mm256_store_pd(block, c00);      _mm256_store_pd(block + 4, c01);
+    _mm256_store_pd(block + 8, c10);  _mm256_store_pd(block + 12, c11);
+    _mm256_store_pd(block + 16, c20); _mm256_store_pd(block + 20, c21);
+    _mm256_store_pd(block + 24, c30); _mm256_store_pd(block + 28, c31);
+    _mm256_store_pd(block + 32, c40); _mm256_store_pd(block + 36, c41);
+    _mm256_store_pd(block + 40, c50); _mm256_store_pd(block + 44, c51);
+#else
+    std::fill(block, block + GEMM_MR * GEMM_NR, 0.0);
+
+    for (int p = 0; p < kc; p++) {
+        for (int r = 0; r < GEMM_MR; r++) {
+            for (int c = 0; c < GEMM_NR; c++) {
+                block[r * GEMM_NR + c] += a[r] * b[c];
+            }
+        }
+
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+#endif
+
+    storeBlock<GEMM_NR>(block, C, ldc, mr, nr, accumulate);
+}
+
+/**
+ * The float version of the micro-kernel, the panels of B are GEMM_NR_FLOAT columns wide
+ *
+ * @param kc          The depth of the panels
+ * @param a           The packed panel of A
+ * @param b           The packed panel of B
+ * @param C           The first value of the block of C
+ * @param ldc         The distance between two rows of C
+ * @param mr          The number of rows of C that exist
+ * @param nr          The number of columns of C that exist
+ * @param accumulate  Whether to add the product to C
+ */
+static void microKernel(int kc, const float *a, const float *b, float *C, int ldc, int mr, int nr, bool accumulate) {
+    alignas(32) float block[GEMM_MR * GEMM_NR_FLOAT];
+
+#ifdef __AVX2__
+    // 6 rows x 16 columns of C in 12 registers, plus the 2 registers of the row of the B panel
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        __m256 x;
+
+#ifdef __FMA__
+        x = _mm256_broadcast_ss(a);     c00 = _mm256_fmadd_ps(x, b0, c00); c01 = _mm256_fmadd_ps(x, b1, c01);
+        x = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(x, b0, c10); c11 = _mm256_fmadd_ps(x, b1, c11);
+        x = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(x, b0, c20); c21 = _mm256_fmadd_ps(x, b1, c21);
+        x = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(x, b0, c30); c31 = _mm256_fmadd_ps(x, b1, c31);
+        x = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(x, b0, c40); c41 = _mm256_fmadd_ps(x, b1, c41);
+        x = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(x, b0, c50); c51 = _mm256_fmadd_ps(x, b1, c51);
+#else
+        x = _mm256_broadcast_ss(a);
+        c00 = _mm256_add_ps(c00, _mm256_mul_ps(x, b0)); c01 = _mm256_add_ps(c01, _mm256_mul_ps(x, b1));
+        x = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_add_ps(c10, _mm256_mul_ps(x, b0)); c11 = _mm256_add_ps(c11, _mm256_mul_ps(x, b1));
+        x = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_add_ps(c20, _mm256_mul_ps(x, b0)); c21 = _mm256_add_ps(c21, _mm256_mul_ps(x, b1));
+        x = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_add_ps(c30, _mm256_mul_ps(x, b0)); c31 = _mm256_add_ps(c31, _mm256_mul_ps(x, b1));
+        x = _mm256_broadcast_ss(a + 4);
+        c40 = _mm256_add_ps(c40, _mm256_mul_ps(x, b0)); c41 = _mm256_add_ps(c41, _mm256_mul_ps(x, b1));
+        x = _mm256_broadcast_ss(a + 5);
+        c50 = _mm256_add_ps(c50, _mm256_mul_ps(x, b0)); c51 = _mm256_add_ps(c51, _mm256_mul_ps(x, b1));
+#endif
+        a += GEMM_MR;
+        b += GEMM_NR_FLOAT;
+    }
+
+    _mm256_store_ps(block, c00);      _mm256_store_ps(block + 8, c01);
+    _mm256_store_ps(block + 16, c10); _mm256_store_ps(block + 24, c11);
+    _mm256_store_ps(block + 32, c20); _mm256_store_ps(block + 40, c21);
+    _mm256_store_ps(block + 48, c30); _mm256_store_ps(block + 56, c31);
+    _mm256_store_ps(block + 64, c40); _mm256_store_ps(block + 72, c41);
+    _mm256_store_ps(block + 80, c50); _mm256_store_ps(block + 88, c51);
+#else
+    std::fill(block, block + GEMM_MR * GEMM_NR_FLOAT, 0.0f);
+
+    for (int p = 0; p < kc; p++) {
+        for (int r = 0; r < GEMM_MR; r++) {
+            for (int c = 0; c < GEMM_NR_FLOAT; c++) {
+                block[r * GEMM_NR_FLOAT + c] += a[r] * b[c];
+            }
+        }
+
+        a += GEMM_MR;
+        b += GEMM_NR_FLOAT;
+    }
+#endif
+
+    storeBlock<GEMM_NR_FLOAT>(block, C, ldc, mr, nr, accumulate);
+}
+
+/**
+ * C = A * B, or C += A * B, where A(i, p) = A[i * a_rs + p * a_cs] and B(p, j) = B[p * b_rs + j * b_cs]
+ *
+ * @param m           The number of rows of C
+ * @param n           The number of columns of C
+ * @param k           The inner dimension of the product
+ * @param A           The left matrix
+ * @param a_rs        The row stride of A
+ * @param a_cs        The column stride of A
+ * @param B           The right matrix
+ * @param b_rs        The row stride of B
+ * @param b_cs        The column stride of B
+ * @param C           The result
+ * @param ldc         The distance between two rows of C
+ * @param packing     The GEMM_PACKING_SIZE values of the packed blocks
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+static void gemm(int m, int n, int k, const T *A, int a_rs, int a_cs, const T *B, int b_rs, int b_cs, T *C, int ldc,
+                 T *packing, bool accumulate) {
+    const int NR = Panel_Width<T>::NR;
+
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+
+    if (k <= 0) {
+        if (!accumulate) {
+            for (int i = 0; i < m; i++) {
+                std::fill(C + size_t(i) * ldc, C + size_t(i) * ldc + n, T(0));
+            }
+        }
+        return;
+    }
+
+    T *packed_A = packing;
+    T *packed_B = packing + size_t(GEMM_MC + GEMM_MR) * GEMM_KC;
+
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = std::min(GEMM_NC, n - jc);
+
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = std::min(GEMM_KC, k - pc);
+
+            // The first block of the depth overwrites C unless the product is accumulated
+            bool add = accumulate || pc > 0;
+
+            packB(kc, nc, B + size_t(pc) * b_rs + size_t(jc) * b_cs, b_rs, b_cs, packed_B);
+
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = std::min(GEMM_MC, m - ic);
+
+                packA(mc, kc, A + size_t(ic) * a_rs + size_t(pc) * a_cs, a_rs, a_cs, packed_A);
+
+                for (int jr = 0; jr < nc; jr += NR) {
+                    const T *b = packed_B + size_t(jr) * kc;
+
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        const T *a = packed_A + size_t(ir) * kc;
+                        T *c = C + size_t(ic + ir) * ldc + jc + jr;
+
+                        microKernel(kc, a, b, c, ldc, std::min(GEMM_MR, mc - ir), std::min(NR, nc - jr), add);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * The mixed precision products use the same blocking with bfloat16 panels. The AVX-512 BF16 dot product instruction
+ * multiplies pairs of bfloat16 values and adds both products to a float, so the panels are packed in pairs of
+ * consecutive depths: for every pair (p, p + 1) a panel of A holds the GEMM_MR pairs (A(i, p), A(i, p + 1)) and a panel
+ * of B the GEMM_NR_BF16 pairs (B(p, j), B(p + 1, j)). An odd depth is padded with a zero pair.
+ */
+
+
+/**
+ * Pack a mc x kc block of bfloat16 A in panels of GEMM_MR rows and pairs of depths. The rows of the last panel past mc
+ * and the last depth past kc are zero
+ *
+ * @param mc      The number of rows of the block
+ * @param kc      The number of columns of the block
+ * @param A       The first value of the block
+ * @param rs      The row stride of A
+ * @param cs      The column stride of A
+ * @param packed  The packed block
+ */
+static void packPairsA(int mc, int kc, const Bfloat16 *A, int rs, int cs, Bfloat16 *packed) {
+    for (int i = 0; i < mc; i += GEMM_MR) {
+        int mr = std::min(GEMM_MR, mc - i);
+
+        for (int p = 0; p < kc; p += 2) {
+            for (int r = 0; r < mr; r++) {
+                const Bfloat16 *value = A + size_t(i + r) * rs + size_t(p) * cs;
+
+                packed[2 * r] = value[0];
+                packed[2 * r + 1] = p + 1 < kc ? value[cs] : Bfloat16(0);
+            }
+
+            for (int r = mr; r < GEMM_MR; r++) {
+                packed[2 * r] = 0;
+                packed[2 * r + 1] = 0;
+            }
+
+            packed += 2 * GEMM_MR;
+        }
+    }
+}
+
+/**
+ * Pack a kc x nc block of bfloat16 B in panels of GEMM_NR_BF16 columns and pairs of depths. The columns of the last
+ * panel past nc and the last depth past kc are zero
+ *
+ * @param kc      The number of rows of the block
+ * @param nc      The number of columns of the block
+ * @param B       The first value of the block
+ * @param rs      The row stride of B
+ * @param cs      The column stride of B
+ * @param packed  The packed block
+ */
+static void packPairsB(int kc, int nc, const Bfloat16 *B, int rs, int cs, Bfloat16 *packed) {
+    for (int j = 0; j < nc; j += GEMM_NR_BF16) {
+        int nr = std::min(GEMM_NR_BF16, nc - j);
+
+        for (int p = 0; p < kc; p += 2) {
+            const Bfloat16 *row = B + size_t(p) * rs + size_t(j) * cs;
+            bool has_next = p + 1 < kc;
+
+            for (int c = 0; c < nr; c++) {
+                packed[2 * c] = row[size_t(c) * cs];
+                packed[2 * c + 1] = has_next ? row[size_t(c) * cs + rs] : Bfloat16(0);
+            }
+
+            for (int c = nr; c < GEMM_NR_BF16; c++) {
+                packed[2 * c] = 0;
+                packed[2 * c + 1] = 0;
+            }
+
+            packed += 2 * GEMM_NR_BF16;
+        }
+    }
+}
+
+#if defined(__AVX2__) && !defined(__AVX512BF16__)
+/**
+ * Broadcast a bfloat16 to the 8 floats of a register. Used by the emulated bfloat16 micro-kernel
+ *
+ * @param value  The bfloat16
+ * @return       The register
+ */
+static inline __m256 broadcastBfloat16(Bfloat16 value) {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(int(uint32_t(value) << 16)));
+}
+#endif
+
+/**
+ * The bfloat16 micro-kernel. Multiplies a packed GEMM_MR x kc panel of A with a packed kc x GEMM_NR_BF16 panel of B,
+ * accumulates in float and stores or adds the mr x nr top left corner of the result to C. Without AVX-512 BF16 the
+ * dot products are emulated with floats, the result is the same up to the rounding of the additions
+ *
+ * @param kc          The depth of the panels
+ * @param a           The packed panel of A
+ * @param b           The packed panel of B
+ * @param C           The first value of the block of C
+ * @param ldc         The distance between two rows of C
+ * @param mr          The number of rows of C that exist
+ * @param nr          The number of columns of C that exist
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+static void microKernelBf16(int kc, const Bfloat16 *a, const Bfloat16 *b, T *C, int ldc, int mr, int nr,
+                            bool accumulate) {
+    alignas(64) float block[GEMM_MR * GEMM_NR_BF16];
+
+    int n_pairs = (kc + 1) / 2;
+
+#ifdef __AVX512BF16__
+    // 6 rows x 32 columns of C in 12 registers, every instruction adds the products of a pair of depths
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+
+    for (int q = 0; q < n_pairs; q++) {
+        __m512bh b0 = (__m512bh) _mm512_loadu_si512(b);
+        __m512bh b1 = (__m512bh) _mm512_loadu_si512(b + 32);
+        __m512bh x;
+
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a)));
+        c00 = _mm512_dpbf16_ps(c00, x, b0); c01 = _mm512_dpbf16_ps(c01, x, b1);
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a + 2)));
+        c10 = _mm512_dpbf16_ps(c10, x, b0); c11 = _mm512_dpbf16_ps(c11, x, b1);
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a + 4)));
+        c20 = _mm512_dpbf16_ps(c20, x, b0); c21 = _mm512_dpbf16_ps(c21, x, b1);
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a + 6)));
+        c30 = _mm512_dpbf16_ps(c30, x, b0); c31 = _mm512_dpbf16_ps(c31, x, b1);
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a + 8)));
+        c40 = _mm512_dpbf16_ps(c40, x, b0); c41 = _mm512_dpbf16_ps(c41, x, b1);
+        x = (__m512bh) _mm512_set1_epi32(_mm_cvtsi128_si32(_mm_loadu_si32(a + 10)));
+        c50 = _mm512_dpbf16_ps(c50, x, b0); c51 = _mm512_dpbf16_ps(c51, x, b1);
+
+        a += 2 * GEMM_MR;
+        b += 2 * GEMM_NR_BF16;
+    }
+
+    _mm512_store_ps(block, c00);       _mm512_store_ps(block + 16, c01);
+    _mm512_store_ps(block + 32, c10);  _mm512_store_ps(block + 48, c11);
+    _mm512_store_ps(block + 64, c20);  _mm512_store_ps(block + 80, c21);
+    _mm512_store_ps(block + 96, c30);  _mm512_store_ps(block + 112, c31);
+    _mm512_store_ps(block + 128, c40); _mm512_store_ps(block + 144, c41);
+    _mm512_store_ps(block + 160, c50); _mm512_store_ps(block + 176, c51);
+#elif defined(__AVX2__)
+    // Without the bfloat16 instructions every lane of 32 bits holds a pair of depths of a column, the shift and the
+    // mask widen them to floats. 8 columns at a time, 6 registers per group
+    const __m256i high = _mm256_set1_epi32(int(0xFFFF0000u));
+
+    for (int g = 0; g < GEMM_NR_BF16; g += 8) {
+        const Bfloat16 *pa = a;
+        const Bfloat16 *pb = b + 2 * g;
+
+        __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps(), c2 = _mm256_setzero_ps();
+        __m256 c3 = _mm256_setzero_ps(), c4 = _mm256_setzero_ps(), c5 = _mm256_setzero_ps();
+
+        for (int q = 0; q < n_pairs; q++) {
+            __m256i pairs = _mm256_loadu_si256((const __m256i *) pb);
+            __m256 b0 = _mm256_castsi256_ps(_mm256_slli_epi32(pairs, 16));
+            __m256 b1 = _mm256_castsi256_ps(_mm256_and_si256(pairs, high));
+            __m256 x, y;
+
+#ifdef __FMA__
+            x = broadcastBfloat16(pa[0]); y = broadcastBfloat16(pa[1]);
+            c0 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c0));
+            x = broadcastBfloat16(pa[2]); y = broadcastBfloat16(pa[3]);
+            c1 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c1));
+            x = broadcastBfloat16(pa[4]); y = broadcastBfloat16(pa[5]);
+            c2 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c2));
+            x = broadcastBfloat16(pa[6]); y = broadcastBfloat16(pa[7]);
+            c3 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c3));
+            x = broadcastBfloat16(pa[8]); y = broadcastBfloat16(pa[9]);
+            c4 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c4));
+            x = broadcastBfloat16(pa[10]); y = broadcastBfloat16(pa[11]);
+            c5 = _mm256_fmadd_ps(y, b1, _mm256_fmadd_ps(x, b0, c5));
+#else
+            x = broadcastBfloat16(pa[0]); y = broadcastBfloat16(pa[1]);
+            c0 = _mm256_add_ps(c0, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+            x = broadcastBfloat16(pa[2]); y = broadcastBfloat16(pa[3]);
+            c1 = _mm256_add_ps(c1, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+            x = broadcastBfloat16(pa[4]); y = broadcastBfloat16(pa[5]);
+            c2 = _mm256_add_ps(c2, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+            x = broadcastBfloat16(pa[6]); y = broadcastBfloat16(pa[7]);
+            c3 = _mm256_add_ps(c3, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+            x = broadcastBfloat16(pa[8]); y = broadcastBfloat16(pa[9]);
+            c4 = _mm256_add_ps(c4, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+            x = broadcastBfloat16(pa[10]); y = broadcastBfloat16(pa[11]);
+            c5 = _mm256_add_ps(c5, _mm256_add_ps(_mm256_mul_ps(x, b0), _mm256_mul_ps(y, b1)));
+#endif
+            pa += 2 * GEMM_MR;
+            pb += 2 * GEMM_NR_BF16;
+        }
+
+        _mm256_store_ps(block + g, c0);
+        _mm256_store_ps(block + GEMM_NR_BF16 + g, c1);
+        _mm256_store_ps(block + 2 * GEMM_NR_BF16 + g, c2);
+        _mm256_store_ps(block + 3 * GEMM_NR_BF16 + g, c3);
+        _mm256_store_ps(block + 4 * GEMM_NR_BF16 + g, c4);
+        _mm256_store_ps(block + 5 * GEMM_NR_BF16 + g, c5);
+    }
+#else
+    std::fill(block, block + GEMM_MR * GEMM_NR_BF16, 0.0f);
+
+    for (int q = 0; q < n_pairs; q++) {
+        for (int r = 0; r < GEMM_MR; r++) {
+            float a0 = Bfloat16ToFloat(a[2 * r]);
+            float a1 = Bfloat16ToFloat(a[2 * r + 1]);
+
+            for (int c = 0; c < GEMM_NR_BF16; c++) {
+                block[r * GEMM_NR_BF16 + c] += a0 * Bfloat16ToFloat(b[2 * c]) + a1 * Bfloat16ToFloat(b[2 * c + 1]);
+            }
+        }
+
+        a += 2 * GEMM_MR;
+        b += 2 * GEMM_NR_BF16;
+    }
+#endif
+
+    storeBlock<GEMM_NR_BF16>(block, C, ldc, mr, nr, accumulate);
+}
+
+/**
+ * C = A * B, or C += A * B, with bfloat16 A and B, where A(i, p) = A[i * a_rs + p * a_cs] and
+ * B(p, j) = B[p * b_rs + j * b_cs]
+ *
+ * @param m           The number of rows of C
+ * @param n           The number of columns of C
+ * @param k           The inner dimension of the product
+ * @param A           The left matrix
+ * @param a_rs        The row stride of A
+ * @param a_cs        The column stride of A
+ * @param B           The right matrix
+ * @param b_rs        The row stride of B
+ * @param b_cs        The column stride of B
+ * @param C           The result
+ * @param ldc         The distance between two rows of C
+ * @param packing     The GEMM_PACKING_SIZE values of the packed blocks
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+static void gemmBf16(int m, int n, int k, const Bfloat16 *A, int a_rs, int a_cs, const Bfloat16 *B, int b_rs,
+                     int b_cs, T *C, int ldc, T *packing, bool accumulate) {
+
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+
+    if (k <= 0) {
+        if (!accumulate) {
+            for (int i = 0; i < m; i++) {
+                std::fill(C + size_t(i) * ldc, C + size_t(i) * ldc + n, T(0));
+            }
+        }
+        return;
+    }
+
+    // The bfloat16 blocks take up less than half of the buffer
+    auto *packed_A = reinterpret_cast<Bfloat16 *>(packing);
+    Bfloat16 *packed_B = packed_A + size_t(GEMM_MC + GEMM_MR) * GEMM_KC;
+
+    for (int jc = 0; jc < n; jc += GEMM_NC) {
+        int nc = std::min(GEMM_NC, n - jc);
+
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = std::min(GEMM_KC, k - pc);
+            int kc_pairs = (kc + 1) / 2 * 2;  // The depth of the packed panels
+
+            // The first block of the depth overwrites C unless the product is accumulated
+            bool add = accumulate || pc > 0;
+
+            packPairsB(kc, nc, B + size_t(pc) * b_rs + size_t(jc) * b_cs, b_rs, b_cs, packed_B);
+
+            for (int ic = 0; ic < m; ic += GEMM_MC) {
+                int mc = std::min(GEMM_MC, m - ic);
+
+                packPairsA(mc, kc, A + size_t(ic) * a_rs + size_t(pc) * a_cs, a_rs, a_cs, packed_A);
+
+                for (int jr = 0; jr < nc; jr += GEMM_NR_BF16) {
+                    const Bfloat16 *b = packed_B + size_t(jr) * kc_pairs;
+
+                    for (int ir = 0; ir < mc; ir += GEMM_MR) {
+                        const Bfloat16 *a = packed_A + size_t(ir) * kc_pairs;
+                        T *c = C + size_t(ic + ir) * ldc + jc + jr;
+
+                        microKernelBf16(kc, a, b, c, ldc, std::min(GEMM_MR, mc - ir), std::min(GEMM_NR_BF16, nc - jr),
+                                        add);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * C = A * B^T
+ *
+ * @param m           The number of rows of A and C
+ * @param n           The number of rows of B and columns of C
+ * @param k           The number of columns of A and B
+ * @param A           The m x k matrix A
+ * @param lda         The distance between two rows of A
+ * @param B           The n x k matrix B
+ * @param ldb         The distance between two rows of B
+ * @param C           The m x n result
+ * @param ldc         The distance between two rows of C
+ * @param packing     The GEMM_PACKING_SIZE values of the packing buffer of the calling thread
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+void GemmNT(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemm(m, n, k, A, lda, 1, B, 1, ldb, C, ldc, packing, accumulate);
+}
+
+/**
+ * C = A^T * B
+ *
+ * @param m           The number of columns of A and rows of C
+ * @param n           The number of columns of B and C
+ * @param k           The number of rows of A and B
+ * @param A           The k x m matrix A
+ * @param lda         The distance between two rows of A
+ * @param B           The k x n matrix B
+ * @param ldb         The distance between two rows of B
+ * @param C           The m x n result
+ * @param ldc         The distance between two rows of C
+ * @param packing     The GEMM_PACKING_SIZE values of the packing buffer of the calling thread
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+void GemmTN(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemm(m, n, k, A, 1, lda, B, ldb, 1, C, ldc, packing, accumulate);
+}
+
+/**
+ * C = A * B
+ *
+ * @param m           The number of rows of A and C
+ * @param n           The number of columns of B and C
+ * @param k           The number of columns of A and rows of B
+ * @param A           The m x k matrix A
+ * @param lda         The distance between two rows of A
+ * @param B           The k x n matrix B
+ * @param ldb         The distance between two rows of B
+ * @param C           The m x n result
+ * @param ldc         The distance between two rows of C
+ * @param packing     The GEMM_PACKING_SIZE values of the packing buffer of the calling thread
+ * @param accumulate  Whether to add the product to C
+ */
+template <typename T>
+void GemmNN(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemm(m, n, k, A, lda, 1, B, ldb, 1, C, ldc, packing, accumulate);
+}
+
+
+/**
+ * C = A * B^T with bfloat16 A and B, see GemmNT()
+ */
+template <typename T>
+void GemmNT(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemmBf16(m, n, k, A, lda, 1, B, 1, ldb, C, ldc, packing, accumulate);
+}
+
+/**
+ * C = A^T * B with bfloat16 A and B, see GemmTN()
+ */
+template <typename T>
+void GemmTN(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemmBf16(m, n, k, A, 1, lda, B, ldb, 1, C, ldc, packing, accumulate);
+}
+
+/**
+ * C = A * B with bfloat16 A and B, see GemmNN()
+ */
+template <typename T>
+void GemmNN(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate) {
+    gemmBf16(m, n, k, A, lda, 1, B, ldb, 1, C, ldc, packing, accumulate);
+}
+
+
+// The two scalar types of the network
+template void GemmNT(int, int, int, const float *, int, const float *, int, float *, int, float *, bool);
+template void GemmNT(int, int, int, const double *, int, const double *, int, double *, int, double *, bool);
+template void GemmTN(int, int, int, const float *, int, const float *, int, float *, int, float *, bool);
+template void GemmTN(int, int, int, const double *, int, const double *, int, double *, int, double *, bool);
+template void GemmNN(int, int, int, const float *, int, const float *, int, float *, int, float *, bool);
+template void GemmNN(int, int, int, const double *, int, const double *, int, double *, int, double *, bool);
+template void GemmNT(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, float *, int, float *, bool);
+template void GemmNT(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, double *, int, double *, bool);
+template void GemmTN(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, float *, int, float *, bool);
+template void GemmTN(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, double *, int, double *, bool);
+template void GemmNN(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, float *, int, float *, bool);
+template void GemmNN(int, int, int, const Bfloat16 *, int, const Bfloat16 *, int, double *, int, double *, bool);
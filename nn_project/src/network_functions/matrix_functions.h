@@ -0,0 +1,55 @@
+#ifndef NN_PROJECT_MATRIX_FUNCTIONS_H
+#define NN_PROJECT_MATRIX_FUNCTIONS_H
+
+#include "bfloat16_functions.h"
+
+#define GEMM_MR 6      // The rows of C computed together by the micro-kernel
+#define GEMM_NR 8      // The columns of C computed together by the micro-kernel, two AVX registers of doubles
+#define GEMM_NR_FLOAT 16  // The columns of C computed together by the float micro-kernel, two AVX registers of floats
+#define GEMM_NR_BF16 32   // The columns of C computed together by the bfloat16 micro-kernel, two AVX-512 registers
+#define GEMM_KC 256    // The depth of a packed block, a KC x NR panel of B stays in L1
+#define GEMM_MC 96     // The rows of a packed block of A, the MC x KC block stays in L2
+#define GEMM_NC 1024   // The columns of a packed block of B
+
+// The number of values of the packing buffer of a product, the packed block of A and then the packed block of B. It
+// is big enough for the panels of both scalar types
+#define GEMM_PACKING_SIZE ((GEMM_MC + GEMM_MR) * GEMM_KC + (GEMM_NC + GEMM_NR_FLOAT) * GEMM_KC)
+
+/*
+ * Cache blocked matrix multiplications on row major matrices. ld* is the distance between two rows of a matrix.
+ * If accumulate is true the product is added to C, otherwise C is overwritten. packing is a buffer of
+ * GEMM_PACKING_SIZE values that belongs to the calling thread, the products never allocate. T is float or double.
+ */
+
+// C = A * B^T, A is m x k and B is n x k (e.g. the weighted sums X * W^T of a batch)
+template <typename T>
+void GemmNT(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+// C = A^T * B, A is k x m and B is k x n (e.g. the weight gradients δ^T * X of a batch)
+template <typename T>
+void GemmTN(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+// C = A * B, A is m x k and B is k x n (e.g. the input errors δ * W of a batch)
+template <typename T>
+void GemmNN(int m, int n, int k, const T *A, int lda, const T *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+/*
+ * Mixed precision versions of the products: A and B are bfloat16 and the products are accumulated in float before they
+ * are stored or added to C. The packing buffer is the same as the one of the products of T.
+ */
+template <typename T>
+void GemmNT(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+template <typename T>
+void GemmTN(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+template <typename T>
+void GemmNN(int m, int n, int k, const Bfloat16 *A, int lda, const Bfloat16 *B, int ldb, T *C, int ldc, T *packing,
+            bool accumulate = false);
+
+#endif
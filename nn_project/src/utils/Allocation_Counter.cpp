@@ -0,0 +1,78 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "Allocation_Counter.h"
+
+
+static std::atomic<uint64_t> n_allocations {0};  // The number of calls to operator new so far
+
+
+/**
+ * Get the number of heap allocations of the program so far
+ *
+ * @return The number of allocations
+ */
+uint64_t Allocation_Counter::getCount() {
+    return n_allocations.load(std::memory_order_relaxed);
+}
+
+/**
+ * Count an allocation and allocate with malloc
+ *
+ * @param size  The size of the allocation in bytes
+ * @return      The memory, nullptr if it could not be allocated
+ */
+static void *countedAllocation(std::size_t size) noexcept {
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    return malloc(size == 0 ? 1 : size);
+}
+
+
+// ------------- Replacements of the global operators ------------- //
+void *operator new(std::size_t size) {
+    void *memory = countedAllocation(size);
+
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocation(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return countedAllocation(size);
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    free(memory);
+}
@@ -0,0 +1,18 @@
+#ifndef NN_PROJECT_ALLOCATION_COUNTER_H
+#define NN_PROJECT_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+
+/**
+ * Counts the heap allocations of the program. The global operator new (all the forms) is replaced by one that counts
+ * the calls before it allocates with malloc, so the difference of two getCount() calls is the number of allocations
+ * made in between by any thread.
+ */
+class Allocation_Counter {
+public:
+    static uint64_t getCount();
+};
+
+
+#endif
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "Arena.h"
+
+
+/**
+ * Class constructor. Allocates and zeroes the block of the arena
+ *
+ * @param size  The size of the arena in bytes
+ */
+Arena::Arena(size_t size) : size(alignedSize(size)) {
+    // new does not respect over-alignment in C++14
+    void *block = nullptr;
+    if (posix_memalign(&block, ARENA_ALIGNMENT, Arena::size) != 0) {
+        throw std::bad_alloc();
+    }
+
+    Arena::memory = (char *) block;
+    memset(Arena::memory, 0, Arena::size);
+}
+
+/**
+ * Class destructor
+ */
+Arena::~Arena() {
+    free(Arena::memory);
+}
+
+
+// ------------- Getters ------------- //
+/**
+ * Get the size of the arena
+ *
+ * @return The size of the arena in bytes
+ */
+size_t Arena::getSize() const {
+    return Arena::size;
+}
+
+/**
+ * Get the bytes handed out so far
+ *
+ * @return The used bytes
+ */
+size_t Arena::getUsed() const {
+    return Arena::used;
+}
+
+
+// ------------- Member functions ------------- //
+/**
+ * Round a size up to a multiple of ARENA_ALIGNMENT. This is the space an allocation of that size takes in the arena
+ *
+ * @param n_bytes  The size in bytes
+ * @return         The rounded size
+ */
+size_t Arena::alignedSize(size_t n_bytes) {
+    return (n_bytes + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
@@ -0,0 +1,66 @@
+#ifndef NN_PROJECT_ARENA_H
+#define NN_PROJECT_ARENA_H
+
+#include <cstddef>
+#include <new>
+
+#define ARENA_ALIGNMENT 64  // The alignment of every allocation of an arena in bytes (a cache line)
+
+
+/**
+ * A single block of memory, allocated once, from which the buffers of the network are carved out. Every allocation
+ * only moves a pointer forward and nothing is released before the arena is destroyed, so once the network is built
+ * no buffer of the training or the testing touches the heap. The memory starts zeroed.
+ */
+class Arena {
+public:
+    // Constructors
+    explicit Arena(size_t size);
+
+    // Copy constructors
+    Arena(const Arena &other) = delete;
+
+    // Destructor
+    ~Arena();
+
+    // Getters
+    size_t getSize() const;
+    size_t getUsed() const;
+
+    // Functions
+    template<class T>
+    T *allocate(size_t n_values);
+
+    static size_t alignedSize(size_t n_bytes);
+
+private:
+    char *memory {nullptr};   /// The block of the arena
+    size_t size {0};          /// The size of the block in bytes
+    size_t used {0};          /// The bytes handed out so far
+};
+
+
+/**
+ * Hand out an array from the arena. The array is aligned to ARENA_ALIGNMENT bytes and its size is rounded up to a
+ * multiple of it
+ *
+ * @tparam T        The type of the values
+ * @param n_values  The number of values
+ * @return          The array, valid as long as the arena
+ */
+template<class T>
+T *Arena::allocate(size_t n_values) {
+    size_t n_bytes = alignedSize(n_values * sizeof(T));
+
+    if (n_bytes > Arena::size - Arena::used) {
+        throw std::bad_alloc();
+    }
+
+    T *values = (T *) (Arena::memory + Arena::used);
+    Arena::used += n_bytes;
+
+    return values;
+}
+
+
+#endif